@@ -0,0 +1,83 @@
+#include "jobs.h"
+#include "platform.h"
+
+typedef struct {
+	void (*func)(void *user, uint32_t index);
+	void *user;
+	uint32_t len;
+	uint32_t first;
+	uint32_t stride;
+	void *start; // Posted when a batch is ready for this worker
+} jobs_worker_t;
+
+// The threads are started on the first call and then wait for the next
+// batch, so a load with many small batches doesn't pay for thread creation
+// each time. Worker 0 is always the calling thread.
+static jobs_worker_t workers[JOBS_WORKERS];
+static void *threads[JOBS_WORKERS];
+static void *done;
+static bool threads_started;
+
+static void jobs_worker_run(jobs_worker_t *w) {
+	for (uint32_t i = w->first; i < w->len; i += w->stride) {
+		w->func(w->user, i);
+	}
+}
+
+static void jobs_worker_thread(void *data) {
+	jobs_worker_t *w = data;
+	while (true) {
+		platform_sem_wait(w->start);
+		jobs_worker_run(w);
+		platform_sem_post(done);
+	}
+}
+
+static void jobs_start_threads(void) {
+	threads_started = true;
+	done = platform_sem_create();
+	if (!done) {
+		return;
+	}
+	for (uint32_t i = 1; i < JOBS_WORKERS; i++) {
+		workers[i].start = platform_sem_create();
+		if (workers[i].start) {
+			threads[i] = platform_thread_create(jobs_worker_thread, &workers[i]);
+		}
+	}
+}
+
+void jobs_run(void (*func)(void *user, uint32_t index), void *user, uint32_t len) {
+	if (len == 0) {
+		return;
+	}
+	if (!threads_started) {
+		jobs_start_threads();
+	}
+
+	uint32_t workers_len = len < JOBS_WORKERS ? len : JOBS_WORKERS;
+	for (uint32_t i = 0; i < workers_len; i++) {
+		workers[i].func = func;
+		workers[i].user = user;
+		workers[i].len = len;
+		workers[i].first = i;
+		workers[i].stride = workers_len;
+	}
+
+	// Any worker whose thread we failed to start runs on this thread
+	uint32_t posted = 0;
+	for (uint32_t i = 1; i < workers_len; i++) {
+		if (threads[i]) {
+			platform_sem_post(workers[i].start);
+			posted++;
+		}
+	}
+	for (uint32_t i = 0; i < workers_len; i++) {
+		if (i == 0 || !threads[i]) {
+			jobs_worker_run(&workers[i]);
+		}
+	}
+	for (uint32_t i = 0; i < posted; i++) {
+		platform_sem_wait(done);
+	}
+}
@@ -0,0 +1,20 @@
+#ifndef JOBS_H
+#define JOBS_H
+
+#include "types.h"
+
+// Number of threads used for load time work, including the calling thread.
+#ifndef JOBS_WORKERS
+	#define JOBS_WORKERS 4
+#endif
+
+// Calls func(user, index) for each index in 0..len-1, spread over the workers,
+// and returns when all calls have finished. Each worker takes every n-th
+// index, so which thread handles an index is fixed. The calls must not touch
+// the mem allocators or the renderer; allocate everything before and upload
+// everything after. Without threads, all calls run on the calling thread.
+// The worker threads are started on the first call and kept for the next
+// ones, so jobs_run() must not be called from more than one thread.
+void jobs_run(void (*func)(void *user, uint32_t index), void *user, uint32_t len);
+
+#endif
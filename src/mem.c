@@ -4,78 +4,318 @@
 #include "mem.h"
 #include "utils.h"
 
+#if defined(MEM_TELEMETRY)
+	// The functions below are the untagged versions
+	#undef mem_bump
+	#undef mem_bump_uninit
+	#undef mem_temp_alloc
+#endif
 
-static uint8_t hunk[MEM_HUNK_BYTES];
-static uint32_t bump_len = 0;
-static uint32_t temp_len = 0;
+#if defined(_WIN32)
+	#include <windows.h>
+	#define MEM_VIRTUAL_WIN32
+#elif (defined(__unix__) || defined(__APPLE__)) && !defined(__EMSCRIPTEN__) && !defined(__plan9__)
+	#include <sys/mman.h>
+	#define MEM_VIRTUAL_MMAP
+#endif
 
-static uint32_t temp_objects[MEM_TEMP_OBJECTS_MAX];
+
+typedef struct {
+	const char *name;
+	uint32_t cap;
+	uint8_t *base;
+	uint32_t len;
+	uint32_t committed;
+	#if defined(MEM_TELEMETRY)
+		uint32_t high_water;
+	#endif
+} arena_t;
+
+static arena_t arenas[MEM_ARENA_MAX] = {
+	[MEM_ARENA_PERSISTENT] = {.name = "persistent", .cap = MEM_PERSISTENT_BYTES},
+	[MEM_ARENA_SCENE]      = {.name = "scene",      .cap = MEM_SCENE_BYTES},
+	[MEM_ARENA_FRAME]      = {.name = "frame",      .cap = MEM_FRAME_BYTES},
+	[MEM_ARENA_TEMP]       = {.name = "temp",       .cap = MEM_TEMP_BYTES},
+};
+
+static mem_arena_t bump_arena = MEM_ARENA_PERSISTENT;
+
+typedef struct {
+	uint32_t start;
+	uint32_t end;
+} temp_object_t;
+
+static temp_object_t temp_objects[MEM_TEMP_OBJECTS_MAX];
 static uint32_t temp_objects_len;
 
 
-// Bump allocator - returns bytes from the front of the hunk
+// Address space for the whole cap is reserved on first use; chunks are
+// committed as the arena grows. Without virtual memory, the whole cap is
+// allocated at once.
 
-// These allocations persist for many frames. The allocator level is reset
-// whenever we load a new race track or menu in game_set_scene()
+static void arena_reserve(arena_t *a) {
+	#if defined(MEM_VIRTUAL_WIN32)
+		a->base = VirtualAlloc(NULL, a->cap, MEM_RESERVE, PAGE_NOACCESS);
+	#elif defined(MEM_VIRTUAL_MMAP)
+		a->base = mmap(NULL, a->cap, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+		if (a->base == MAP_FAILED) {
+			a->base = NULL;
+		}
+	#else
+		a->base = malloc(a->cap);
+		a->committed = a->cap;
+	#endif
+	error_if(!a->base, "Failed to reserve %d bytes for %s mem", a->cap, a->name);
+}
 
-void *mem_mark() {
-	return &hunk[bump_len];
+static void arena_commit(arena_t *a, uint32_t len) {
+	if (len <= a->committed) {
+		return;
+	}
+	uint32_t committed = minint(((len + MEM_CHUNK_BYTES - 1) / MEM_CHUNK_BYTES) * MEM_CHUNK_BYTES, a->cap);
+	#if defined(MEM_VIRTUAL_WIN32)
+		error_if(
+			!VirtualAlloc(a->base + a->committed, committed - a->committed, MEM_COMMIT, PAGE_READWRITE),
+			"Failed to commit %d bytes for %s mem", committed, a->name
+		);
+	#elif defined(MEM_VIRTUAL_MMAP)
+		error_if(
+			mprotect(a->base + a->committed, committed - a->committed, PROT_READ | PROT_WRITE) != 0,
+			"Failed to commit %d bytes for %s mem", committed, a->name
+		);
+	#endif
+	a->committed = committed;
 }
 
-void *mem_bump(uint32_t size) {
-	error_if(bump_len + temp_len + size >= MEM_HUNK_BYTES, "Failed to allocate %d bytes in hunk mem", size);
-	uint8_t *p = &hunk[bump_len];
-	bump_len += size;
+static void *arena_push(mem_arena_t arena, uint32_t size) {
+	arena_t *a = &arenas[arena];
+	error_if(size > a->cap - a->len, "Failed to allocate %d bytes in %s mem", size, a->name);
+	if (!a->base) {
+		arena_reserve(a);
+	}
+	arena_commit(a, a->len + size);
+	uint8_t *p = a->base + a->len;
+	a->len += size;
+	#if defined(MEM_TELEMETRY)
+		a->high_water = maxint(a->high_water, a->len);
+	#endif
+	return p;
+}
+
+void *mem_arena_alloc(mem_arena_t arena, uint32_t size) {
+	void *p = arena_push(arena, size);
 	memset(p, 0, size);
 	return p;
 }
 
+void *mem_arena_mark(mem_arena_t arena) {
+	arena_t *a = &arenas[arena];
+	if (!a->base) {
+		arena_reserve(a);
+	}
+	return a->base + a->len;
+}
+
+void mem_arena_reset(mem_arena_t arena, void *p) {
+	arena_t *a = &arenas[arena];
+	uint32_t offset = (uint8_t *)p - a->base;
+	error_if((uint8_t *)p < a->base || offset > a->len, "Invalid mem reset for %s mem", a->name);
+	a->len = offset;
+}
+
+uint32_t mem_arena_len(mem_arena_t arena) {
+	return arenas[arena].len;
+}
+
+
+
+// Bump allocator - returns bytes from the current bump arena
+
+// These allocations persist for many frames. The game loads its global assets
+// into the persistent arena and then switches to the scene arena, which is
+// reset whenever we load a new race track or menu in game_set_scene()
+
+void mem_set_bump_arena(mem_arena_t arena) {
+	error_if(arena == MEM_ARENA_TEMP, "The temp arena can't be used for bump allocations");
+	bump_arena = arena;
+}
+
+void *mem_mark() {
+	return mem_arena_mark(bump_arena);
+}
+
+void *mem_bump(uint32_t size) {
+	return mem_arena_alloc(bump_arena, size);
+}
+
+void *mem_bump_uninit(uint32_t size) {
+	return arena_push(bump_arena, size);
+}
+
 void mem_reset(void *p) {
-	uint32_t offset = (uint8_t *)p - (uint8_t *)hunk;
-	error_if(offset > bump_len || offset > MEM_HUNK_BYTES, "Invalid mem reset");
-	bump_len = offset;
+	for (int i = 0; i < MEM_ARENA_MAX; i++) {
+		arena_t *a = &arenas[i];
+		if (a->base && (uint8_t *)p >= a->base && (uint8_t *)p <= a->base + a->len) {
+			mem_arena_reset(i, p);
+			return;
+		}
+	}
+	die("Invalid mem reset");
 }
 
 
 
-// Temp allocator - returns bytes from the back of the hunk
+// Frame allocator - scratch bytes that are valid until the end of the frame.
+// Everything is released at once in system_update()
+
+void *mem_frame_alloc(uint32_t size) {
+	return mem_arena_alloc(MEM_ARENA_FRAME, size);
+}
+
+void mem_frame_reset() {
+	arenas[MEM_ARENA_FRAME].len = 0;
+}
+
+
+
+// Temp allocator - returns bytes from the temp arena
 
 // Temporary allocated bytes are not allowed to persist for multiple frames. You
-// need to explicitly free them when you are done. Temp allocated bytes don't 
-// have be freed in reverse allocation order. I.e. you can allocate A then B, 
+// need to explicitly free them when you are done. Temp allocated bytes don't
+// have be freed in reverse allocation order. I.e. you can allocate A then B,
 // and aftewards free A then B.
 
 void *mem_temp_alloc(uint32_t size) {
-	size = ((size >> 3) + 7) << 3; // allign to 8 bytes
+	size = ((maxint(size, 1) + 7) >> 3) << 3; // align to 8 bytes, never empty
 
-	error_if(bump_len + temp_len + size >= MEM_HUNK_BYTES, "Failed to allocate %d bytes in temp mem", size);
 	error_if(temp_objects_len >= MEM_TEMP_OBJECTS_MAX, "MEM_TEMP_OBJECTS_MAX reached");
 
-	temp_len += size;
-	void *p = &hunk[MEM_HUNK_BYTES - temp_len];
-	temp_objects[temp_objects_len++] = temp_len;
+	arena_t *a = &arenas[MEM_ARENA_TEMP];
+	uint8_t *p = arena_push(MEM_ARENA_TEMP, size);
+	temp_objects[temp_objects_len++] = (temp_object_t){.start = p - a->base, .end = a->len};
 	return p;
 }
 
 void mem_temp_free(void *p) {
-	uint32_t offset = (uint8_t *)&hunk[MEM_HUNK_BYTES] - (uint8_t *)p;
-	error_if(offset > MEM_HUNK_BYTES, "Object 0x%p not in temp hunk", p);
+	arena_t *a = &arenas[MEM_ARENA_TEMP];
+	error_if(!a->base || (uint8_t *)p < a->base || (uint8_t *)p >= a->base + a->len, "Object 0x%p not in temp mem", p);
 
+	uint32_t offset = (uint8_t *)p - a->base;
 	bool found = false;
 	uint32_t remaining_max = 0;
 	for (int i = 0; i < temp_objects_len; i++) {
-		if (temp_objects[i] == offset) {
+		if (temp_objects[i].start == offset) {
 			temp_objects[i--] = temp_objects[--temp_objects_len];
 			found = true;
 		}
-		else if (temp_objects[i] > remaining_max) {
-			remaining_max = temp_objects[i];
+		else if (temp_objects[i].end > remaining_max) {
+			remaining_max = temp_objects[i].end;
 		}
 	}
-	error_if(!found, "Object 0x%p not in temp hunk", p);
-	temp_len = remaining_max;
+	error_if(!found, "Object 0x%p not in temp mem", p);
+	a->len = remaining_max;
 }
 
 void mem_temp_check() {
-	error_if(temp_len != 0, "Temp memory not free: %d object(s)", temp_objects_len);
+	error_if(arenas[MEM_ARENA_TEMP].len != 0, "Temp memory not free: %d object(s)", temp_objects_len);
 }
+
+
+
+#if defined(MEM_TELEMETRY)
+
+typedef struct {
+	const char *file;
+	int line;
+	mem_arena_t arena;
+	uint32_t count;
+	uint32_t bytes;
+} mem_callsite_t;
+
+static mem_callsite_t callsites[MEM_TELEMETRY_CALLSITES_MAX];
+static uint32_t callsites_len;
+
+static void mem_telemetry_record(mem_arena_t arena, uint32_t size, const char *file, int line) {
+	mem_callsite_t *cs = NULL;
+	for (int i = 0; i < callsites_len; i++) {
+		if (callsites[i].line == line && callsites[i].arena == arena && strcmp(callsites[i].file, file) == 0) {
+			cs = &callsites[i];
+			break;
+		}
+	}
+	if (!cs) {
+		error_if(callsites_len >= MEM_TELEMETRY_CALLSITES_MAX, "MEM_TELEMETRY_CALLSITES_MAX reached");
+		cs = &callsites[callsites_len++];
+		*cs = (mem_callsite_t){.file = file, .line = line, .arena = arena};
+	}
+	cs->count++;
+	cs->bytes += size;
+}
+
+void *mem_bump_tagged(uint32_t size, const char *file, int line) {
+	mem_telemetry_record(bump_arena, size, file, line);
+	return mem_bump(size);
+}
+
+void *mem_bump_uninit_tagged(uint32_t size, const char *file, int line) {
+	mem_telemetry_record(bump_arena, size, file, line);
+	return mem_bump_uninit(size);
+}
+
+void *mem_temp_alloc_tagged(uint32_t size, const char *file, int line) {
+	mem_telemetry_record(MEM_ARENA_TEMP, size, file, line);
+	return mem_temp_alloc(size);
+}
+
+static int mem_callsite_cmp(const void *a, const void *b) {
+	uint32_t bytes_a = ((mem_callsite_t *)a)->bytes;
+	uint32_t bytes_b = ((mem_callsite_t *)b)->bytes;
+	return bytes_a < bytes_b ? 1 : (bytes_a > bytes_b ? -1 : 0);
+}
+
+void mem_telemetry_report(const char *scope) {
+	printf("mem report for %s\n", scope);
+	for (int i = 0; i < MEM_ARENA_MAX; i++) {
+		arena_t *a = &arenas[i];
+		printf(
+			"  %-10s %9d bytes used, %9d high-water, %9d committed of %9d\n",
+			a->name, a->len, a->high_water, a->committed, a->cap
+		);
+		a->high_water = a->len;
+	}
+
+	// Totals per source file, which is close enough to a subsystem
+	static mem_callsite_t files[MEM_TELEMETRY_CALLSITES_MAX];
+	uint32_t files_len = 0;
+	for (int i = 0; i < callsites_len; i++) {
+		int j = 0;
+		while (j < files_len && strcmp(files[j].file, callsites[i].file) != 0) {
+			j++;
+		}
+		if (j == files_len) {
+			files[files_len++] = (mem_callsite_t){.file = callsites[i].file};
+		}
+		files[j].count += callsites[i].count;
+		files[j].bytes += callsites[i].bytes;
+	}
+
+	qsort(files, files_len, sizeof(mem_callsite_t), mem_callsite_cmp);
+	qsort(callsites, callsites_len, sizeof(mem_callsite_t), mem_callsite_cmp);
+
+	printf("  by file:\n");
+	for (int i = 0; i < files_len; i++) {
+		printf("    %9d bytes in %6d allocs  %s\n", files[i].bytes, files[i].count, files[i].file);
+	}
+
+	printf("  by callsite:\n");
+	for (int i = 0; i < callsites_len; i++) {
+		mem_callsite_t *cs = &callsites[i];
+		printf(
+			"    %9d bytes in %6d allocs  %-10s %s:%d\n",
+			cs->bytes, cs->count, arenas[cs->arena].name, cs->file, cs->line
+		);
+	}
+	callsites_len = 0;
+}
+
+#endif
@@ -3,15 +3,76 @@
 
 #include "types.h"
 
-#define MEM_TEMP_OBJECTS_MAX 8
-#define MEM_HUNK_BYTES (4 * 1024 * 1024)
+// Each arena reserves address space for its hard cap up front and commits it
+// in chunks as it grows, so allocations in an arena stay contiguous. The caps
+// can be overridden at compile time.
 
+#ifndef MEM_PERSISTENT_BYTES
+	#define MEM_PERSISTENT_BYTES (4 * 1024 * 1024)
+#endif
+#ifndef MEM_SCENE_BYTES
+	#define MEM_SCENE_BYTES (16 * 1024 * 1024)
+#endif
+#ifndef MEM_FRAME_BYTES
+	#define MEM_FRAME_BYTES (1 * 1024 * 1024)
+#endif
+#ifndef MEM_TEMP_BYTES
+	#define MEM_TEMP_BYTES (16 * 1024 * 1024)
+#endif
+
+#define MEM_CHUNK_BYTES (256 * 1024)
+#define MEM_TEMP_OBJECTS_MAX 32
+
+typedef enum {
+	MEM_ARENA_PERSISTENT, // Lives as long as the game; global assets
+	MEM_ARENA_SCENE,      // Reset whenever a new race track or menu is loaded
+	MEM_ARENA_FRAME,      // Scratch, reset at the end of each frame
+	MEM_ARENA_TEMP,       // Load time temp objects; freed explicitly
+	MEM_ARENA_MAX
+} mem_arena_t;
+
+void *mem_arena_alloc(mem_arena_t arena, uint32_t size);
+void *mem_arena_mark(mem_arena_t arena);
+void mem_arena_reset(mem_arena_t arena, void *p);
+uint32_t mem_arena_len(mem_arena_t arena);
+
+// mem_bump() and mem_mark() use the current bump arena; mem_reset() works
+// with a mark from any arena.
+void mem_set_bump_arena(mem_arena_t arena);
+
+// mem_bump() clears the allocated bytes; mem_bump_uninit() leaves them as
+// they are, for buffers that are fully written right after.
 void *mem_bump(uint32_t size);
+void *mem_bump_uninit(uint32_t size);
 void *mem_mark(void);
 void mem_reset(void *p);
 
+void *mem_frame_alloc(uint32_t size);
+void mem_frame_reset(void);
+
 void *mem_temp_alloc(uint32_t size);
 void mem_temp_free(void *p);
 void mem_temp_check(void);
 
+
+// Telemetry. With MEM_TELEMETRY defined, each mem_bump() and mem_temp_alloc()
+// is tagged with its callsite. mem_telemetry_report() prints the high-water
+// mark of each arena and the allocations per callsite and source file since
+// the last report. Without MEM_TELEMETRY all of this compiles out.
+
+#if defined(MEM_TELEMETRY)
+	#define MEM_TELEMETRY_CALLSITES_MAX 512
+
+	void *mem_bump_tagged(uint32_t size, const char *file, int line);
+	void *mem_bump_uninit_tagged(uint32_t size, const char *file, int line);
+	void *mem_temp_alloc_tagged(uint32_t size, const char *file, int line);
+	void mem_telemetry_report(const char *scope);
+
+	#define mem_bump(SIZE) mem_bump_tagged(SIZE, __FILE__, __LINE__)
+	#define mem_bump_uninit(SIZE) mem_bump_uninit_tagged(SIZE, __FILE__, __LINE__)
+	#define mem_temp_alloc(SIZE) mem_temp_alloc_tagged(SIZE, __FILE__, __LINE__)
+#else
+	#define mem_telemetry_report(SCOPE)
+#endif
+
 #endif
@@ -0,0 +1,157 @@
+#include "occlusion.h"
+#include "utils.h"
+
+// A small software depth buffer for occlusion culling. Occluders (i.e. the 
+// track faces close to the camera) are rasterized into it each frame; the 
+// screen space bounds of potential occludees are then tested against it 
+// before they are submitted to the renderer. This runs entirely on the CPU 
+// and is independent of the render backend.
+
+#define OCCLUSION_NEAR_W 1.0
+
+static float depth[OCCLUSION_BUFFER_WIDTH * OCCLUSION_BUFFER_HEIGHT];
+static mat4_t vp_mat;
+static bool is_active = false;
+static occlusion_stats_t stats;
+
+typedef struct {
+	float x, y, z, w;
+} clip_pos_t;
+
+static inline clip_pos_t occlusion_project(vec3_t p) {
+	mat4_t *m = &vp_mat;
+	clip_pos_t c;
+	c.x = m->m[0] * p.x + m->m[4] * p.y + m->m[ 8] * p.z + m->m[12];
+	c.y = m->m[1] * p.x + m->m[5] * p.y + m->m[ 9] * p.z + m->m[13];
+	c.z = m->m[2] * p.x + m->m[6] * p.y + m->m[10] * p.z + m->m[14];
+	c.w = m->m[3] * p.x + m->m[7] * p.y + m->m[11] * p.z + m->m[15];
+	return c;
+}
+
+void occlusion_begin(mat4_t *view_projection) {
+	vp_mat = *view_projection;
+	is_active = true;
+	stats.occluder_tris = 0;
+	stats.tests = 0;
+	stats.rejected = 0;
+
+	for (int i = 0; i < OCCLUSION_BUFFER_WIDTH * OCCLUSION_BUFFER_HEIGHT; i++) {
+		depth[i] = 1.0;
+	}
+}
+
+void occlusion_end() {
+	is_active = false;
+}
+
+void occlusion_add_tris(tris_t *tris) {
+	if (!is_active) {
+		return;
+	}
+
+	// Project to buffer coordinates. Triangles that cross the near plane are
+	// just skipped; missing an occluder is always safe.
+	vec3_t s[3];
+	for (int i = 0; i < 3; i++) {
+		clip_pos_t c = occlusion_project(tris->vertices[i].pos);
+		if (c.w < OCCLUSION_NEAR_W) {
+			return;
+		}
+		s[i].x = ( c.x / c.w + 1.0) * 0.5 * OCCLUSION_BUFFER_WIDTH;
+		s[i].y = (-c.y / c.w + 1.0) * 0.5 * OCCLUSION_BUFFER_HEIGHT;
+		s[i].z = c.z / c.w;
+	}
+
+	float area = (s[1].x - s[0].x) * (s[2].y - s[0].y) - (s[2].x - s[0].x) * (s[1].y - s[0].y);
+	if (area == 0) {
+		return;
+	}
+	float inv_area = 1.0 / area;
+
+	int min_x = maxint(0, (int)floor(minfloat(s[0].x, minfloat(s[1].x, s[2].x))));
+	int min_y = maxint(0, (int)floor(minfloat(s[0].y, minfloat(s[1].y, s[2].y))));
+	int max_x = minint(OCCLUSION_BUFFER_WIDTH - 1, (int)ceil(maxfloat(s[0].x, maxfloat(s[1].x, s[2].x))));
+	int max_y = minint(OCCLUSION_BUFFER_HEIGHT - 1, (int)ceil(maxfloat(s[0].y, maxfloat(s[1].y, s[2].y))));
+	if (min_x > max_x || min_y > max_y) {
+		return;
+	}
+
+	stats.occluder_tris++;
+
+	// Barycentric weights at pixel centers; depth is affine in screen space
+	for (int y = min_y; y <= max_y; y++) {
+		float py = y + 0.5;
+		for (int x = min_x; x <= max_x; x++) {
+			float px = x + 0.5;
+			float w0 = ((s[1].x - px) * (s[2].y - py) - (s[2].x - px) * (s[1].y - py)) * inv_area;
+			float w1 = ((s[2].x - px) * (s[0].y - py) - (s[0].x - px) * (s[2].y - py)) * inv_area;
+			float w2 = 1.0 - w0 - w1;
+			if (w0 < 0 || w1 < 0 || w2 < 0) {
+				continue;
+			}
+
+			float z = w0 * s[0].z + w1 * s[1].z + w2 * s[2].z;
+			float *d = &depth[y * OCCLUSION_BUFFER_WIDTH + x];
+			if (z < *d) {
+				*d = z;
+			}
+		}
+	}
+}
+
+bool occlusion_test_aabb(vec3_t min, vec3_t max) {
+	if (!is_active) {
+		return true;
+	}
+	stats.tests++;
+
+	float sx0 = OCCLUSION_BUFFER_WIDTH, sy0 = OCCLUSION_BUFFER_HEIGHT, sz = 1.0;
+	float sx1 = 0, sy1 = 0;
+	for (int i = 0; i < 8; i++) {
+		vec3_t p = vec3(
+			(i & 1) ? max.x : min.x,
+			(i & 2) ? max.y : min.y,
+			(i & 4) ? max.z : min.z
+		);
+		clip_pos_t c = occlusion_project(p);
+
+		// Box reaches through the near plane; can't be occluded
+		if (c.w < OCCLUSION_NEAR_W) {
+			return true;
+		}
+		float x = ( c.x / c.w + 1.0) * 0.5 * OCCLUSION_BUFFER_WIDTH;
+		float y = (-c.y / c.w + 1.0) * 0.5 * OCCLUSION_BUFFER_HEIGHT;
+		sx0 = minfloat(sx0, x);
+		sy0 = minfloat(sy0, y);
+		sx1 = maxfloat(sx1, x);
+		sy1 = maxfloat(sy1, y);
+		sz = minfloat(sz, c.z / c.w);
+	}
+
+	// Grow by one pixel to be conservative about partially covered pixels
+	int min_x = maxint(0, (int)floor(sx0) - 1);
+	int min_y = maxint(0, (int)floor(sy0) - 1);
+	int max_x = minint(OCCLUSION_BUFFER_WIDTH - 1, (int)ceil(sx1) + 1);
+	int max_y = minint(OCCLUSION_BUFFER_HEIGHT - 1, (int)ceil(sy1) + 1);
+
+	// Completely off screen; leave that to the frustum test
+	if (min_x > max_x || min_y > max_y) {
+		return true;
+	}
+
+	for (int y = min_y; y <= max_y; y++) {
+		float *d = &depth[y * OCCLUSION_BUFFER_WIDTH];
+		for (int x = min_x; x <= max_x; x++) {
+			if (sz <= d[x]) {
+				return true;
+			}
+		}
+	}
+
+	stats.rejected++;
+	return false;
+}
+
+occlusion_stats_t occlusion_stats() {
+	return stats;
+}
@@ -0,0 +1,21 @@
+#ifndef OCCLUSION_H
+#define OCCLUSION_H
+
+#include "types.h"
+
+#define OCCLUSION_BUFFER_WIDTH 256
+#define OCCLUSION_BUFFER_HEIGHT 128
+
+typedef struct {
+	int32_t occluder_tris;
+	int32_t tests;
+	int32_t rejected;
+} occlusion_stats_t;
+
+void occlusion_begin(mat4_t *view_projection);
+void occlusion_end(void);
+void occlusion_add_tris(tris_t *tris);
+bool occlusion_test_aabb(vec3_t min, vec3_t max);
+occlusion_stats_t occlusion_stats(void);
+
+#endif
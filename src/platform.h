@@ -6,11 +6,38 @@
 void platform_exit(void);
 vec2i_t platform_screen_size(void);
 double platform_now(void);
+
+// The wall clock, for measuring how long something took. platform_now() is
+// the game's clock, which may advance in fixed steps per frame instead.
+double platform_real_time(void);
 void platform_set_fullscreen(bool fullscreen);
 void platform_set_audio_mix_cb(void (*cb)(float *buffer, uint32_t len));
 
+// Returns NULL if the platform can't run threads; the caller then has to do
+// the work on the main thread itself.
+void *platform_thread_create(void (*func)(void *user), void *user);
+void platform_thread_join(void *thread);
+
+// Counting semaphores to hand work to threads; NULL where threads aren't
+// supported.
+void *platform_sem_create(void);
+void platform_sem_post(void *sem);
+void platform_sem_wait(void *sem);
+void platform_sleep(double seconds);
+
 #if defined(RENDERER_SOFTWARE)
 	rgba_t *platform_get_screenbuffer(int32_t *pitch);
 #endif
 
+#if defined(RENDERER_VULKAN)
+	#include <vulkan/vulkan.h>
+
+	// The instance extensions needed to present to the window
+	const char **platform_vulkan_extensions(uint32_t *len);
+
+	// Returns VK_NULL_HANDLE if there is nothing to present to; the renderer
+	// then draws offscreen only.
+	VkSurfaceKHR platform_vulkan_create_surface(VkInstance instance);
+#endif
+
 #endif
@@ -0,0 +1,402 @@
+#include <pthread.h>
+#include <time.h>
+
+#include "platform.h"
+#include "system.h"
+#include "render.h"
+#include "utils.h"
+#include "mem.h"
+#include "wipeout/image.h"
+
+// A platform without a window, input or audio device. It runs a fixed number
+// of frames as fast as possible and prints how long they took. The game sees
+// a fixed 60hz clock, so runs are repeatable regardless of the host speed.
+//
+// Usage: wipegame [frames] [capture path]
+//        wipegame lzss file.cmp...
+//        wipegame tim file.cmp...
+//
+// The other forms benchmark the LZSS or TIM decoder against its reference
+// decoder on the given files and check that both produce the same bytes.
+
+#define PLATFORM_HEADLESS_FRAMES 3600
+#define PLATFORM_HEADLESS_TICK (1.0/60.0)
+
+static bool wants_to_exit = false;
+static uint64_t frame_index = 0;
+
+double platform_real_time(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+void platform_exit(void) {
+	wants_to_exit = true;
+}
+
+double platform_now(void) {
+	return frame_index * PLATFORM_HEADLESS_TICK;
+}
+
+void platform_set_fullscreen(bool fullscreen) {}
+
+void platform_set_audio_mix_cb(void (*cb)(float *buffer, uint32_t len)) {}
+
+vec2i_t platform_screen_size(void) {
+	return vec2i(SYSTEM_WINDOW_WIDTH, SYSTEM_WINDOW_HEIGHT);
+}
+
+typedef struct {
+	pthread_t thread;
+	void (*func)(void *user);
+	void *user;
+} platform_thread_t;
+
+static void *platform_thread_run(void *data) {
+	platform_thread_t *t = data;
+	t->func(t->user);
+	return NULL;
+}
+
+void *platform_thread_create(void (*func)(void *user), void *user) {
+	platform_thread_t *t = malloc(sizeof(platform_thread_t));
+	t->func = func;
+	t->user = user;
+	if (pthread_create(&t->thread, NULL, platform_thread_run, t) != 0) {
+		free(t);
+		return NULL;
+	}
+	return t;
+}
+
+void platform_thread_join(void *thread) {
+	platform_thread_t *t = thread;
+	pthread_join(t->thread, NULL);
+	free(t);
+}
+
+typedef struct {
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+	uint32_t count;
+} platform_sem_t;
+
+void *platform_sem_create(void) {
+	platform_sem_t *s = malloc(sizeof(platform_sem_t));
+	pthread_mutex_init(&s->mutex, NULL);
+	pthread_cond_init(&s->cond, NULL);
+	s->count = 0;
+	return s;
+}
+
+void platform_sem_post(void *sem) {
+	platform_sem_t *s = sem;
+	pthread_mutex_lock(&s->mutex);
+	s->count++;
+	pthread_cond_signal(&s->cond);
+	pthread_mutex_unlock(&s->mutex);
+}
+
+void platform_sem_wait(void *sem) {
+	platform_sem_t *s = sem;
+	pthread_mutex_lock(&s->mutex);
+	while (s->count == 0) {
+		pthread_cond_wait(&s->cond, &s->mutex);
+	}
+	s->count--;
+	pthread_mutex_unlock(&s->mutex);
+}
+
+void platform_sleep(double seconds) {
+	struct timespec ts = {
+		.tv_sec = (time_t)seconds,
+		.tv_nsec = (long)((seconds - (time_t)seconds) * 1e9)
+	};
+	nanosleep(&ts, NULL);
+}
+
+
+#if defined(RENDERER_GL) // ----------------------------------------------------
+	// An offscreen context on a pbuffer surface. With Mesa's surfaceless
+	// platform this needs neither X11 nor a GPU; llvmpipe is fine.
+	#include <EGL/egl.h>
+	#include <EGL/eglext.h>
+
+	static EGLDisplay egl_display;
+	static EGLSurface egl_surface;
+	static EGLContext egl_context;
+
+	void platform_video_init(void) {
+		egl_display = EGL_NO_DISPLAY;
+		PFNEGLGETPLATFORMDISPLAYEXTPROC get_platform_display =
+			(PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+		if (get_platform_display) {
+			egl_display = get_platform_display(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+		}
+		if (egl_display == EGL_NO_DISPLAY) {
+			egl_display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+		}
+		error_if(!eglInitialize(egl_display, NULL, NULL), "Failed to initialize EGL");
+
+		#if defined(USE_GLES2)
+			EGLint renderable_type = EGL_OPENGL_ES2_BIT;
+			EGLint context_attribs[] = {EGL_CONTEXT_CLIENT_VERSION, 2, EGL_NONE};
+			eglBindAPI(EGL_OPENGL_ES_API);
+		#else
+			EGLint renderable_type = EGL_OPENGL_BIT;
+			EGLint context_attribs[] = {
+				EGL_CONTEXT_MAJOR_VERSION, 3,
+				EGL_CONTEXT_MINOR_VERSION, 3,
+				EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+				EGL_NONE
+			};
+			eglBindAPI(EGL_OPENGL_API);
+		#endif
+
+		EGLint config_attribs[] = {
+			EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+			EGL_RENDERABLE_TYPE, renderable_type,
+			EGL_RED_SIZE, 8,
+			EGL_GREEN_SIZE, 8,
+			EGL_BLUE_SIZE, 8,
+			EGL_DEPTH_SIZE, 24,
+			EGL_NONE
+		};
+		EGLConfig config;
+		EGLint configs_len = 0;
+		eglChooseConfig(egl_display, config_attribs, &config, 1, &configs_len);
+		error_if(configs_len == 0, "No EGL config with pbuffer support");
+
+		EGLint surface_attribs[] = {
+			EGL_WIDTH, SYSTEM_WINDOW_WIDTH,
+			EGL_HEIGHT, SYSTEM_WINDOW_HEIGHT,
+			EGL_NONE
+		};
+		egl_surface = eglCreatePbufferSurface(egl_display, config, surface_attribs);
+		error_if(egl_surface == EGL_NO_SURFACE, "Failed to create EGL pbuffer surface");
+
+		egl_context = eglCreateContext(egl_display, config, EGL_NO_CONTEXT, context_attribs);
+		#if !defined(USE_GLES2)
+			// No 3.3 core context; the renderer falls back to its GL2 path
+			if (egl_context == EGL_NO_CONTEXT) {
+				egl_context = eglCreateContext(egl_display, config, EGL_NO_CONTEXT, (EGLint[]){EGL_NONE});
+			}
+		#endif
+		error_if(egl_context == EGL_NO_CONTEXT, "Failed to create EGL context");
+		error_if(!eglMakeCurrent(egl_display, egl_surface, egl_surface, egl_context), "Failed to make EGL context current");
+
+		printf("headless: %s\n", eglQueryString(egl_display, EGL_VENDOR));
+	}
+
+	void platform_video_cleanup(void) {
+		eglMakeCurrent(egl_display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+		eglDestroyContext(egl_display, egl_context);
+		eglDestroySurface(egl_display, egl_surface);
+		eglTerminate(egl_display);
+	}
+
+	void platform_end_frame(void) {
+		eglSwapBuffers(egl_display, egl_surface);
+	}
+
+#elif defined(RENDERER_SOFTWARE) // ----------------------------------------------
+	static rgba_t screenbuffer[SYSTEM_WINDOW_WIDTH * SYSTEM_WINDOW_HEIGHT];
+
+	void platform_video_init(void) {}
+	void platform_video_cleanup(void) {}
+	void platform_end_frame(void) {}
+
+	rgba_t *platform_get_screenbuffer(int32_t *pitch) {
+		*pitch = SYSTEM_WINDOW_WIDTH * sizeof(rgba_t);
+		return screenbuffer;
+	}
+
+#elif defined(RENDERER_VULKAN) // ------------------------------------------------
+	// No surface; the renderer draws into an offscreen image. Lavapipe is fine.
+	void platform_video_init(void) {}
+	void platform_video_cleanup(void) {}
+	void platform_end_frame(void) {}
+
+	const char **platform_vulkan_extensions(uint32_t *len) {
+		*len = 0;
+		return NULL;
+	}
+
+	VkSurfaceKHR platform_vulkan_create_surface(VkInstance instance) {
+		return VK_NULL_HANDLE;
+	}
+
+#elif defined(RENDERER_NULL) // --------------------------------------------------
+	void platform_video_init(void) {}
+	void platform_video_cleanup(void) {}
+	void platform_end_frame(void) {}
+
+#else
+	#error "Unsupported renderer for platform HEADLESS"
+#endif
+
+
+void global_init(void);
+
+#define PLATFORM_HEADLESS_BENCHMARK_SECONDS 0.25
+
+static double platform_lzss_decode_time(uint8_t *in, uint32_t in_size, uint8_t *out, uint32_t out_size, bool reference) {
+	int runs = 0;
+	double time_start = platform_real_time();
+	double time_total = 0;
+	while (time_total < PLATFORM_HEADLESS_BENCHMARK_SECONDS) {
+		if (reference) {
+			lzss_decompress_reference(in, out);
+		}
+		else {
+			lzss_decompress(in, in_size, out, out_size);
+		}
+		runs++;
+		time_total = platform_real_time() - time_start;
+	}
+	return time_total / runs;
+}
+
+static int platform_lzss_benchmark(int paths_len, char **paths) {
+	int mismatches = 0;
+	for (int i = 0; i < paths_len; i++) {
+		uint32_t size;
+		uint8_t *bytes = file_load(paths[i], &size);
+
+		uint32_t p = 0;
+		uint32_t out_size = 0;
+		int32_t image_count = get_i32_le(bytes, &p);
+		for (int j = 0; j < image_count; j++) {
+			out_size += get_i32_le(bytes, &p);
+		}
+
+		// The reference decoder may write past the end on broken files
+		uint8_t *out_reference = mem_temp_alloc(out_size + 1024);
+		uint8_t *out = mem_temp_alloc(out_size);
+		double time_reference = platform_lzss_decode_time(bytes + p, size - p, out_reference, out_size, true);
+		double time = platform_lzss_decode_time(bytes + p, size - p, out, out_size, false);
+		bool identical = memcmp(out, out_reference, out_size) == 0;
+		mismatches += !identical;
+
+		printf(
+			"lzss: %s: %d bytes, reference %.1f MB/s, fast %.1f MB/s, %.2fx, %s\n",
+			paths[i], out_size, 
+			out_size / time_reference / (1024 * 1024), out_size / time / (1024 * 1024), 
+			time_reference / time, identical ? "identical" : "MISMATCH"
+		);
+		mem_temp_free(out);
+		mem_temp_free(out_reference);
+		mem_temp_free(bytes);
+	}
+	return mismatches ? 1 : 0;
+}
+
+static double platform_tim_decode_time(cmp_t *cmp, rgba_t **pixels, bool reference) {
+	int runs = 0;
+	double time_start = platform_real_time();
+	double time_total = 0;
+	while (time_total < PLATFORM_HEADLESS_BENCHMARK_SECONDS) {
+		for (int i = 0; i < cmp->len; i++) {
+			if (reference) {
+				image_decode_from_bytes_reference(cmp->entries[i], false, pixels[i]);
+			}
+			else {
+				image_decode_from_bytes(cmp->entries[i], false, pixels[i]);
+			}
+		}
+		runs++;
+		time_total = platform_real_time() - time_start;
+	}
+	return time_total / runs;
+}
+
+static int platform_tim_benchmark(int paths_len, char **paths) {
+	int mismatches = 0;
+	for (int i = 0; i < paths_len; i++) {
+		cmp_t *cmp = image_load_compressed(paths[i]);
+
+		uint32_t pixels_len = 0;
+		for (int j = 0; j < cmp->len; j++) {
+			uint32_t width, height;
+			image_size_from_bytes(cmp->entries[j], &width, &height);
+			pixels_len += width * height;
+		}
+
+		rgba_t **pixels = mem_temp_alloc(sizeof(rgba_t *) * cmp->len * 2);
+		rgba_t *pixels_new = mem_temp_alloc(sizeof(rgba_t) * pixels_len);
+		rgba_t *pixels_reference = mem_temp_alloc(sizeof(rgba_t) * pixels_len);
+		for (int j = 0, offset = 0; j < cmp->len; j++) {
+			uint32_t width, height;
+			image_size_from_bytes(cmp->entries[j], &width, &height);
+			pixels[j] = pixels_new + offset;
+			pixels[cmp->len + j] = pixels_reference + offset;
+			offset += width * height;
+		}
+
+		double time_reference = platform_tim_decode_time(cmp, pixels + cmp->len, true);
+		double time = platform_tim_decode_time(cmp, pixels, false);
+		bool identical = memcmp(pixels_new, pixels_reference, sizeof(rgba_t) * pixels_len) == 0;
+
+		// The semi transparent variant is only checked
+		for (int j = 0; j < cmp->len; j++) {
+			image_decode_from_bytes_reference(cmp->entries[j], true, pixels[cmp->len + j]);
+			image_decode_from_bytes(cmp->entries[j], true, pixels[j]);
+		}
+		identical = identical && memcmp(pixels_new, pixels_reference, sizeof(rgba_t) * pixels_len) == 0;
+		mismatches += !identical;
+
+		printf(
+			"tim: %s: %d images, %d pixels, reference %.1f MP/s, fast %.1f MP/s, %.2fx, %s\n",
+			paths[i], cmp->len, pixels_len,
+			pixels_len / time_reference / 1e6, pixels_len / time / 1e6,
+			time_reference / time, identical ? "identical" : "MISMATCH"
+		);
+		mem_temp_free(pixels_reference);
+		mem_temp_free(pixels_new);
+		mem_temp_free(pixels);
+		mem_temp_free(cmp);
+	}
+	return mismatches ? 1 : 0;
+}
+
+int main(int argc, char *argv[]) {
+	if (argc > 1 && strcmp(argv[1], "lzss") == 0) {
+		return platform_lzss_benchmark(argc - 2, argv + 2);
+	}
+	if (argc > 1 && strcmp(argv[1], "tim") == 0) {
+		return platform_tim_benchmark(argc - 2, argv + 2);
+	}
+
+	uint64_t frames = PLATFORM_HEADLESS_FRAMES;
+	if (argc > 1) {
+		frames = strtoull(argv[1], NULL, 10);
+	}
+
+	#if !defined(RENDERER_GL)
+		global_init();
+	#endif
+	platform_video_init();
+	system_init();
+	if (argc > 2) {
+		render_capture_start(argv[2]);
+	}
+
+	double time_start = platform_real_time();
+	while (!wants_to_exit && frame_index < frames) {
+		frame_index++;
+		system_update();
+		platform_end_frame();
+	}
+	double time_total = platform_real_time() - time_start;
+
+	printf(
+		"headless: %llu frames in %.3fs, %.3fms per frame\n",
+		(unsigned long long)frame_index, time_total,
+		frame_index ? (time_total * 1000.0) / frame_index : 0
+	);
+
+	system_cleanup();
+	platform_video_cleanup();
+	return 0;
+}
@@ -3,6 +3,13 @@
 #include "platform.h"
 #include "input.h"
 #include "system.h"
+#include "render.h"
+#include "utils.h"
+
+// Usage: wipegame [capture path]
+//
+// With a capture path, every frame is recorded from the start; see
+// render_capture_start().
 
 static uint64_t perf_freq = 0;
 static bool wants_to_exit = false;
@@ -86,6 +93,10 @@ double platform_now() {
 	return (double)perf_counter / (double)perf_freq;
 }
 
+double platform_real_time(void) {
+	return platform_now();
+}
+
 void platform_set_fullscreen(bool fullscreen) {
 	if (fullscreen) {
 		int32_t display = SDL_GetWindowDisplayIndex(window);
@@ -116,6 +127,52 @@ void platform_set_audio_mix_cb(void (*cb)(float *buffer, uint32_t len)) {
 	SDL_PauseAudioDevice(audio_device, 0);
 }
 
+typedef struct {
+	SDL_Thread *thread;
+	void (*func)(void *user);
+	void *user;
+} platform_thread_t;
+
+static int platform_thread_run(void *data) {
+	platform_thread_t *t = data;
+	t->func(t->user);
+	return 0;
+}
+
+void *platform_thread_create(void (*func)(void *user), void *user) {
+	platform_thread_t *t = malloc(sizeof(platform_thread_t));
+	t->func = func;
+	t->user = user;
+	t->thread = SDL_CreateThread(platform_thread_run, "worker", t);
+	if (!t->thread) {
+		free(t);
+		return NULL;
+	}
+	return t;
+}
+
+void platform_thread_join(void *thread) {
+	platform_thread_t *t = thread;
+	SDL_WaitThread(t->thread, NULL);
+	free(t);
+}
+
+void *platform_sem_create(void) {
+	return SDL_CreateSemaphore(0);
+}
+
+void platform_sem_post(void *sem) {
+	SDL_SemPost(sem);
+}
+
+void platform_sem_wait(void *sem) {
+	SDL_SemWait(sem);
+}
+
+void platform_sleep(double seconds) {
+	SDL_Delay(seconds * 1000);
+}
+
 
 #if defined(RENDERER_GL) // ----------------------------------------------------
 	#define PLATFORM_WINDOW_FLAGS SDL_WINDOW_OPENGL
@@ -126,9 +183,22 @@ void platform_set_audio_mix_cb(void (*cb)(float *buffer, uint32_t len)) {
 			SDL_GL_SetAttribute(SDL_GL_CONTEXT_PROFILE_MASK, SDL_GL_CONTEXT_PROFILE_ES);
 			SDL_GL_SetAttribute(SDL_GL_CONTEXT_MAJOR_VERSION, 2);
 			SDL_GL_SetAttribute(SDL_GL_CONTEXT_MINOR_VERSION, 1);
+		#elif !defined(__APPLE__)
+			// Ask for a 3.3 core context first; the renderer falls back to its
+			// GL2 path with whatever context we get otherwise
+			SDL_GL_SetAttribute(SDL_GL_CONTEXT_PROFILE_MASK, SDL_GL_CONTEXT_PROFILE_CORE);
+			SDL_GL_SetAttribute(SDL_GL_CONTEXT_MAJOR_VERSION, 3);
+			SDL_GL_SetAttribute(SDL_GL_CONTEXT_MINOR_VERSION, 3);
 		#endif
 
 		platform_gl = SDL_GL_CreateContext(window);
+		#if !defined(USE_GLES2) && !defined(__APPLE__)
+			if (!platform_gl) {
+				SDL_GL_ResetAttributes();
+				platform_gl = SDL_GL_CreateContext(window);
+			}
+		#endif
+		error_if(!platform_gl, "Failed to create GL context: %s", SDL_GetError());
 		SDL_GL_SetSwapInterval(1);
 	}
 
@@ -203,6 +273,54 @@ void platform_set_audio_mix_cb(void (*cb)(float *buffer, uint32_t len)) {
 		return screen_size;
 	}
 
+#elif defined(RENDERER_VULKAN) // ------------------------------------------------
+	#include <SDL2/SDL_vulkan.h>
+	#define PLATFORM_WINDOW_FLAGS SDL_WINDOW_VULKAN
+
+	static const char *vulkan_extensions[16];
+
+	void platform_video_init(void) {}
+	void platform_video_cleanup(void) {}
+	void platform_prepare_frame(void) {}
+
+	void platform_end_frame(void) {
+		// The renderer presents the swapchain itself
+	}
+
+	const char **platform_vulkan_extensions(uint32_t *len) {
+		unsigned int count = len(vulkan_extensions);
+		error_if(!SDL_Vulkan_GetInstanceExtensions(window, &count, vulkan_extensions), "SDL_Vulkan_GetInstanceExtensions: %s", SDL_GetError());
+		*len = count;
+		return vulkan_extensions;
+	}
+
+	VkSurfaceKHR platform_vulkan_create_surface(VkInstance instance) {
+		VkSurfaceKHR surface;
+		error_if(!SDL_Vulkan_CreateSurface(window, instance, &surface), "SDL_Vulkan_CreateSurface: %s", SDL_GetError());
+		return surface;
+	}
+
+	vec2i_t platform_screen_size(void) {
+		int width, height;
+		SDL_Vulkan_GetDrawableSize(window, &width, &height);
+		return vec2i(width, height);
+	}
+
+#elif defined(RENDERER_NULL) // --------------------------------------------------
+	// The window is just there to receive input; nothing is ever drawn to it
+	#define PLATFORM_WINDOW_FLAGS 0
+
+	void platform_video_init(void) {}
+	void platform_video_cleanup(void) {}
+	void platform_prepare_frame(void) {}
+	void platform_end_frame(void) {}
+
+	vec2i_t platform_screen_size(void) {
+		int width, height;
+		SDL_GetWindowSize(window, &width, &height);
+		return vec2i(width, height);
+	}
+
 #else
 	#error "Unsupported renderer for platform SDL"
 #endif
@@ -235,6 +353,9 @@ int main(int argc, char *argv[]) {
 
 	platform_video_init();
 	system_init();
+	if (argc > 1) {
+		render_capture_start(argv[1]);
+	}
 
 	while (!wants_to_exit) {
 		platform_pump_events();
@@ -243,6 +364,9 @@ int main(int argc, char *argv[]) {
 		platform_end_frame();
 	}
 
+	// Flush the frames still queued for the capture, before the renderer
+	// goes away
+	render_capture_stop();
 	system_cleanup();
 	platform_video_cleanup();
 
@@ -1,5 +1,11 @@
 #include "platform.h"
 #include "system.h"
+#include "render.h"
+
+// Usage: wipegame [capture path]
+//
+// With a capture path, every frame is recorded from the start; see
+// render_capture_start().
 
 #if defined(RENDERER_GL)
 	#ifdef __EMSCRIPTEN__
@@ -155,6 +161,10 @@ double platform_now() {
 	return stm_sec(stm_now());
 }
 
+double platform_real_time(void) {
+	return platform_now();
+}
+
 void platform_set_fullscreen(bool fullscreen) {
 	if (fullscreen == sapp_is_fullscreen()) {
 		return;
@@ -233,8 +243,120 @@ void platform_set_audio_mix_cb(void (*cb)(float *buffer, uint32_t len)) {
 	audio_callback = cb;
 }
 
+#if defined(__EMSCRIPTEN__)
+	// We don't build with -pthread for the web
+	void *platform_thread_create(void (*func)(void *user), void *user) {
+		return NULL;
+	}
+
+	void platform_thread_join(void *thread) {}
+
+	void *platform_sem_create(void) {
+		return NULL;
+	}
+
+	void platform_sem_post(void *sem) {}
+
+	void platform_sem_wait(void *sem) {}
+
+	void platform_sleep(double seconds) {}
+
+#else
+	#include <pthread.h>
+	#include <time.h>
+
+	typedef struct {
+		pthread_t thread;
+		void (*func)(void *user);
+		void *user;
+	} platform_thread_t;
+
+	static void *platform_thread_run(void *data) {
+		platform_thread_t *t = data;
+		t->func(t->user);
+		return NULL;
+	}
+
+	void *platform_thread_create(void (*func)(void *user), void *user) {
+		platform_thread_t *t = malloc(sizeof(platform_thread_t));
+		t->func = func;
+		t->user = user;
+		if (pthread_create(&t->thread, NULL, platform_thread_run, t) != 0) {
+			free(t);
+			return NULL;
+		}
+		return t;
+	}
+
+	void platform_thread_join(void *thread) {
+		platform_thread_t *t = thread;
+		pthread_join(t->thread, NULL);
+		free(t);
+	}
+
+	// Unnamed POSIX semaphores are missing on macOS
+	typedef struct {
+		pthread_mutex_t mutex;
+		pthread_cond_t cond;
+		uint32_t count;
+	} platform_sem_t;
+
+	void *platform_sem_create(void) {
+		platform_sem_t *s = malloc(sizeof(platform_sem_t));
+		pthread_mutex_init(&s->mutex, NULL);
+		pthread_cond_init(&s->cond, NULL);
+		s->count = 0;
+		return s;
+	}
+
+	void platform_sem_post(void *sem) {
+		platform_sem_t *s = sem;
+		pthread_mutex_lock(&s->mutex);
+		s->count++;
+		pthread_cond_signal(&s->cond);
+		pthread_mutex_unlock(&s->mutex);
+	}
+
+	void platform_sem_wait(void *sem) {
+		platform_sem_t *s = sem;
+		pthread_mutex_lock(&s->mutex);
+		while (s->count == 0) {
+			pthread_cond_wait(&s->cond, &s->mutex);
+		}
+		s->count--;
+		pthread_mutex_unlock(&s->mutex);
+	}
+
+	void platform_sleep(double seconds) {
+		struct timespec ts = {
+			.tv_sec = (time_t)seconds,
+			.tv_nsec = (long)((seconds - (time_t)seconds) * 1e9)
+		};
+		nanosleep(&ts, NULL);
+	}
+#endif
+
+static const char *capture_path = NULL;
+
+static void platform_init(void) {
+	system_init();
+	if (capture_path) {
+		render_capture_start(capture_path);
+	}
+}
+
+static void platform_cleanup(void) {
+	// Flush the frames still queued for the capture, before the renderer
+	// goes away
+	render_capture_stop();
+	system_cleanup();
+}
+
 sapp_desc sokol_main(int argc, char* argv[]) {
 	stm_setup();
+	if (argc > 1) {
+		capture_path = argv[1];
+	}
 
 	saudio_setup(&(saudio_desc){
 		.sample_rate = 44100,
@@ -247,9 +369,9 @@ sapp_desc sokol_main(int argc, char* argv[]) {
 	return (sapp_desc) {
 		.width = SYSTEM_WINDOW_WIDTH,
 		.height = SYSTEM_WINDOW_HEIGHT,
-		.init_cb = system_init,
+		.init_cb = platform_init,
 		.frame_cb = system_update,
-		.cleanup_cb = system_cleanup,
+		.cleanup_cb = platform_cleanup,
 		.event_cb = platform_handle_event,
 		.win32_console_attach = true
 	};
@@ -22,6 +22,14 @@ typedef enum {
 
 #define RENDER_USE_MIPMAPS 1
 
+// Store the texture atlas with 16 bits per pixel (5 bits per color, 1 bit
+// alpha). All TIM textures are 15 bit colors with binary transparency, so
+// this is lossless for them and halves the atlas memory and upload size.
+#define RENDER_USE_16BIT_ATLAS 1
+
+// Maximum fade out distances; the far plane is fixed at RENDER_FADEOUT_FAR.
+// The actual fade out (and culling) distances can be lowered at runtime with
+// render_set_fadeout().
 #define RENDER_FADEOUT_NEAR 48000.0
 #define RENDER_FADEOUT_FAR 64000.0
 
@@ -44,21 +52,75 @@ void render_set_model_mat(mat4_t *m);
 void render_set_depth_write(bool enabled);
 void render_set_depth_test(bool enabled);
 void render_set_depth_offset(float offset);
+void render_set_depth_far(bool enabled);
 void render_set_screen_position(vec2_t pos);
 void render_set_blend_mode(render_blend_mode_t mode);
 void render_set_cull_backface(bool enabled);
+void render_set_fadeout(float near, float far);
+vec2_t render_fadeout(void);
 
 vec3_t render_transform(vec3_t pos);
+mat4_t render_view_projection(void);
+frustum_t render_frustum(void);
 void render_push_tris(tris_t tris, uint16_t texture);
 void render_push_sprite(vec3_t pos, vec2i_t size, rgba_t color, uint16_t texture);
 void render_push_2d(vec2i_t pos, vec2i_t size, rgba_t color, uint16_t texture);
 void render_push_2d_tile(vec2i_t pos, vec2i_t uv_offset, vec2i_t uv_size, vec2i_t size, rgba_t color, uint16_t texture_index);
 
 uint16_t render_texture_create(uint32_t width, uint32_t height, rgba_t *pixels);
+
+// Lazy textures only reserve their index. load() is called for the pixels
+// the first time the texture is pushed or prefetched; only then does it take
+// up room in the atlas. user has to stay valid until the texture is reset.
+typedef void (*render_texture_load_t)(void *user, uint32_t width, uint32_t height, rgba_t *pixels);
+uint16_t render_texture_create_lazy(uint32_t width, uint32_t height, render_texture_load_t load, void *user);
+void render_texture_prefetch(uint16_t texture_index);
+
 vec2i_t render_texture_size(uint16_t texture_index);
 void render_texture_replace_pixels(int16_t texture_index, rgba_t *pixels);
+// The palette holds animated colors. Vertices with a color_slot get the rgb 
+// of that slot instead of their own color, at the time they're pushed; in
+// static meshes at the time the mesh is drawn. Slot 0 is reserved for "none".
+#define RENDER_PALETTE_SIZE 1024
+
+uint16_t render_palette_alloc(uint16_t len);
+void render_set_palette_color(uint16_t slot, rgba_t color);
+uint16_t render_palette_len(void);
+void render_palette_reset(uint16_t len);
+
 uint16_t render_textures_len(void);
 void render_textures_reset(uint16_t len);
 void render_textures_dump(const char *path);
 
+// Static meshes. All tris pushed between render_mesh_begin() and 
+// render_mesh_end() are kept on the gpu and can be drawn again with the
+// current state and model matrix. Palette colors and texture positions are
+// resolved at the time they're pushed, so meshes have to be reset together
+// with the textures. render_mesh_begin() returns false if the renderer can't
+// keep meshes; the tris then have to be pushed each frame.
+#define RENDER_NO_MESH 0xffff
+
+bool render_mesh_begin(uint32_t tris_len);
+uint16_t render_mesh_end(void);
+void render_mesh_draw(uint16_t mesh);
+uint16_t render_meshes_len(void);
+void render_meshes_reset(uint16_t len);
+
+// Video frames go to the gpu as Y, Cb and Cr planes, into textures outside of
+// the atlas, and are converted to rgb when drawn. The planes are one buffer:
+// Y with plane_size, followed by Cb and Cr with half its width and height; of
+// these only size is drawn. render_video_begin() returns false if the
+// renderer can't do that; the frames then have to be converted and drawn as
+// a texture.
+bool render_video_begin(vec2i_t size, vec2i_t plane_size);
+void render_video_upload(uint8_t *planes);
+void render_push_video(vec2i_t pos, vec2i_t size);
+void render_video_end(void);
+
+// Capture every frame, without stalling the renderer. A path ending in .y4m
+// records a raw video stream; otherwise each frame is written to 
+// path_00000.png etc.
+void render_capture_start(const char *path);
+void render_capture_stop(void);
+
 #endif
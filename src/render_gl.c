@@ -33,14 +33,30 @@
 #include "render.h"
 #include "mem.h"
 #include "utils.h"
+#include "platform.h"
 
 
 #define ATLAS_SIZE 64
 #define ATLAS_GRID 32
 #define ATLAS_BORDER 16
 
+#if RENDER_USE_16BIT_ATLAS
+	// GLES derives the storage from the type; internal format must match
+	#if defined(__EMSCRIPTEN__) || defined(USE_GLES2)
+		#define ATLAS_INTERNAL_FORMAT GL_RGBA
+	#else
+		#define ATLAS_INTERNAL_FORMAT GL_RGB5_A1
+	#endif
+	#define ATLAS_TYPE GL_UNSIGNED_SHORT_5_5_5_1
+#else
+	#define ATLAS_INTERNAL_FORMAT GL_RGBA
+	#define ATLAS_TYPE GL_UNSIGNED_BYTE
+#endif
+
 #define RENDER_TRIS_BUFFER_CAPACITY 2048
+#define RENDER_SPRITES_BUFFER_CAPACITY 1024
 #define TEXTURES_MAX 1024
+#define MESHES_MAX 2048
 
 
 #if defined(__EMSCRIPTEN__) || defined(USE_GLES2)
@@ -61,18 +77,47 @@
 	#define FAR_PLANE (RENDER_FADEOUT_FAR)
 	#define RENDER_DEPTH_BUFFER_INTERNAL_FORMAT GL_DEPTH_COMPONENT24
 #endif
+
+// The GL 3.3 path is chosen at runtime, if the context supports it. It keeps 
+// the view in a uniform buffer shared by all programs, draws sprites 
+// instanced and static meshes from their own buffers. GLES2, WebGL and the 
+// legacy macOS context always use the GL2 path.
+#if defined(__EMSCRIPTEN__) || defined(USE_GLES2) || (defined(__APPLE__) && defined(__MACH__))
+	#define RENDER_HAS_GL33 0
+#else
+	#define RENDER_HAS_GL33 1
+
+	// Lets the GL2 style shaders compile as GLSL 3.30
+	#define SHADER_PRELUDE_330_VS \
+		"#version 330 core\n" \
+		"#define attribute in\n" \
+		"#define varying out\n"
+
+	#define SHADER_PRELUDE_330_FS \
+		"#version 330 core\n" \
+		"#define varying in\n" \
+		"#define texture2D texture\n" \
+		"#define gl_FragColor frag_color\n" \
+		"out vec4 frag_color;\n"
+#endif
 	
 
 typedef struct {
 	vec2i_t offset;
 	vec2i_t size;
+	render_texture_load_t load; // Not in the atlas yet, if set
+	void *user;
 } render_texture_t;
 
 uint16_t RENDER_NO_TEXTURE;
 
+static bool use_gl33 = false;
+static GLuint program_bound = 0;
+
 #define use_program(SHADER) \
 	glUseProgram((SHADER)->program); \
-	glBindVertexArray((SHADER)->vao);
+	glBindVertexArray((SHADER)->vao); \
+	program_bound = (SHADER)->program;
 
 #define bind_va_f(index, container, member, start) \
 	glVertexAttribPointer( \
@@ -88,10 +133,26 @@ uint16_t RENDER_NO_TEXTURE;
 		(GLvoid*)(offsetof(container, member) + start) \
 	)
 
+#define bind_va_u16(index, container, member, start) \
+	glVertexAttribIPointer( \
+		index, 1, GL_UNSIGNED_SHORT, \
+		sizeof(container), \
+		(GLvoid*)(offsetof(container, member) + start) \
+	)
+
 
 static GLuint compile_shader(GLenum type, const char *source) {
+	const char *sources[] = {"", source};
+	#if RENDER_HAS_GL33
+		if (use_gl33) {
+			sources[0] = type == GL_VERTEX_SHADER 
+				? SHADER_PRELUDE_330_VS 
+				: SHADER_PRELUDE_330_FS;
+		}
+	#endif
+
 	GLuint shader = glCreateShader(type);
-	glShaderSource(shader, 1, &source, NULL);
+	glShaderSource(shader, 2, sources, NULL);
 	glCompileShader(shader);
 	
 	GLint success;
@@ -149,13 +210,96 @@ static const char * const SHADER_GAME_VS = SHADER_SOURCE(
 	}
 );
 
+#if RENDER_HAS_GL33
+	// Same as SHADER_GAME_VS, but with the view in a uniform buffer. Palette
+	// slots are resolved here, so static meshes pick up palette changes.
+	static const char * const SHADER_GAME_VS_330 = SHADER_SOURCE(
+		attribute vec3 pos;
+		attribute vec2 uv;
+		attribute vec4 color;
+		attribute uint color_slot;
+
+		varying vec4 v_color;
+		varying vec2 v_uv;
+
+		layout(std140) uniform view_block {
+			mat4 view;
+			mat4 projection;
+			mat4 sprite;
+			vec4 camera_pos;
+			vec4 fade;
+		};
+		layout(std140) uniform palette_block {
+			uvec4 palette[256]; // RENDER_PALETTE_SIZE / 4 packed rgba colors
+		};
+		uniform mat4 model;
+		uniform vec2 screen;
+
+		void main() {
+			gl_Position = projection * view * model * vec4(pos, 1.0);
+			gl_Position.xy += screen.xy * gl_Position.w;
+			v_color = color;
+			if (color_slot != 0u) {
+				uint c = palette[color_slot / 4u][color_slot % 4u];
+				v_color.rgb = vec3(c & 0xffu, (c >> 8) & 0xffu, (c >> 16) & 0xffu) / 255.0;
+			}
+			v_color.a *= smoothstep(
+				fade.y, fade.x, // fadeout far, near
+				length(camera_pos - model * vec4(pos, 1.0))
+			);
+			v_uv = uv / 2048.0; // ATLAS_GRID * ATLAS_SIZE
+		}
+	);
+
+	// One instance per sprite; the quad is built from the vertex id and 
+	// rotated to face the camera, like render_push_sprite() does on the cpu
+	static const char * const SHADER_SPRITE_VS_330 = SHADER_SOURCE(
+		attribute vec3 pos;
+		attribute vec2 size;
+		attribute vec4 color;
+		attribute vec2 uv_offset;
+		attribute vec2 uv_size;
+
+		varying vec4 v_color;
+		varying vec2 v_uv;
+
+		layout(std140) uniform view_block {
+			mat4 view;
+			mat4 projection;
+			mat4 sprite;
+			vec4 camera_pos;
+			vec4 fade;
+		};
+		uniform mat4 model;
+		uniform vec2 screen;
+
+		const vec2 corners[6] = vec2[6](
+			vec2(0.0, 0.0), vec2(1.0, 0.0), vec2(0.0, 1.0),
+			vec2(0.0, 1.0), vec2(1.0, 0.0), vec2(1.0, 1.0)
+		);
+
+		void main() {
+			vec2 corner = corners[gl_VertexID];
+			vec3 p = pos + (sprite * vec4((corner - 0.5) * size, 0.0, 1.0)).xyz;
+			gl_Position = projection * view * model * vec4(p, 1.0);
+			gl_Position.xy += screen.xy * gl_Position.w;
+			v_color = color;
+			v_color.a *= smoothstep(
+				fade.y, fade.x, // fadeout far, near
+				length(camera_pos - model * vec4(p, 1.0))
+			);
+			v_uv = (uv_offset + corner * uv_size) / 2048.0; // ATLAS_GRID * ATLAS_SIZE
+		}
+	);
+#endif
+
 static const char * const SHADER_GAME_FS = SHADER_SOURCE(
 	varying vec4 v_color;
 	varying vec2 v_uv;
-	uniform sampler2D texture;
+	uniform sampler2D atlas;
 
 	void main() {
-		vec4 tex_color = texture2D(texture, v_uv);
+		vec4 tex_color = texture2D(atlas, v_uv);
 		vec4 color = tex_color * v_color;
 		if (color.a == 0.0) {
 			discard;
@@ -181,13 +325,19 @@ typedef struct {
 		GLuint pos;
 		GLuint uv;
 		GLuint color;
+		GLuint color_slot; // GL 3.3 only
 	} attribute;
+	uint32_t draw_state_version;
 } prg_game_t;
 
 prg_game_t *shader_game_init() {
 	prg_game_t *s = mem_bump(sizeof(prg_game_t));
 	
-	s->program = create_program(SHADER_GAME_VS, SHADER_GAME_FS);
+	#if RENDER_HAS_GL33
+		s->program = create_program(use_gl33 ? SHADER_GAME_VS_330 : SHADER_GAME_VS, SHADER_GAME_FS);
+	#else
+		s->program = create_program(SHADER_GAME_VS, SHADER_GAME_FS);
+	#endif
 
 	s->uniform.view = glGetUniformLocation(s->program, "view");
 	s->uniform.model = glGetUniformLocation(s->program, "model");
@@ -211,9 +361,80 @@ prg_game_t *shader_game_init() {
 	bind_va_f(s->attribute.uv, vertex_t, uv, 0);
 	bind_va_color(s->attribute.color, vertex_t, color, 0);
 
+	#if RENDER_HAS_GL33
+		if (use_gl33) {
+			s->attribute.color_slot = glGetAttribLocation(s->program, "color_slot");
+			glEnableVertexAttribArray(s->attribute.color_slot);
+			bind_va_u16(s->attribute.color_slot, vertex_t, color_slot, 0);
+		}
+	#endif
+
 	return s;
 }
 
+#if RENDER_HAS_GL33
+	typedef struct {
+		vec3_t pos;
+		vec2_t size;
+		rgba_t color;
+		vec2_t uv_offset;
+		vec2_t uv_size;
+	} render_sprite_t;
+
+	typedef struct {
+		GLuint program;
+		GLuint vao;
+		struct {
+			GLuint model;
+			GLuint screen;
+		} uniform;
+		struct {
+			GLuint pos;
+			GLuint size;
+			GLuint color;
+			GLuint uv_offset;
+			GLuint uv_size;
+		} attribute;
+		uint32_t draw_state_version;
+	} prg_sprite_t;
+
+	// Expects the sprite instance buffer to be bound
+	prg_sprite_t *shader_sprite_init() {
+		prg_sprite_t *s = mem_bump(sizeof(prg_sprite_t));
+
+		s->program = create_program(SHADER_SPRITE_VS_330, SHADER_GAME_FS);
+
+		s->uniform.model = glGetUniformLocation(s->program, "model");
+		s->uniform.screen = glGetUniformLocation(s->program, "screen");
+
+		s->attribute.pos = glGetAttribLocation(s->program, "pos");
+		s->attribute.size = glGetAttribLocation(s->program, "size");
+		s->attribute.color = glGetAttribLocation(s->program, "color");
+		s->attribute.uv_offset = glGetAttribLocation(s->program, "uv_offset");
+		s->attribute.uv_size = glGetAttribLocation(s->program, "uv_size");
+
+		glGenVertexArrays(1, &s->vao);
+		glBindVertexArray(s->vao);
+
+		GLuint attributes[] = {
+			s->attribute.pos, s->attribute.size, s->attribute.color, 
+			s->attribute.uv_offset, s->attribute.uv_size
+		};
+		for (int i = 0; i < len(attributes); i++) {
+			glEnableVertexAttribArray(attributes[i]);
+			glVertexAttribDivisor(attributes[i], 1);
+		}
+
+		bind_va_f(s->attribute.pos, render_sprite_t, pos, 0);
+		bind_va_f(s->attribute.size, render_sprite_t, size, 0);
+		bind_va_color(s->attribute.color, render_sprite_t, color, 0);
+		bind_va_f(s->attribute.uv_offset, render_sprite_t, uv_offset, 0);
+		bind_va_f(s->attribute.uv_size, render_sprite_t, uv_size, 0);
+
+		return s;
+	}
+#endif
+
 
 // -----------------------------------------------------------------------------
 // POST Effect shaders
@@ -237,11 +458,11 @@ static const char * const SHADER_POST_VS = SHADER_SOURCE(
 static const char * const SHADER_POST_FS_DEFAULT = SHADER_SOURCE(
 	varying vec2 v_uv;
 
-	uniform sampler2D texture;
+	uniform sampler2D backbuffer;
 	uniform vec2 screen_size;
 
 	void main() {
-		gl_FragColor = texture2D(texture, v_uv);
+		gl_FragColor = texture2D(backbuffer, v_uv);
 	}
 );
 
@@ -251,7 +472,7 @@ static const char * const SHADER_POST_FS_CRT = SHADER_SOURCE(
 	varying vec2 v_uv;
 
 	uniform float time;
-	uniform sampler2D texture;
+	uniform sampler2D backbuffer;
 	uniform vec2 screen_size;
 
 	vec2 curve(vec2 uv) {
@@ -269,12 +490,12 @@ static const char * const SHADER_POST_FS_CRT = SHADER_SOURCE(
 		vec3 color;
 		float x =  sin(0.3*time+uv.y*21.0)*sin(0.7*time+uv.y*29.0)*sin(0.3+0.33*time+uv.y*31.0)*0.0017;
 
-		color.r = texture2D(texture, vec2(x+uv.x+0.001,uv.y+0.001)).x+0.05;
-		color.g = texture2D(texture, vec2(x+uv.x+0.000,uv.y-0.002)).y+0.05;
-		color.b = texture2D(texture, vec2(x+uv.x-0.002,uv.y+0.000)).z+0.05;
-		color.r += 0.08*texture2D(texture, 0.75*vec2(x+0.025, -0.027)+vec2(uv.x+0.001,uv.y+0.001)).x;
-		color.g += 0.05*texture2D(texture, 0.75*vec2(x+-0.022, -0.02)+vec2(uv.x+0.000,uv.y-0.002)).y;
-		color.b += 0.08*texture2D(texture, 0.75*vec2(x+-0.02, -0.018)+vec2(uv.x-0.002,uv.y+0.000)).z;
+		color.r = texture2D(backbuffer, vec2(x+uv.x+0.001,uv.y+0.001)).x+0.05;
+		color.g = texture2D(backbuffer, vec2(x+uv.x+0.000,uv.y-0.002)).y+0.05;
+		color.b = texture2D(backbuffer, vec2(x+uv.x-0.002,uv.y+0.000)).z+0.05;
+		color.r += 0.08*texture2D(backbuffer, 0.75*vec2(x+0.025, -0.027)+vec2(uv.x+0.001,uv.y+0.001)).x;
+		color.g += 0.05*texture2D(backbuffer, 0.75*vec2(x+-0.022, -0.02)+vec2(uv.x+0.000,uv.y-0.002)).y;
+		color.b += 0.08*texture2D(backbuffer, 0.75*vec2(x+-0.02, -0.018)+vec2(uv.x-0.002,uv.y+0.000)).z;
 
 		color = clamp(color*0.6+0.4*color*color*1.0,0.0,1.0);
 
@@ -348,6 +569,44 @@ prg_post_t *shader_post_crt_init() {
 
 
 
+// -----------------------------------------------------------------------------
+// Video shader
+
+// BT.601 with video range luma, same as plm_frame_to_rgba()
+static const char * const SHADER_VIDEO_FS = SHADER_SOURCE(
+	varying vec2 v_uv;
+
+	uniform sampler2D plane_y;
+	uniform sampler2D plane_cb;
+	uniform sampler2D plane_cr;
+
+	void main() {
+		float y = (texture2D(plane_y, v_uv).r - 0.0627) * 1.1644;
+		float cb = texture2D(plane_cb, v_uv).r - 0.502;
+		float cr = texture2D(plane_cr, v_uv).r - 0.502;
+		gl_FragColor = vec4(
+			y + 1.596 * cr,
+			y - 0.3918 * cb - 0.813 * cr,
+			y + 2.0172 * cb,
+			1.0
+		);
+	}
+);
+
+// Draws a quad with the same vertices as the post pass
+prg_post_t *shader_video_init() {
+	prg_post_t *s = mem_bump(sizeof(prg_post_t));
+	s->program = create_program(SHADER_POST_VS, SHADER_VIDEO_FS);
+	shader_post_general_init(s);
+
+	glUniform1i(glGetUniformLocation(s->program, "plane_y"), 0);
+	glUniform1i(glGetUniformLocation(s->program, "plane_cb"), 1);
+	glUniform1i(glGetUniformLocation(s->program, "plane_cr"), 2);
+	return s;
+}
+
+
+
 // -----------------------------------------------------------------------------
 
 static GLuint vbo;
@@ -367,10 +626,14 @@ static mat4_t projection_mat_bb = mat4_identity();
 static mat4_t projection_mat_3d = mat4_identity();
 static mat4_t sprite_mat = mat4_identity();
 static mat4_t view_mat = mat4_identity();
+static vec2_t fadeout = vec2(RENDER_FADEOUT_NEAR, RENDER_FADEOUT_FAR);
 
 
 static render_texture_t textures[TEXTURES_MAX];
 static uint32_t textures_len = 0;
+
+static rgba_t palette[RENDER_PALETTE_SIZE];
+static uint16_t palette_len = 1;
 static bool texture_mipmap_is_dirty = false;
 
 static render_resolution_t render_res;
@@ -381,9 +644,61 @@ static GLuint backbuffer_depth_buffer = 0;
 prg_game_t *prg_game;
 prg_post_t *prg_post;
 prg_post_t *prg_post_effects[NUM_RENDER_POST_EFFCTS] = {};
+prg_post_t *prg_video;
+
+#if RENDER_HAS_GL33
+	// Matches the view_block in SHADER_GAME_VS_330
+	typedef struct {
+		mat4_t view;
+		mat4_t projection;
+		mat4_t sprite;
+		float camera_pos[4];
+		float fade[4];
+	} render_view_block_t;
+
+	typedef struct {
+		GLuint vbo;
+		GLuint vao;
+		uint32_t tris_len;
+	} render_mesh_t;
+
+	prg_sprite_t *prg_sprite;
+
+	static GLuint view_ubo;
+	static render_view_block_t view_block;
+
+	static GLuint palette_ubo;
+	static bool palette_is_dirty = true;
+
+	static GLuint sprites_vbo;
+	static render_sprite_t sprites_buffer[RENDER_SPRITES_BUFFER_CAPACITY];
+	static uint32_t sprites_len = 0;
+
+	// The model matrix and screen position are uploaded to each program only
+	// when it is used for a draw
+	static mat4_t model_mat = mat4_identity();
+	static vec2_t screen_position = vec2(0, 0);
+	static uint32_t draw_state_version = 1;
+
+	static render_mesh_t meshes[MESHES_MAX];
+	static uint32_t meshes_len = 0;
+
+	// While building a mesh, all pushed tris end up here
+	static tris_t *mesh_tris = NULL;
+	static uint32_t mesh_tris_len = 0;
+	static uint32_t mesh_tris_capacity = 0;
+
+	static void render_init_gl33(void);
+	static void render_flush_gl33(void);
+	static void render_use_program_gl33(GLuint program);
+	static void render_view_block_upload(void);
+	static void render_palette_upload(void);
+#endif
 
 
 static void render_flush();
+static void render_capture_frame(void);
+static void render_texture_load(render_texture_t *t);
 
 
 // static void gl_message_callback(GLenum source, GLenum type, GLuint id, GLenum severity, GLsizei length, const GLchar *message, const void *userParam) {
@@ -400,6 +715,16 @@ void render_init(vec2i_t screen_size) {
 		glewInit();
 	#endif
 
+	#if RENDER_HAS_GL33
+		const char *gl_version = (const char *)glGetString(GL_VERSION);
+		int gl_major = 0;
+		int gl_minor = 0;
+		if (gl_version && sscanf(gl_version, "%d.%d", &gl_major, &gl_minor) == 2) {
+			use_gl33 = gl_major > 3 || (gl_major == 3 && gl_minor >= 3);
+		}
+		printf("render: GL %s, using the %s path\n", gl_version, use_gl33 ? "GL 3.3" : "GL2");
+	#endif
+
 	// glEnable(GL_DEBUG_OUTPUT);
 	// glDebugMessageCallback(gl_message_callback, NULL);
 	// glDebugMessageControl(GL_DONT_CARE, GL_DONT_CARE, GL_DONT_CARE, 0, NULL, GL_TRUE);
@@ -420,7 +745,7 @@ void render_init(vec2i_t screen_size) {
 
 	uint32_t tw = ATLAS_SIZE * ATLAS_GRID;
 	uint32_t th = ATLAS_SIZE * ATLAS_GRID;
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, tw, th, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+	glTexImage2D(GL_TEXTURE_2D, 0, ATLAS_INTERNAL_FORMAT, tw, th, 0, GL_RGBA, ATLAS_TYPE, NULL);
 	printf("atlas texture %5d\n", atlas_texture);
 	
 
@@ -436,9 +761,16 @@ void render_init(vec2i_t screen_size) {
 	prg_post_effects[RENDER_POST_CRT] = shader_post_crt_init();
 	render_set_post_effect(RENDER_POST_NONE);
 
+	prg_video = shader_video_init();
+
 	// Game shader
 
 	prg_game = shader_game_init();
+	#if RENDER_HAS_GL33
+		if (use_gl33) {
+			render_init_gl33();
+		}
+	#endif
 	use_program(prg_game);
 
 	render_set_view(vec3(0, 0, 0), vec3(0, 0, 0));
@@ -466,6 +798,7 @@ void render_init(vec2i_t screen_size) {
 
 void render_cleanup() {
 	// TODO
+	render_capture_stop();
 }
 
 
@@ -582,6 +915,10 @@ void render_frame_prepare() {
 	glViewport(0, 0, backbuffer_size.x, backbuffer_size.y);
 
 	glBindTexture(GL_TEXTURE_2D, atlas_texture);
+	#if RENDER_HAS_GL33
+		screen_position = vec2(0, 0);
+		draw_state_version++;
+	#endif
 	glUniform2f(prg_game->uniform.screen, 0, 0);
 	glEnable(GL_DEPTH_TEST);
 	glDepthMask(true);
@@ -593,6 +930,7 @@ void render_frame_prepare() {
 
 void render_frame_end() {
 	render_flush();
+	render_capture_frame();
 
 	use_program(prg_post);
 
@@ -626,6 +964,13 @@ void render_frame_end() {
 }
 
 void render_flush() {
+	#if RENDER_HAS_GL33
+		if (use_gl33) {
+			render_flush_gl33();
+			return;
+		}
+	#endif
+
 	if (tris_len == 0) {
 		return;
 	}
@@ -656,10 +1001,25 @@ void render_set_view(vec3_t pos, vec3_t angles) {
 	render_set_model_mat(&mat4_identity());
 
 	render_flush();
+	#if RENDER_HAS_GL33
+		if (use_gl33) {
+			view_block.view = view_mat;
+			view_block.projection = projection_mat_3d;
+			view_block.sprite = sprite_mat;
+			view_block.camera_pos[0] = pos.x;
+			view_block.camera_pos[1] = pos.y;
+			view_block.camera_pos[2] = pos.z;
+			view_block.camera_pos[3] = 1;
+			view_block.fade[0] = fadeout.x;
+			view_block.fade[1] = fadeout.y;
+			render_view_block_upload();
+			return;
+		}
+	#endif
 	glUniformMatrix4fv(prg_game->uniform.view, 1, false, view_mat.m);
 	glUniformMatrix4fv(prg_game->uniform.projection, 1, false, projection_mat_3d.m);
 	glUniform3f(prg_game->uniform.camera_pos, pos.x, pos.y, pos.z);
-	glUniform2f(prg_game->uniform.fade, RENDER_FADEOUT_NEAR, RENDER_FADEOUT_FAR);
+	glUniform2f(prg_game->uniform.fade, fadeout.x, fadeout.y);
 }
 
 void render_set_view_2d() {
@@ -668,6 +1028,17 @@ void render_set_view_2d() {
 	render_set_depth_write(false);
 
 	render_set_model_mat(&mat4_identity());
+	#if RENDER_HAS_GL33
+		if (use_gl33) {
+			view_block.view = mat4_identity();
+			view_block.projection = projection_mat_2d;
+			view_block.camera_pos[0] = 0;
+			view_block.camera_pos[1] = 0;
+			view_block.camera_pos[2] = 0;
+			render_view_block_upload();
+			return;
+		}
+	#endif
 	glUniform3f(prg_game->uniform.camera_pos, 0, 0, 0);
 	glUniformMatrix4fv(prg_game->uniform.view, 1, false, mat4_identity().m);
 	glUniformMatrix4fv(prg_game->uniform.projection, 1, false, projection_mat_2d.m);
@@ -675,6 +1046,13 @@ void render_set_view_2d() {
 
 void render_set_model_mat(mat4_t *m) {
 	render_flush();
+	#if RENDER_HAS_GL33
+		if (use_gl33) {
+			model_mat = *m;
+			draw_state_version++;
+			return;
+		}
+	#endif
 	glUniformMatrix4fv(prg_game->uniform.model, 1, false, m->m);
 }
 
@@ -704,8 +1082,37 @@ void render_set_depth_offset(float offset) {
 	glPolygonOffset(offset, 1.0);
 }
 
+void render_set_depth_far(bool enabled) {
+	// Puts all following geometry onto the far plane; with the depth test 
+	// enabled it only ends up where nothing else was drawn yet
+	render_flush();
+	if (enabled) {
+		glDepthFunc(GL_LEQUAL);
+		#if defined(__EMSCRIPTEN__) || defined(USE_GLES2)
+			glDepthRangef(1, 1);
+		#else
+			glDepthRange(1, 1);
+		#endif
+	}
+	else {
+		glDepthFunc(GL_LESS);
+		#if defined(__EMSCRIPTEN__) || defined(USE_GLES2)
+			glDepthRangef(0, 1);
+		#else
+			glDepthRange(0, 1);
+		#endif
+	}
+}
+
 void render_set_screen_position(vec2_t pos) {
 	render_flush();
+	#if RENDER_HAS_GL33
+		if (use_gl33) {
+			screen_position = pos;
+			draw_state_version++;
+			return;
+		}
+	#endif
 	glUniform2f(prg_game->uniform.screen, pos.x, -pos.y);
 }
 
@@ -734,6 +1141,15 @@ void render_set_cull_backface(bool enabled) {
 	}
 }
 
+void render_set_fadeout(float near, float far) {
+	// Takes effect with the next render_set_view()
+	fadeout = vec2(near, far);
+}
+
+vec2_t render_fadeout(void) {
+	return fadeout;
+}
+
 
 
 
@@ -741,6 +1157,19 @@ vec3_t render_transform(vec3_t pos) {
 	return vec3_transform(vec3_transform(pos, &view_mat), &projection_mat_3d);
 }
 
+mat4_t render_view_projection() {
+	mat4_t vp_mat;
+	mat4_mul(&vp_mat, &projection_mat_3d, &view_mat);
+	return vp_mat;
+}
+
+frustum_t render_frustum() {
+	frustum_t frustum;
+	mat4_t vp_mat = render_view_projection();
+	frustum_from_mat(&frustum, &vp_mat);
+	return frustum;
+}
+
 void render_push_tris(tris_t tris, uint16_t texture_index) {
 	error_if(texture_index >= textures_len, "Invalid texture %d", texture_index);
 	
@@ -749,17 +1178,60 @@ void render_push_tris(tris_t tris, uint16_t texture_index) {
 	}
 
 	render_texture_t *t = &textures[texture_index];
+	if (t->load) {
+		render_texture_load(t);
+	}
 
+	// The GL 3.3 shader looks up palette slots itself
 	for (int i = 0; i < 3; i++) {
 		tris.vertices[i].uv.x += t->offset.x;
 		tris.vertices[i].uv.y += t->offset.y;
+		if (tris.vertices[i].color_slot && !use_gl33) {
+			rgba_t color = palette[tris.vertices[i].color_slot];
+			color.as_rgba.a = tris.vertices[i].color.as_rgba.a;
+			tris.vertices[i].color = color;
+		}
 	}
+
+	#if RENDER_HAS_GL33
+		if (mesh_tris) {
+			error_if(mesh_tris_len >= mesh_tris_capacity, "Mesh tris capacity %d reached", mesh_tris_capacity);
+			mesh_tris[mesh_tris_len++] = tris;
+			return;
+		}
+
+		// A batch holds either tris or sprites, so blended ones are drawn
+		// in the order they were pushed
+		if (sprites_len) {
+			render_flush();
+		}
+	#endif
 	tris_buffer[tris_len++] = tris;
 }
 
 void render_push_sprite(vec3_t pos, vec2i_t size, rgba_t color, uint16_t texture_index) {
 	error_if(texture_index >= textures_len, "Invalid texture %d", texture_index);
 
+	#if RENDER_HAS_GL33
+		if (use_gl33) {
+			if (sprites_len >= RENDER_SPRITES_BUFFER_CAPACITY || tris_len) {
+				render_flush();
+			}
+			render_texture_t *t = &textures[texture_index];
+			if (t->load) {
+				render_texture_load(t);
+			}
+			sprites_buffer[sprites_len++] = (render_sprite_t){
+				.pos = pos,
+				.size = vec2(size.x, size.y),
+				.color = color,
+				.uv_offset = vec2(t->offset.x, t->offset.y),
+				.uv_size = vec2(t->size.x, t->size.y)
+			};
+			return;
+		}
+	#endif
+
 	vec3_t p1 = vec3_add(pos, vec3_transform(vec3(-size.x * 0.5, -size.y * 0.5, 0), &sprite_mat));
 	vec3_t p2 = vec3_add(pos, vec3_transform(vec3( size.x * 0.5, -size.y * 0.5, 0), &sprite_mat));
 	vec3_t p3 = vec3_add(pos, vec3_transform(vec3(-size.x * 0.5,  size.y * 0.5, 0), &sprite_mat));
@@ -854,9 +1326,31 @@ void render_push_2d_tile(vec2i_t pos, vec2i_t uv_offset, vec2i_t uv_size, vec2i_
 }
 
 
-uint16_t render_texture_create(uint32_t tw, uint32_t th, rgba_t *pixels) {
-	error_if(textures_len >= TEXTURES_MAX, "TEXTURES_MAX reached");
+static void render_atlas_upload(uint32_t x, uint32_t y, uint32_t w, uint32_t h, rgba_t *pixels) {
+	glBindTexture(GL_TEXTURE_2D, atlas_texture);
 
+	#if RENDER_USE_16BIT_ATLAS
+		uint32_t len = w * h;
+		uint16_t *p16 = mem_temp_alloc(sizeof(uint16_t) * len);
+		for (uint32_t i = 0; i < len; i++) {
+			rgba_t c = pixels[i];
+			p16[i] =
+				((c.as_rgba.r >> 3) << 11) |
+				((c.as_rgba.g >> 3) << 6) |
+				((c.as_rgba.b >> 3) << 1) |
+				(c.as_rgba.a >> 7);
+		}
+		// 16 bit rows of odd width are not 4 byte aligned
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 2);
+		glTexSubImage2D(GL_TEXTURE_2D, 0, x, y, w, h, GL_RGBA, ATLAS_TYPE, p16);
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+		mem_temp_free(p16);
+	#else
+		glTexSubImage2D(GL_TEXTURE_2D, 0, x, y, w, h, GL_RGBA, ATLAS_TYPE, pixels);
+	#endif
+}
+
+static void render_atlas_insert(render_texture_t *t, uint32_t tw, uint32_t th, rgba_t *pixels) {
 	uint32_t bw = tw + ATLAS_BORDER * 2;
 	uint32_t bh = th + ATLAS_BORDER * 2;
 
@@ -932,20 +1426,46 @@ uint16_t render_texture_create(uint32_t tw, uint32_t th, rgba_t *pixels) {
 
 	uint32_t x = grid_x * ATLAS_GRID;
 	uint32_t y = grid_y * ATLAS_GRID;
-	glBindTexture(GL_TEXTURE_2D, atlas_texture);
-	glTexSubImage2D(GL_TEXTURE_2D, 0, x, y, bw, bh, GL_RGBA, GL_UNSIGNED_BYTE, pb);
+	render_atlas_upload(x, y, bw, bh, pb);
 	mem_temp_free(pb);
 
 
 	texture_mipmap_is_dirty = RENDER_USE_MIPMAPS;
+	*t = (render_texture_t){ {x + ATLAS_BORDER, y + ATLAS_BORDER}, {tw, th} };
+
+	printf("inserted atlas texture (%3dx%3d) at (%3d,%3d)\n", tw, th, grid_x, grid_y);
+}
+
+static void render_texture_load(render_texture_t *t) {
+	rgba_t *pixels = mem_temp_alloc(sizeof(rgba_t) * t->size.x * t->size.y);
+	t->load(t->user, t->size.x, t->size.y, pixels);
+	render_atlas_insert(t, t->size.x, t->size.y, pixels);
+	mem_temp_free(pixels);
+}
+
+uint16_t render_texture_create(uint32_t tw, uint32_t th, rgba_t *pixels) {
+	error_if(textures_len >= TEXTURES_MAX, "TEXTURES_MAX reached");
 	uint16_t texture_index = textures_len;
 	textures_len++;
-	textures[texture_index] = (render_texture_t){ {x + ATLAS_BORDER, y + ATLAS_BORDER}, {tw, th} };
+	render_atlas_insert(&textures[texture_index], tw, th, pixels);
+	return texture_index;
+}
 
-	printf("inserted atlas texture (%3dx%3d) at (%3d,%3d)\n", tw, th, grid_x, grid_y);
+uint16_t render_texture_create_lazy(uint32_t tw, uint32_t th, render_texture_load_t load, void *user) {
+	error_if(textures_len >= TEXTURES_MAX, "TEXTURES_MAX reached");
+	uint16_t texture_index = textures_len;
+	textures_len++;
+	textures[texture_index] = (render_texture_t){.size = {tw, th}, .load = load, .user = user};
 	return texture_index;
 }
 
+void render_texture_prefetch(uint16_t texture_index) {
+	error_if(texture_index >= textures_len, "Invalid texture %d", texture_index);
+	if (textures[texture_index].load) {
+		render_texture_load(&textures[texture_index]);
+	}
+}
+
 vec2i_t render_texture_size(uint16_t texture_index) {
 	error_if(texture_index >= textures_len, "Invalid texture %d", texture_index);
 	return textures[texture_index].size;
@@ -955,8 +1475,39 @@ void render_texture_replace_pixels(int16_t texture_index, rgba_t *pixels) {
 	error_if(texture_index >= textures_len, "Invalid texture %d", texture_index);
 
 	render_texture_t *t = &textures[texture_index];
-	glBindTexture(GL_TEXTURE_2D, atlas_texture);
-	glTexSubImage2D(GL_TEXTURE_2D, 0, t->offset.x, t->offset.y, t->size.x, t->size.y, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+	if (t->load) {
+		render_atlas_insert(t, t->size.x, t->size.y, pixels);
+		return;
+	}
+	render_atlas_upload(t->offset.x, t->offset.y, t->size.x, t->size.y, pixels);
+}
+
+uint16_t render_palette_alloc(uint16_t len) {
+	error_if(palette_len + len > RENDER_PALETTE_SIZE, "RENDER_PALETTE_SIZE reached");
+	uint16_t start = palette_len;
+	palette_len += len;
+	return start;
+}
+
+void render_set_palette_color(uint16_t slot, rgba_t color) {
+	error_if(slot == 0 || slot >= palette_len, "Invalid palette slot %d", slot);
+	#if RENDER_HAS_GL33
+		// Tris that are already pushed keep the color they were pushed with
+		if (use_gl33 && palette[slot].as_uint32 != color.as_uint32) {
+			render_flush();
+			palette_is_dirty = true;
+		}
+	#endif
+	palette[slot] = color;
+}
+
+uint16_t render_palette_len() {
+	return palette_len;
+}
+
+void render_palette_reset(uint16_t len) {
+	error_if(len == 0 || len > palette_len, "Invalid palette reset len %d >= %d", len, palette_len);
+	palette_len = len;
 }
 
 uint16_t render_textures_len() {
@@ -980,14 +1531,18 @@ void render_textures_reset(uint16_t len) {
 		return;
 	}
 
-	// Replay all texture grid insertions up to the reset len
+	// Replay all texture grid insertions up to the reset len. Lazy textures
+	// may have been inserted after later ones, or not at all.
 	for (int i = 0; i < textures_len; i++) {
+		if (textures[i].load) {
+			continue;
+		}
 		uint32_t grid_x = (textures[i].offset.x - ATLAS_BORDER) / ATLAS_GRID;
 		uint32_t grid_y = (textures[i].offset.y - ATLAS_BORDER) / ATLAS_GRID;
 		uint32_t grid_width = (textures[i].size.x + ATLAS_BORDER * 2 + ATLAS_GRID - 1) / ATLAS_GRID;
 		uint32_t grid_height = (textures[i].size.y + ATLAS_BORDER * 2 + ATLAS_GRID - 1) / ATLAS_GRID;
 		for (uint32_t cx = grid_x; cx < grid_x + grid_width; cx++) {
-			atlas_map[cx] = grid_y + grid_height;
+			atlas_map[cx] = maxint(atlas_map[cx], grid_y + grid_height);
 		}
 	}
 }
@@ -1000,3 +1555,570 @@ void render_textures_dump(const char *path) {
 	stbi_write_png(path, width, height, 4, pixels, 0);
 	free(pixels);
 }
+
+
+
+// -----------------------------------------------------------------------------
+// Static meshes
+
+bool render_mesh_begin(uint32_t tris_len) {
+	#if RENDER_HAS_GL33
+		if (!use_gl33) {
+			return false;
+		}
+		error_if(mesh_tris, "render_mesh_begin() while building a mesh");
+		error_if(meshes_len >= MESHES_MAX, "MESHES_MAX reached");
+
+		render_flush();
+		mesh_tris = mem_temp_alloc(sizeof(tris_t) * tris_len);
+		mesh_tris_len = 0;
+		mesh_tris_capacity = tris_len;
+		return true;
+	#else
+		return false;
+	#endif
+}
+
+uint16_t render_mesh_end(void) {
+	#if RENDER_HAS_GL33
+		error_if(!mesh_tris, "render_mesh_end() without render_mesh_begin()");
+
+		render_mesh_t *mesh = &meshes[meshes_len];
+		mesh->tris_len = mesh_tris_len;
+
+		glGenBuffers(1, &mesh->vbo);
+		glBindBuffer(GL_ARRAY_BUFFER, mesh->vbo);
+		glBufferData(GL_ARRAY_BUFFER, sizeof(tris_t) * mesh_tris_len, mesh_tris, GL_STATIC_DRAW);
+
+		glGenVertexArrays(1, &mesh->vao);
+		glBindVertexArray(mesh->vao);
+		glEnableVertexAttribArray(prg_game->attribute.pos);
+		glEnableVertexAttribArray(prg_game->attribute.uv);
+		glEnableVertexAttribArray(prg_game->attribute.color);
+		glEnableVertexAttribArray(prg_game->attribute.color_slot);
+		bind_va_f(prg_game->attribute.pos, vertex_t, pos, 0);
+		bind_va_f(prg_game->attribute.uv, vertex_t, uv, 0);
+		bind_va_color(prg_game->attribute.color, vertex_t, color, 0);
+		bind_va_u16(prg_game->attribute.color_slot, vertex_t, color_slot, 0);
+
+		// Force the program and its vao to be bound again with the next draw
+		program_bound = 0;
+
+		mem_temp_free(mesh_tris);
+		mesh_tris = NULL;
+		return meshes_len++;
+	#else
+		die("render_mesh_end() without render_mesh_begin()");
+		return RENDER_NO_MESH;
+	#endif
+}
+
+void render_mesh_draw(uint16_t mesh) {
+	#if RENDER_HAS_GL33
+		error_if(mesh >= meshes_len, "Invalid mesh %d", mesh);
+		render_flush();
+
+		if (texture_mipmap_is_dirty) {
+			glGenerateMipmap(GL_TEXTURE_2D);
+			texture_mipmap_is_dirty = false;
+		}
+		render_palette_upload();
+		render_use_program_gl33(prg_game->program);
+		glBindVertexArray(meshes[mesh].vao);
+		glDrawArrays(GL_TRIANGLES, 0, meshes[mesh].tris_len * 3);
+		glBindVertexArray(prg_game->vao);
+	#else
+		die("Invalid mesh %d", mesh);
+	#endif
+}
+
+uint16_t render_meshes_len(void) {
+	#if RENDER_HAS_GL33
+		return meshes_len;
+	#else
+		return 0;
+	#endif
+}
+
+void render_meshes_reset(uint16_t len) {
+	#if RENDER_HAS_GL33
+		error_if(len > meshes_len, "Invalid mesh reset len %d >= %d", len, meshes_len);
+		for (uint32_t i = len; i < meshes_len; i++) {
+			glDeleteBuffers(1, &meshes[i].vbo);
+			glDeleteVertexArrays(1, &meshes[i].vao);
+		}
+		meshes_len = len;
+	#endif
+}
+
+
+
+// -----------------------------------------------------------------------------
+// Video
+
+// The planes are uploaded through a pixel buffer object, where available. It
+// is orphaned for each frame, so the copy to the textures runs on the gpu
+// while we carry on and never waits for a draw still using the last frame.
+#if defined(__EMSCRIPTEN__) || defined(USE_GLES2)
+	#define RENDER_VIDEO_USE_PBO 0
+#else
+	#define RENDER_VIDEO_USE_PBO 1
+#endif
+
+static struct {
+	vec2i_t size;
+	vec2i_t plane_size;
+	GLuint textures[3]; // Y, Cb, Cr
+	GLuint pbo;
+} video;
+
+static vec2i_t render_video_plane_size(int plane) {
+	return plane == 0
+		? video.plane_size
+		: vec2i(video.plane_size.x / 2, video.plane_size.y / 2);
+}
+
+bool render_video_begin(vec2i_t size, vec2i_t plane_size) {
+	error_if(video.textures[0], "render_video_begin() while a video is running");
+	video.size = size;
+	video.plane_size = plane_size;
+
+	// GL 3.3 core has no luminance textures; the shader only reads .r anyway
+	#if RENDER_HAS_GL33
+		GLenum internal_format = use_gl33 ? GL_R8 : GL_LUMINANCE;
+		GLenum format = use_gl33 ? GL_RED : GL_LUMINANCE;
+	#else
+		GLenum internal_format = GL_LUMINANCE;
+		GLenum format = GL_LUMINANCE;
+	#endif
+
+	render_flush();
+	glGenTextures(3, video.textures);
+	for (int i = 0; i < 3; i++) {
+		vec2i_t s = render_video_plane_size(i);
+		glBindTexture(GL_TEXTURE_2D, video.textures[i]);
+		glTexImage2D(GL_TEXTURE_2D, 0, internal_format, s.x, s.y, 0, format, GL_UNSIGNED_BYTE, NULL);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	}
+	glBindTexture(GL_TEXTURE_2D, atlas_texture);
+
+	#if RENDER_VIDEO_USE_PBO
+		glGenBuffers(1, &video.pbo);
+	#endif
+	return true;
+}
+
+void render_video_upload(uint8_t *planes) {
+	error_if(!video.textures[0], "render_video_upload() without render_video_begin()");
+	render_flush();
+
+	#if RENDER_HAS_GL33
+		GLenum format = use_gl33 ? GL_RED : GL_LUMINANCE;
+	#else
+		GLenum format = GL_LUMINANCE;
+	#endif
+
+	uint32_t bytes = video.plane_size.x * video.plane_size.y * 3 / 2;
+	uint8_t *src = planes;
+	#if RENDER_VIDEO_USE_PBO
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, video.pbo);
+		glBufferData(GL_PIXEL_UNPACK_BUFFER, bytes, planes, GL_STREAM_DRAW);
+		src = NULL; // Offsets into the pbo from here
+	#endif
+
+	for (int i = 0; i < 3; i++) {
+		vec2i_t s = render_video_plane_size(i);
+		glBindTexture(GL_TEXTURE_2D, video.textures[i]);
+		glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, s.x, s.y, format, GL_UNSIGNED_BYTE, src);
+		src += s.x * s.y;
+	}
+	glBindTexture(GL_TEXTURE_2D, atlas_texture);
+
+	#if RENDER_VIDEO_USE_PBO
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+	#endif
+}
+
+void render_push_video(vec2i_t pos, vec2i_t size) {
+	error_if(!video.textures[0], "render_push_video() without render_video_begin()");
+	render_flush();
+
+	use_program(prg_video);
+	glUniformMatrix4fv(prg_video->uniform.projection, 1, false, projection_mat_2d.m);
+	for (int i = 2; i >= 0; i--) {
+		glActiveTexture(GL_TEXTURE0 + i);
+		glBindTexture(GL_TEXTURE_2D, video.textures[i]);
+	}
+
+	// Only the visible part of the planes
+	float u = (float)video.size.x / video.plane_size.x;
+	float v = (float)video.size.y / video.plane_size.y;
+	rgba_t white = rgba(128,128,128,255);
+	tris_buffer[tris_len++] = (tris_t){
+		.vertices = {
+			{.pos = {pos.x, pos.y + size.y, 0}, .uv = {0, v}, .color = white},
+			{.pos = {pos.x + size.x, pos.y, 0}, .uv = {u, 0}, .color = white},
+			{.pos = {pos.x, pos.y, 0}, .uv = {0, 0}, .color = white},
+		}
+	};
+	tris_buffer[tris_len++] = (tris_t){
+		.vertices = {
+			{.pos = {pos.x + size.x, pos.y + size.y, 0}, .uv = {u, v}, .color = white},
+			{.pos = {pos.x + size.x, pos.y, 0}, .uv = {u, 0}, .color = white},
+			{.pos = {pos.x, pos.y + size.y, 0}, .uv = {0, v}, .color = white},
+		}
+	};
+	glBindBuffer(GL_ARRAY_BUFFER, vbo);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(tris_t) * tris_len, tris_buffer, GL_DYNAMIC_DRAW);
+	glDrawArrays(GL_TRIANGLES, 0, tris_len * 3);
+	tris_len = 0;
+
+	glBindTexture(GL_TEXTURE_2D, atlas_texture);
+	use_program(prg_game);
+}
+
+void render_video_end(void) {
+	if (!video.textures[0]) {
+		return;
+	}
+	render_flush();
+	glDeleteTextures(3, video.textures);
+	#if RENDER_VIDEO_USE_PBO
+		glDeleteBuffers(1, &video.pbo);
+	#endif
+	memset(&video, 0, sizeof(video));
+}
+
+
+
+// -----------------------------------------------------------------------------
+// GL 3.3
+
+#if RENDER_HAS_GL33
+
+static void render_init_gl33(void) {
+	// The view is shared by the game and sprite programs through binding 0
+	glGenBuffers(1, &view_ubo);
+	glBindBuffer(GL_UNIFORM_BUFFER, view_ubo);
+	glBufferData(GL_UNIFORM_BUFFER, sizeof(render_view_block_t), NULL, GL_STREAM_DRAW);
+	glBindBufferBase(GL_UNIFORM_BUFFER, 0, view_ubo);
+
+	glGenBuffers(1, &sprites_vbo);
+	glBindBuffer(GL_ARRAY_BUFFER, sprites_vbo);
+	prg_sprite = shader_sprite_init();
+	glBindBuffer(GL_ARRAY_BUFFER, vbo);
+
+	glUniformBlockBinding(prg_game->program, glGetUniformBlockIndex(prg_game->program, "view_block"), 0);
+	glUniformBlockBinding(prg_sprite->program, glGetUniformBlockIndex(prg_sprite->program, "view_block"), 0);
+
+	// The palette only goes to the game program, through binding 1
+	glGenBuffers(1, &palette_ubo);
+	glBindBuffer(GL_UNIFORM_BUFFER, palette_ubo);
+	glBufferData(GL_UNIFORM_BUFFER, sizeof(palette), NULL, GL_STREAM_DRAW);
+	glBindBufferBase(GL_UNIFORM_BUFFER, 1, palette_ubo);
+	glUniformBlockBinding(prg_game->program, glGetUniformBlockIndex(prg_game->program, "palette_block"), 1);
+
+	view_block.view = mat4_identity();
+	view_block.projection = mat4_identity();
+	view_block.sprite = mat4_identity();
+}
+
+static void render_view_block_upload(void) {
+	// Orphan the old storage, so we don't wait for draws still using it
+	glBindBuffer(GL_UNIFORM_BUFFER, view_ubo);
+	glBufferData(GL_UNIFORM_BUFFER, sizeof(render_view_block_t), &view_block, GL_STREAM_DRAW);
+}
+
+static void render_palette_upload(void) {
+	if (!palette_is_dirty) {
+		return;
+	}
+	glBindBuffer(GL_UNIFORM_BUFFER, palette_ubo);
+	glBufferData(GL_UNIFORM_BUFFER, sizeof(palette), palette, GL_STREAM_DRAW);
+	palette_is_dirty = false;
+}
+
+static void render_use_program_gl33(GLuint program) {
+	GLuint model;
+	GLuint screen;
+	uint32_t *version;
+	if (program == prg_sprite->program) {
+		if (program_bound != program) {
+			use_program(prg_sprite);
+		}
+		model = prg_sprite->uniform.model;
+		screen = prg_sprite->uniform.screen;
+		version = &prg_sprite->draw_state_version;
+	}
+	else {
+		if (program_bound != program) {
+			use_program(prg_game);
+		}
+		model = prg_game->uniform.model;
+		screen = prg_game->uniform.screen;
+		version = &prg_game->draw_state_version;
+	}
+
+	if (*version != draw_state_version) {
+		glUniformMatrix4fv(model, 1, false, model_mat.m);
+		glUniform2f(screen, screen_position.x, -screen_position.y);
+		*version = draw_state_version;
+	}
+}
+
+static void render_flush_gl33(void) {
+	if (tris_len == 0 && sprites_len == 0) {
+		return;
+	}
+
+	if (texture_mipmap_is_dirty) {
+		glGenerateMipmap(GL_TEXTURE_2D);
+		texture_mipmap_is_dirty = false;
+	}
+	render_palette_upload();
+
+	// Tris pushed with the post program bound are for the post pass; draw 
+	// them as they are
+	if (tris_len) {
+		if (program_bound != prg_post->program) {
+			render_use_program_gl33(prg_game->program);
+		}
+		glBindBuffer(GL_ARRAY_BUFFER, vbo);
+		glBufferData(GL_ARRAY_BUFFER, sizeof(tris_t) * tris_len, tris_buffer, GL_DYNAMIC_DRAW);
+		glDrawArrays(GL_TRIANGLES, 0, tris_len * 3);
+		tris_len = 0;
+	}
+
+	// Pushing a sprite flushes pending tris and vice versa, so at most one
+	// of these draws anything
+	if (sprites_len) {
+		render_use_program_gl33(prg_sprite->program);
+		glBindBuffer(GL_ARRAY_BUFFER, sprites_vbo);
+		glBufferData(GL_ARRAY_BUFFER, sizeof(render_sprite_t) * sprites_len, sprites_buffer, GL_STREAM_DRAW);
+		glDrawArraysInstanced(GL_TRIANGLES, 0, 6, sprites_len);
+		sprites_len = 0;
+	}
+}
+
+#endif
+
+
+
+// -----------------------------------------------------------------------------
+// Frame capture
+
+#if defined(__EMSCRIPTEN__) || defined(USE_GLES2)
+
+void render_capture_start(const char *path) {
+	printf("capture: not supported without pixel buffer objects\n");
+}
+
+void render_capture_stop(void) {}
+
+static void render_capture_frame(void) {}
+
+#else
+
+// The backbuffer is read into a ring of pixel buffer objects. A pbo is only 
+// mapped RENDER_CAPTURE_PBOS frames after its glReadPixels(), when the copy 
+// has long finished, so we never wait for the gpu. The pixels are then handed
+// to a writer thread; if that falls behind, frames are dropped instead of 
+// stalling the game.
+#define RENDER_CAPTURE_PBOS 3
+#define RENDER_CAPTURE_QUEUE_LEN 8
+
+typedef struct {
+	bool enabled;
+	bool is_y4m;
+	char path[256];
+	FILE *file;
+	vec2i_t size;
+	uint8_t *yuv;
+
+	GLuint pbos[RENDER_CAPTURE_PBOS];
+	uint32_t frames_issued;
+	uint32_t frames_captured;
+	uint32_t frames_dropped;
+
+	// Single producer (render thread), single consumer (writer thread)
+	struct {
+		uint32_t index;
+		rgba_t *pixels;
+	} queue[RENDER_CAPTURE_QUEUE_LEN];
+	uint32_t queue_read_pos;
+	uint32_t queue_write_pos;
+	uint32_t stop;
+	void *thread;
+} render_capture_t;
+
+static render_capture_t capture;
+
+static void render_capture_write(uint32_t index, rgba_t *pixels) {
+	int32_t w = capture.size.x;
+	int32_t h = capture.size.y;
+
+	// GL rows are bottom to top
+	if (!capture.is_y4m) {
+		char path[280];
+		snprintf(path, sizeof(path), "%s_%05d.png", capture.path, index);
+		stbi_write_png(path, w, h, 4, pixels + w * (h - 1), -w * (int)sizeof(rgba_t));
+		return;
+	}
+
+	// BT.601, 4:4:4
+	uint8_t *py = capture.yuv;
+	uint8_t *pu = py + w * h;
+	uint8_t *pv = pu + w * h;
+	for (int32_t y = 0; y < h; y++) {
+		rgba_t *row = pixels + w * (h - 1 - y);
+		for (int32_t x = 0; x < w; x++) {
+			int32_t r = row[x].as_rgba.r;
+			int32_t g = row[x].as_rgba.g;
+			int32_t b = row[x].as_rgba.b;
+			*py++ = (( 66 * r + 129 * g +  25 * b + 128) >> 8) + 16;
+			*pu++ = ((-38 * r -  74 * g + 112 * b + 128) >> 8) + 128;
+			*pv++ = ((112 * r -  94 * g -  18 * b + 128) >> 8) + 128;
+		}
+	}
+	fputs("FRAME\n", capture.file);
+	fwrite(capture.yuv, 1, w * h * 3, capture.file);
+}
+
+static void render_capture_write_queued(void) {
+	uint32_t write_pos = atomic_load_acquire(&capture.queue_write_pos);
+	while (capture.queue_read_pos != write_pos) {
+		uint32_t i = capture.queue_read_pos % RENDER_CAPTURE_QUEUE_LEN;
+		render_capture_write(capture.queue[i].index, capture.queue[i].pixels);
+		atomic_store_release(&capture.queue_read_pos, capture.queue_read_pos + 1);
+	}
+}
+
+static void render_capture_thread(void *user) {
+	while (true) {
+		// Check the stop flag first, so that everything queued before it was
+		// set is still written
+		uint32_t stop = atomic_load_acquire(&capture.stop);
+		render_capture_write_queued();
+		if (stop) {
+			break;
+		}
+		platform_sleep(0.002);
+	}
+}
+
+static void render_capture_readback(uint32_t pbo_index) {
+	uint32_t bytes = capture.size.x * capture.size.y * sizeof(rgba_t);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, capture.pbos[pbo_index]);
+	void *pixels = glMapBuffer(GL_PIXEL_PACK_BUFFER, GL_READ_ONLY);
+
+	uint32_t write_pos = capture.queue_write_pos;
+	if (!pixels || write_pos - atomic_load_acquire(&capture.queue_read_pos) >= RENDER_CAPTURE_QUEUE_LEN) {
+		capture.frames_dropped++;
+	}
+	else {
+		uint32_t i = write_pos % RENDER_CAPTURE_QUEUE_LEN;
+		memcpy(capture.queue[i].pixels, pixels, bytes);
+		capture.queue[i].index = capture.frames_captured;
+		atomic_store_release(&capture.queue_write_pos, write_pos + 1);
+	}
+	capture.frames_captured++;
+
+	if (pixels) {
+		glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+	}
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+	// Without a thread we have to write it ourselves
+	if (!capture.thread) {
+		render_capture_write_queued();
+	}
+}
+
+void render_capture_start(const char *path) {
+	error_if(capture.enabled, "Capture already running");
+
+	capture = (render_capture_t){0};
+	capture.size = backbuffer_size;
+	snprintf(capture.path, sizeof(capture.path), "%s", path);
+	capture.is_y4m = str_ends_with(path, ".y4m");
+
+	if (capture.is_y4m) {
+		capture.file = fopen(path, "wb");
+		if (!capture.file) {
+			printf("capture: failed to open %s\n", path);
+			return;
+		}
+		fprintf(capture.file, "YUV4MPEG2 W%d H%d F60:1 Ip A1:1 C444\n", capture.size.x, capture.size.y);
+		capture.yuv = malloc(capture.size.x * capture.size.y * 3);
+	}
+
+	uint32_t bytes = capture.size.x * capture.size.y * sizeof(rgba_t);
+	glGenBuffers(RENDER_CAPTURE_PBOS, capture.pbos);
+	for (int i = 0; i < RENDER_CAPTURE_PBOS; i++) {
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, capture.pbos[i]);
+		glBufferData(GL_PIXEL_PACK_BUFFER, bytes, NULL, GL_STREAM_READ);
+	}
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+	for (int i = 0; i < RENDER_CAPTURE_QUEUE_LEN; i++) {
+		capture.queue[i].pixels = malloc(bytes);
+	}
+
+	capture.thread = platform_thread_create(render_capture_thread, NULL);
+	capture.enabled = true;
+	printf("capture: %dx%d to %s\n", capture.size.x, capture.size.y, path);
+}
+
+void render_capture_stop(void) {
+	if (!capture.enabled) {
+		return;
+	}
+	capture.enabled = false;
+
+	// Read back whatever is still in flight, in order
+	uint32_t pending = minint(capture.frames_issued, RENDER_CAPTURE_PBOS);
+	for (uint32_t i = capture.frames_issued - pending; i < capture.frames_issued; i++) {
+		render_capture_readback(i % RENDER_CAPTURE_PBOS);
+	}
+
+	if (capture.thread) {
+		atomic_store_release(&capture.stop, 1);
+		platform_thread_join(capture.thread);
+	}
+
+	glDeleteBuffers(RENDER_CAPTURE_PBOS, capture.pbos);
+	for (int i = 0; i < RENDER_CAPTURE_QUEUE_LEN; i++) {
+		free(capture.queue[i].pixels);
+	}
+	if (capture.file) {
+		fclose(capture.file);
+		free(capture.yuv);
+	}
+	printf("capture: %d frames, %d dropped\n", capture.frames_captured - capture.frames_dropped, capture.frames_dropped);
+}
+
+static void render_capture_frame(void) {
+	if (!capture.enabled) {
+		return;
+	}
+	if (backbuffer_size.x != capture.size.x || backbuffer_size.y != capture.size.y) {
+		printf("capture: resolution changed\n");
+		render_capture_stop();
+		return;
+	}
+
+	uint32_t pbo_index = capture.frames_issued % RENDER_CAPTURE_PBOS;
+	if (capture.frames_issued >= RENDER_CAPTURE_PBOS) {
+		render_capture_readback(pbo_index);
+	}
+
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, capture.pbos[pbo_index]);
+	glReadPixels(0, 0, capture.size.x, capture.size.y, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	capture.frames_issued++;
+}
+
+#endif
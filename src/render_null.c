@@ -0,0 +1,397 @@
+#include "system.h"
+#include "render.h"
+#include "mem.h"
+#include "utils.h"
+#include "platform.h"
+
+// A renderer that draws nothing. It only keeps the state the game reads back
+// (matrices, texture sizes, the palette) and counts what a real renderer
+// would have to do. Useful to profile the game side without a GPU.
+
+#define NEAR_PLANE 16.0
+#define FAR_PLANE (RENDER_FADEOUT_FAR)
+#define TEXTURES_MAX 1024
+
+// Same as the GL renderer, so the flush count is comparable
+#define RENDER_TRIS_BUFFER_CAPACITY 2048
+
+// Print the counters every n frames
+#define RENDER_STATS_FRAMES 600
+
+typedef struct {
+	uint64_t frames;
+	uint64_t tris;
+	uint64_t state_changes;
+	uint64_t flushes;
+	uint64_t texture_bytes;
+} render_stats_t;
+
+typedef struct {
+	vec2i_t size;
+	render_texture_load_t load; // Not loaded yet, if set
+	void *user;
+} render_texture_t;
+
+static vec2i_t screen_size;
+
+static mat4_t view_mat;
+static mat4_t projection_mat;
+static mat4_t sprite_mat;
+static vec2_t fadeout = {RENDER_FADEOUT_NEAR, RENDER_FADEOUT_FAR};
+static render_blend_mode_t blend_mode = RENDER_BLEND_NORMAL;
+
+static render_texture_t textures[TEXTURES_MAX];
+static uint32_t textures_len;
+
+static rgba_t palette[RENDER_PALETTE_SIZE];
+static uint16_t palette_len = 1;
+
+static uint32_t tris_len;
+static render_stats_t stats;
+static render_stats_t stats_total;
+
+uint16_t RENDER_NO_TEXTURE;
+
+static void render_flush(void);
+static void render_state_change(void);
+static void render_stats_accumulate(void);
+static void render_stats_print(const char *name, render_stats_t *s);
+static void render_texture_load(uint16_t texture_index);
+
+void global_init(void) {
+	view_mat = mat4_identity();
+	projection_mat = mat4_identity();
+	sprite_mat = mat4_identity();
+}
+
+void render_init(vec2i_t screen_size) {
+	render_set_screen_size(screen_size);
+	textures_len = 0;
+
+	rgba_t white_pixels[4] = {
+		rgba(128,128,128,255), rgba(128,128,128,255),
+		rgba(128,128,128,255), rgba(128,128,128,255)
+	};
+	RENDER_NO_TEXTURE = render_texture_create(2, 2, white_pixels);
+}
+
+void render_cleanup(void) {
+	render_stats_accumulate();
+	render_stats_print("total", &stats_total);
+}
+
+void render_set_screen_size(vec2i_t size) {
+	screen_size = size;
+
+	float aspect = (float)size.x / (float)size.y;
+	float fov = (73.75 / 180.0) * 3.14159265358;
+	float f = 1.0 / tan(fov / 2);
+	float nf = 1.0 / (NEAR_PLANE - FAR_PLANE);
+	projection_mat = mat4(
+		f / aspect, 0, 0, 0,
+		0, f, 0, 0,
+		0, 0, (FAR_PLANE + NEAR_PLANE) * nf, -1,
+		0, 0, 2 * FAR_PLANE * NEAR_PLANE * nf, 0
+	);
+}
+
+void render_set_resolution(render_resolution_t res) {}
+void render_set_post_effect(render_post_effect_t post) {}
+
+vec2i_t render_size(void) {
+	return screen_size;
+}
+
+
+void render_frame_prepare(void) {}
+
+void render_frame_end(void) {
+	render_flush();
+	stats.frames++;
+
+	if (stats.frames >= RENDER_STATS_FRAMES) {
+		render_stats_print("last", &stats);
+		render_stats_accumulate();
+	}
+}
+
+static void render_stats_accumulate(void) {
+	stats_total.frames += stats.frames;
+	stats_total.tris += stats.tris;
+	stats_total.state_changes += stats.state_changes;
+	stats_total.flushes += stats.flushes;
+	stats_total.texture_bytes += stats.texture_bytes;
+	stats = (render_stats_t){0};
+}
+
+static void render_stats_print(const char *name, render_stats_t *s) {
+	if (s->frames == 0) {
+		return;
+	}
+	printf(
+		"render null, %s %llu frames: %llu tris, %llu state changes, %llu flushes, %llu texture bytes per frame\n",
+		name, (unsigned long long)s->frames,
+		(unsigned long long)(s->tris / s->frames),
+		(unsigned long long)(s->state_changes / s->frames),
+		(unsigned long long)(s->flushes / s->frames),
+		(unsigned long long)(s->texture_bytes / s->frames)
+	);
+}
+
+static void render_flush(void) {
+	if (tris_len == 0) {
+		return;
+	}
+	stats.flushes++;
+	tris_len = 0;
+}
+
+static void render_state_change(void) {
+	render_flush();
+	stats.state_changes++;
+}
+
+void render_set_view(vec3_t pos, vec3_t angles) {
+	render_state_change();
+	view_mat = mat4_identity();
+	mat4_set_translation(&view_mat, vec3(0, 0, 0));
+	mat4_set_roll_pitch_yaw(&view_mat, vec3(angles.x, -angles.y + M_PI, angles.z + M_PI));
+	mat4_translate(&view_mat, vec3_inv(pos));
+	mat4_set_yaw_pitch_roll(&sprite_mat, vec3(-angles.x, angles.y - M_PI, 0));
+}
+
+void render_set_view_2d(void) {
+	render_state_change();
+}
+
+void render_set_model_mat(mat4_t *m) {
+	render_state_change();
+}
+
+void render_set_depth_write(bool enabled) {
+	render_state_change();
+}
+
+void render_set_depth_test(bool enabled) {
+	render_state_change();
+}
+
+void render_set_depth_offset(float offset) {
+	render_state_change();
+}
+
+void render_set_depth_far(bool enabled) {
+	render_state_change();
+}
+
+void render_set_screen_position(vec2_t pos) {
+	render_state_change();
+}
+
+void render_set_blend_mode(render_blend_mode_t new_mode) {
+	if (new_mode == blend_mode) {
+		return;
+	}
+	blend_mode = new_mode;
+	render_state_change();
+}
+
+void render_set_cull_backface(bool enabled) {
+	render_state_change();
+}
+
+void render_set_fadeout(float near, float far) {
+	fadeout = vec2(near, far);
+}
+
+vec2_t render_fadeout(void) {
+	return fadeout;
+}
+
+vec3_t render_transform(vec3_t pos) {
+	return vec3_transform(vec3_transform(pos, &view_mat), &projection_mat);
+}
+
+mat4_t render_view_projection(void) {
+	mat4_t vp_mat;
+	mat4_mul(&vp_mat, &projection_mat, &view_mat);
+	return vp_mat;
+}
+
+frustum_t render_frustum(void) {
+	frustum_t frustum;
+	mat4_t vp_mat = render_view_projection();
+	frustum_from_mat(&frustum, &vp_mat);
+	return frustum;
+}
+
+void render_push_tris(tris_t tris, uint16_t texture_index) {
+	error_if(texture_index >= textures_len, "Invalid texture %d", texture_index);
+	if (textures[texture_index].load) {
+		render_texture_load(texture_index);
+	}
+
+	if (tris_len >= RENDER_TRIS_BUFFER_CAPACITY) {
+		render_flush();
+	}
+	tris_len++;
+	stats.tris++;
+}
+
+void render_push_sprite(vec3_t pos, vec2i_t size, rgba_t color, uint16_t texture_index) {
+	error_if(texture_index >= textures_len, "Invalid texture %d", texture_index);
+
+	// Same work as the other renderers, so the game side cost is comparable
+	vec3_t p0 = vec3_add(pos, vec3_transform(vec3(-size.x * 0.5, -size.y * 0.5, 0), &sprite_mat));
+	vec3_t p1 = vec3_add(pos, vec3_transform(vec3( size.x * 0.5, -size.y * 0.5, 0), &sprite_mat));
+	vec3_t p2 = vec3_add(pos, vec3_transform(vec3(-size.x * 0.5,  size.y * 0.5, 0), &sprite_mat));
+	vec3_t p3 = vec3_add(pos, vec3_transform(vec3( size.x * 0.5,  size.y * 0.5, 0), &sprite_mat));
+
+	tris_t _tris;
+	_tris.vertices[0] = (vertex_t){p0, (vec2_t){0, 0}, color};
+	_tris.vertices[1] = (vertex_t){p1, (vec2_t){0, 0}, color};
+	_tris.vertices[2] = (vertex_t){p2, (vec2_t){0, 0}, color};
+	render_push_tris(_tris, texture_index);
+
+	_tris.vertices[0] = (vertex_t){p2, (vec2_t){0, 0}, color};
+	_tris.vertices[1] = (vertex_t){p1, (vec2_t){0, 0}, color};
+	_tris.vertices[2] = (vertex_t){p3, (vec2_t){0, 0}, color};
+	render_push_tris(_tris, texture_index);
+}
+
+void render_push_2d(vec2i_t pos, vec2i_t size, rgba_t color, uint16_t texture_index) {
+	render_push_2d_tile(pos, vec2i(0, 0), render_texture_size(texture_index), size, color, texture_index);
+}
+
+void render_push_2d_tile(vec2i_t pos, vec2i_t uv_offset, vec2i_t uv_size, vec2i_t size, rgba_t color, uint16_t texture_index) {
+	error_if(texture_index >= textures_len, "Invalid texture %d", texture_index);
+	if (textures[texture_index].load) {
+		render_texture_load(texture_index);
+	}
+
+	if (tris_len + 2 > RENDER_TRIS_BUFFER_CAPACITY) {
+		render_flush();
+	}
+	tris_len += 2;
+	stats.tris += 2;
+}
+
+
+uint16_t render_texture_create(uint32_t width, uint32_t height, rgba_t *pixels) {
+	error_if(textures_len >= TEXTURES_MAX, "TEXTURES_MAX reached");
+
+	uint16_t texture_index = textures_len;
+	textures[texture_index] = (render_texture_t){.size = vec2i(width, height)};
+	textures_len++;
+	stats.texture_bytes += width * height * sizeof(rgba_t);
+	return texture_index;
+}
+
+uint16_t render_texture_create_lazy(uint32_t width, uint32_t height, render_texture_load_t load, void *user) {
+	error_if(textures_len >= TEXTURES_MAX, "TEXTURES_MAX reached");
+
+	uint16_t texture_index = textures_len;
+	textures[texture_index] = (render_texture_t){.size = vec2i(width, height), .load = load, .user = user};
+	textures_len++;
+	return texture_index;
+}
+
+// The pixels are still loaded, so the cost shows up in a profile
+static void render_texture_load(uint16_t texture_index) {
+	render_texture_t *t = &textures[texture_index];
+	uint32_t len = t->size.x * t->size.y;
+	rgba_t *pixels = mem_temp_alloc(sizeof(rgba_t) * len);
+	t->load(t->user, t->size.x, t->size.y, pixels);
+	mem_temp_free(pixels);
+	t->load = NULL;
+	stats.texture_bytes += len * sizeof(rgba_t);
+}
+
+void render_texture_prefetch(uint16_t texture_index) {
+	error_if(texture_index >= textures_len, "Invalid texture %d", texture_index);
+	if (textures[texture_index].load) {
+		render_texture_load(texture_index);
+	}
+}
+
+vec2i_t render_texture_size(uint16_t texture_index) {
+	error_if(texture_index >= textures_len, "Invalid texture %d", texture_index);
+	return textures[texture_index].size;
+}
+
+void render_texture_replace_pixels(int16_t texture_index, rgba_t *pixels) {
+	error_if(texture_index >= textures_len, "Invalid texture %d", texture_index);
+	textures[texture_index].load = NULL;
+	stats.texture_bytes += textures[texture_index].size.x * textures[texture_index].size.y * sizeof(rgba_t);
+}
+
+uint16_t render_palette_alloc(uint16_t len) {
+	error_if(palette_len + len > RENDER_PALETTE_SIZE, "RENDER_PALETTE_SIZE reached");
+	uint16_t start = palette_len;
+	palette_len += len;
+	return start;
+}
+
+void render_set_palette_color(uint16_t slot, rgba_t color) {
+	error_if(slot == 0 || slot >= palette_len, "Invalid palette slot %d", slot);
+	palette[slot] = color;
+}
+
+uint16_t render_palette_len(void) {
+	return palette_len;
+}
+
+void render_palette_reset(uint16_t len) {
+	error_if(len == 0 || len > palette_len, "Invalid palette reset len %d >= %d", len, palette_len);
+	palette_len = len;
+}
+
+uint16_t render_textures_len(void) {
+	return textures_len;
+}
+
+void render_textures_reset(uint16_t len) {
+	error_if(len > textures_len, "Invalid texture reset len %d >= %d", len, textures_len);
+	render_flush();
+	textures_len = len;
+}
+
+void render_textures_dump(const char *path) {}
+
+// Meshes are not supported; everything is pushed each frame
+bool render_mesh_begin(uint32_t tris_len) {
+	return false;
+}
+
+uint16_t render_mesh_end(void) {
+	die("render_mesh_end() without render_mesh_begin()");
+	return RENDER_NO_MESH;
+}
+
+void render_mesh_draw(uint16_t mesh) {
+	die("Invalid mesh %d", mesh);
+}
+
+uint16_t render_meshes_len(void) {
+	return 0;
+}
+
+void render_meshes_reset(uint16_t len) {}
+
+// Video planes are not supported; the frames are drawn as a texture
+bool render_video_begin(vec2i_t size, vec2i_t plane_size) {
+	return false;
+}
+
+void render_video_upload(uint8_t *planes) {
+	die("render_video_upload() without render_video_begin()");
+}
+
+void render_push_video(vec2i_t pos, vec2i_t size) {
+	die("render_push_video() without render_video_begin()");
+}
+
+void render_video_end(void) {}
+
+void render_capture_start(const char *path) {}
+void render_capture_stop(void) {}
@@ -25,10 +25,14 @@ static mat4_t view_mat;
 static mat4_t mvp_mat;
 static mat4_t projection_mat;
 static mat4_t sprite_mat;
+static vec2_t fadeout = {RENDER_FADEOUT_NEAR, RENDER_FADEOUT_FAR};
 
 static render_texture_t textures[TEXTURES_MAX];
 static uint32_t textures_len;
 
+static rgba_t palette[RENDER_PALETTE_SIZE];
+static uint16_t palette_len = 1;
+
 uint16_t RENDER_NO_TEXTURE;
 
 void global_init(void)
@@ -131,14 +135,36 @@ void render_set_model_mat(mat4_t *m) {
 void render_set_depth_write(bool enabled) {}
 void render_set_depth_test(bool enabled) {}
 void render_set_depth_offset(float offset) {}
+void render_set_depth_far(bool enabled) {}
 void render_set_screen_position(vec2_t pos) {}
 void render_set_blend_mode(render_blend_mode_t mode) {}
 void render_set_cull_backface(bool enabled) {}
 
+void render_set_fadeout(float near, float far) {
+	fadeout = vec2(near, far);
+}
+
+vec2_t render_fadeout(void) {
+	return fadeout;
+}
+
 vec3_t render_transform(vec3_t pos) {
 	return vec3_transform(vec3_transform(pos, &view_mat), &projection_mat);
 }
 
+mat4_t render_view_projection() {
+	mat4_t vp_mat;
+	mat4_mul(&vp_mat, &projection_mat, &view_mat);
+	return vp_mat;
+}
+
+frustum_t render_frustum() {
+	frustum_t frustum;
+	mat4_t vp_mat = render_view_projection();
+	frustum_from_mat(&frustum, &vp_mat);
+	return frustum;
+}
+
 void render_push_tris(tris_t tris, uint16_t texture_index) {
 	float w2 = screen_size.x * 0.5;
 	float h2 = screen_size.y * 0.5;
@@ -155,6 +181,10 @@ void render_push_tris(tris_t tris, uint16_t texture_index) {
 	vec2i_t sc2 = vec2i(p2.x * w2 + w2, h2 - p2.y * h2);
 
 	rgba_t color = tris.vertices[0].color;
+	if (tris.vertices[0].color_slot) {
+		color = palette[tris.vertices[0].color_slot];
+		color.as_rgba.a = tris.vertices[0].color.as_rgba.a;
+	}
 	color.as_rgba.r = minint(color.as_rgba.r * 2, 255);
 	color.as_rgba.g = minint(color.as_rgba.g * 2, 255);
 	color.as_rgba.b = minint(color.as_rgba.b * 2, 255);
@@ -224,6 +254,15 @@ uint16_t render_texture_create(uint32_t width, uint32_t height, rgba_t *pixels)
 	return texture_index;
 }
 
+// Textures are not drawn, so lazy ones are never loaded
+uint16_t render_texture_create_lazy(uint32_t width, uint32_t height, render_texture_load_t load, void *user) {
+	return render_texture_create(width, height, NULL);
+}
+
+void render_texture_prefetch(uint16_t texture_index) {
+	error_if(texture_index >= textures_len, "Invalid texture %d", texture_index);
+}
+
 vec2i_t render_texture_size(uint16_t texture_index) {
 	error_if(texture_index >= textures_len, "Invalid texture %d", texture_index);
 	return textures[texture_index].size;
@@ -235,6 +274,27 @@ void render_texture_replace_pixels(int16_t texture_index, rgba_t *pixels) {
 	// memcpy(t->pixels, pixels, t->size.x * t->size.y * sizeof(rgba_t));
 }
 
+uint16_t render_palette_alloc(uint16_t len) {
+	error_if(palette_len + len > RENDER_PALETTE_SIZE, "RENDER_PALETTE_SIZE reached");
+	uint16_t start = palette_len;
+	palette_len += len;
+	return start;
+}
+
+void render_set_palette_color(uint16_t slot, rgba_t color) {
+	error_if(slot == 0 || slot >= palette_len, "Invalid palette slot %d", slot);
+	palette[slot] = color;
+}
+
+uint16_t render_palette_len() {
+	return palette_len;
+}
+
+void render_palette_reset(uint16_t len) {
+	error_if(len == 0 || len > palette_len, "Invalid palette reset len %d >= %d", len, palette_len);
+	palette_len = len;
+}
+
 uint16_t render_textures_len() {
 	return textures_len;
 }
@@ -246,6 +306,44 @@ void render_textures_reset(uint16_t len) {
 
 void render_textures_dump(const char *path) {}
 
+// Meshes are not supported; everything is pushed each frame
+bool render_mesh_begin(uint32_t tris_len) {
+	return false;
+}
+
+uint16_t render_mesh_end(void) {
+	die("render_mesh_end() without render_mesh_begin()");
+	return RENDER_NO_MESH;
+}
+
+void render_mesh_draw(uint16_t mesh) {
+	die("Invalid mesh %d", mesh);
+}
+
+uint16_t render_meshes_len(void) {
+	return 0;
+}
+
+void render_meshes_reset(uint16_t len) {}
+
+// Video planes are not supported; the frames are drawn as a texture
+bool render_video_begin(vec2i_t size, vec2i_t plane_size) {
+	return false;
+}
+
+void render_video_upload(uint8_t *planes) {
+	die("render_video_upload() without render_video_begin()");
+}
+
+void render_push_video(vec2i_t pos, vec2i_t size) {
+	die("render_push_video() without render_video_begin()");
+}
+
+void render_video_end(void) {}
+
+void render_capture_start(const char *path) {}
+void render_capture_stop(void) {}
+
 static uint8_t
 lerp8(uint8_t a, uint8_t b, float t)
 {
@@ -0,0 +1,2045 @@
+#include <vulkan/vulkan.h>
+
+#include "libs/stb_image_write.h"
+
+#include "system.h"
+#include "render.h"
+#include "platform.h"
+#include "mem.h"
+#include "utils.h"
+
+// SPIR-V, built from src/shaders/ by the Makefile
+#include "game.vert.h"
+#include "game.frag.h"
+#include "post.vert.h"
+#include "post_default.frag.h"
+#include "post_crt.frag.h"
+
+#define NEAR_PLANE 16.0
+#define FAR_PLANE (RENDER_FADEOUT_FAR)
+#define TEXTURES_MAX 1024
+
+#define ATLAS_SIZE 64
+#define ATLAS_GRID 32
+#define ATLAS_BORDER 16
+#define ATLAS_MIP_LEVELS 12 // log2(ATLAS_SIZE * ATLAS_GRID) + 1
+
+// All per frame memory is allocated upfront, persistently mapped and used as
+// a ring; nothing is allocated while drawing. With several frames in flight
+// the cpu can record the next frame while the gpu is still busy.
+#define RENDER_FRAMES_IN_FLIGHT 2
+#define RENDER_FRAME_TRIS_MAX (64 * 1024)
+#define RENDER_FRAME_VIEWS_MAX 256
+#define RENDER_VIEW_STRIDE 256 // >= minUniformBufferOffsetAlignment
+#define RENDER_STAGING_SIZE (8 * 1024 * 1024)
+#define RENDER_SWAPCHAIN_IMAGES_MAX 8
+
+// Every combination of the fixed function state gets its own pipeline,
+// built at init. Depth offset and the viewport are dynamic.
+#define RENDER_PIPELINE_BLEND_LIGHTER (1<<0)
+#define RENDER_PIPELINE_DEPTH_TEST    (1<<1)
+#define RENDER_PIPELINE_DEPTH_WRITE   (1<<2)
+#define RENDER_PIPELINE_CULL          (1<<3)
+#define RENDER_PIPELINE_DEPTH_FAR     (1<<4)
+#define RENDER_PIPELINES_MAX          (1<<5)
+
+
+typedef struct {
+	vec2i_t offset;
+	vec2i_t size;
+	render_texture_load_t load; // Not in the atlas yet, if set
+	void *user;
+} render_texture_t;
+
+typedef struct {
+	VkBuffer buffer;
+	VkDeviceMemory memory;
+	void *mapped;
+} render_buffer_t;
+
+typedef struct {
+	VkImage image;
+	VkDeviceMemory memory;
+	VkImageView view;
+} render_image_t;
+
+// Matches the uniform block in shaders/game.vert
+typedef struct {
+	mat4_t view;
+	mat4_t projection;
+	float camera_pos[4];
+	float fade[2];
+} render_view_t;
+
+// Matches the push constants in shaders/game.vert
+typedef struct {
+	mat4_t model;
+	float screen[2];
+} render_draw_t;
+
+// Matches the push constants in shaders/post_crt.frag
+typedef struct {
+	float screen_size[2];
+	float time;
+} render_post_t;
+
+typedef struct {
+	VkCommandPool command_pool;
+	VkCommandBuffer command_buffer;
+	VkFence fence;
+	VkSemaphore image_available;
+	VkDescriptorSet descriptor_set;
+	render_buffer_t vertices;
+	render_buffer_t views;
+} render_frame_t;
+
+uint16_t RENDER_NO_TEXTURE;
+
+static VkInstance instance;
+static VkSurfaceKHR surface = VK_NULL_HANDLE;
+static VkPhysicalDevice physical_device;
+static VkPhysicalDeviceProperties device_properties;
+static VkPhysicalDeviceMemoryProperties memory_properties;
+static VkDevice device;
+static uint32_t queue_family;
+static VkQueue queue;
+static bool has_anisotropy;
+static VkFormat depth_format;
+static VkFormat screen_format = VK_FORMAT_B8G8R8A8_UNORM;
+
+static VkSwapchainKHR swapchain = VK_NULL_HANDLE;
+static uint32_t swapchain_images_len;
+static VkImage swapchain_images[RENDER_SWAPCHAIN_IMAGES_MAX];
+static VkImageView swapchain_views[RENDER_SWAPCHAIN_IMAGES_MAX];
+static VkFramebuffer swapchain_framebuffers[RENDER_SWAPCHAIN_IMAGES_MAX];
+static VkSemaphore swapchain_render_finished[RENDER_SWAPCHAIN_IMAGES_MAX];
+static vec2i_t swapchain_size;
+static bool swapchain_is_dirty = true;
+static uint32_t swapchain_image_index;
+static bool swapchain_image_acquired;
+
+static VkRenderPass scene_pass;
+static VkRenderPass post_pass;
+static VkRenderPass post_pass_present;
+static VkDescriptorSetLayout scene_set_layout;
+static VkDescriptorSetLayout post_set_layout;
+static VkPipelineLayout scene_pipeline_layout;
+static VkPipelineLayout post_pipeline_layout;
+static VkPipeline scene_pipelines[RENDER_PIPELINES_MAX];
+static VkPipeline post_pipelines[NUM_RENDER_POST_EFFCTS];
+static VkDescriptorPool descriptor_pool;
+static VkDescriptorSet post_descriptor_set;
+static VkSampler atlas_sampler_linear;
+static VkSampler atlas_sampler_nearest;
+static VkSampler backbuffer_sampler;
+
+static render_image_t atlas;
+static bool atlas_is_initialized = false;
+static render_image_t backbuffer;
+static render_image_t backbuffer_depth;
+static VkFramebuffer backbuffer_framebuffer = VK_NULL_HANDLE;
+static bool backbuffer_is_dirty = true;
+
+// The offscreen target for the post pass if there is no swapchain image to
+// present to: headless, or a minimized window.
+static render_image_t screen;
+static VkFramebuffer screen_framebuffer = VK_NULL_HANDLE;
+
+static render_frame_t frames[RENDER_FRAMES_IN_FLIGHT];
+static render_frame_t *frame;
+static uint64_t frame_index = 0;
+static bool frame_is_recording = false;
+
+// Texture uploads are recorded into their own command buffer, which is
+// submitted ahead of the frame, or right away when the staging buffer is
+// full.
+static struct {
+	VkCommandPool command_pool;
+	VkCommandBuffer command_buffer;
+	VkFence fence;
+	render_buffer_t staging;
+	uint32_t staging_len;
+	bool is_recording;
+	bool mipmap_is_dirty;
+} upload;
+
+// Vertices are written straight into the current frame's vertex ring. A
+// flush just records a draw for everything since the last one.
+static uint32_t tris_len = 0;
+static uint32_t tris_drawn = 0;
+static uint32_t views_len = 0;
+
+static vec2i_t screen_size;
+static vec2i_t backbuffer_size;
+static render_resolution_t render_res = RENDER_RES_NATIVE;
+static render_post_effect_t post_effect = RENDER_POST_NONE;
+
+static mat4_t projection_mat_2d;
+static mat4_t projection_mat_3d;
+static mat4_t sprite_mat;
+static mat4_t view_mat;
+static vec2_t fadeout = {RENDER_FADEOUT_NEAR, RENDER_FADEOUT_FAR};
+
+// The state for the next draw, and what was last recorded into the command
+// buffer
+static uint32_t pipeline_state;
+static uint32_t pipeline_state_recorded;
+static render_view_t view;
+static bool view_is_dirty;
+static render_draw_t draw;
+static bool draw_is_dirty;
+static float depth_offset;
+static float depth_offset_recorded;
+static bool viewport_is_dirty;
+
+static render_texture_t textures[TEXTURES_MAX];
+static uint32_t textures_len = 0;
+static uint32_t atlas_map[ATLAS_SIZE] = {0};
+
+static rgba_t palette[RENDER_PALETTE_SIZE];
+static uint16_t palette_len = 1;
+
+static void render_flush(void);
+static void render_recreate_swapchain(void);
+static void render_recreate_backbuffer(void);
+static void render_texture_load(render_texture_t *t);
+static void render_capture_frame(VkCommandBuffer cb);
+static void render_capture_readback(uint32_t slot);
+
+
+// -----------------------------------------------------------------------------
+// Helpers
+
+static void vk_check(VkResult result, const char *what) {
+	error_if(result != VK_SUCCESS, "Vulkan %s failed: %d", what, result);
+}
+
+static uint32_t render_memory_type(uint32_t type_bits, VkMemoryPropertyFlags flags) {
+	for (uint32_t i = 0; i < memory_properties.memoryTypeCount; i++) {
+		if ((type_bits & (1 << i)) && flags_is(memory_properties.memoryTypes[i].propertyFlags, flags)) {
+			return i;
+		}
+	}
+	die("No suitable Vulkan memory type");
+	return 0;
+}
+
+static render_buffer_t render_buffer_create(VkDeviceSize size, VkBufferUsageFlags usage) {
+	render_buffer_t b;
+	vk_check(vkCreateBuffer(device, &(VkBufferCreateInfo){
+		.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+		.size = size,
+		.usage = usage,
+		.sharingMode = VK_SHARING_MODE_EXCLUSIVE
+	}, NULL, &b.buffer), "vkCreateBuffer");
+
+	VkMemoryRequirements req;
+	vkGetBufferMemoryRequirements(device, b.buffer, &req);
+	vk_check(vkAllocateMemory(device, &(VkMemoryAllocateInfo){
+		.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+		.allocationSize = req.size,
+		.memoryTypeIndex = render_memory_type(req.memoryTypeBits, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT)
+	}, NULL, &b.memory), "vkAllocateMemory");
+	vkBindBufferMemory(device, b.buffer, b.memory, 0);
+	vk_check(vkMapMemory(device, b.memory, 0, size, 0, &b.mapped), "vkMapMemory");
+	return b;
+}
+
+static void render_buffer_destroy(render_buffer_t *b) {
+	vkDestroyBuffer(device, b->buffer, NULL);
+	vkFreeMemory(device, b->memory, NULL);
+}
+
+static render_image_t render_image_create(vec2i_t size, uint32_t mip_levels, VkFormat format, VkImageUsageFlags usage, VkImageAspectFlags aspect) {
+	render_image_t img;
+	vk_check(vkCreateImage(device, &(VkImageCreateInfo){
+		.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+		.imageType = VK_IMAGE_TYPE_2D,
+		.format = format,
+		.extent = {size.x, size.y, 1},
+		.mipLevels = mip_levels,
+		.arrayLayers = 1,
+		.samples = VK_SAMPLE_COUNT_1_BIT,
+		.tiling = VK_IMAGE_TILING_OPTIMAL,
+		.usage = usage,
+		.sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+		.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED
+	}, NULL, &img.image), "vkCreateImage");
+
+	VkMemoryRequirements req;
+	vkGetImageMemoryRequirements(device, img.image, &req);
+	vk_check(vkAllocateMemory(device, &(VkMemoryAllocateInfo){
+		.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+		.allocationSize = req.size,
+		.memoryTypeIndex = render_memory_type(req.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT)
+	}, NULL, &img.memory), "vkAllocateMemory");
+	vkBindImageMemory(device, img.image, img.memory, 0);
+
+	vk_check(vkCreateImageView(device, &(VkImageViewCreateInfo){
+		.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
+		.image = img.image,
+		.viewType = VK_IMAGE_VIEW_TYPE_2D,
+		.format = format,
+		.subresourceRange = {aspect, 0, mip_levels, 0, 1}
+	}, NULL, &img.view), "vkCreateImageView");
+	return img;
+}
+
+static void render_image_destroy(render_image_t *img) {
+	vkDestroyImageView(device, img->view, NULL);
+	vkDestroyImage(device, img->image, NULL);
+	vkFreeMemory(device, img->memory, NULL);
+}
+
+static VkShaderModule render_shader_module(const uint32_t *code, size_t size) {
+	VkShaderModule module;
+	vk_check(vkCreateShaderModule(device, &(VkShaderModuleCreateInfo){
+		.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO,
+		.codeSize = size,
+		.pCode = code
+	}, NULL, &module), "vkCreateShaderModule");
+	return module;
+}
+
+// Makes transfer writes to host visible memory readable once the fence of the
+// command buffer was waited on
+static void render_host_read_barrier(VkCommandBuffer cb) {
+	vkCmdPipelineBarrier(cb, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0, 1, &(VkMemoryBarrier){
+		.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+		.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+		.dstAccessMask = VK_ACCESS_HOST_READ_BIT
+	}, 0, NULL, 0, NULL);
+}
+
+static void render_image_barrier(
+	VkCommandBuffer cb, VkImage image, uint32_t base_mip, uint32_t mip_levels,
+	VkImageLayout old_layout, VkImageLayout new_layout,
+	VkAccessFlags src_access, VkAccessFlags dst_access,
+	VkPipelineStageFlags src_stage, VkPipelineStageFlags dst_stage
+) {
+	vkCmdPipelineBarrier(cb, src_stage, dst_stage, 0, 0, NULL, 0, NULL, 1, &(VkImageMemoryBarrier){
+		.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+		.srcAccessMask = src_access,
+		.dstAccessMask = dst_access,
+		.oldLayout = old_layout,
+		.newLayout = new_layout,
+		.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+		.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+		.image = image,
+		.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, base_mip, mip_levels, 0, 1}
+	});
+}
+
+// Vulkan has y pointing down and a depth range of 0..1; the game and all
+// culling uses GL's clip space, so we only convert for the gpu.
+static mat4_t render_clip_correct(mat4_t *m) {
+	mat4_t correction = mat4(
+		1,  0, 0,   0,
+		0, -1, 0,   0,
+		0,  0, 0.5, 0,
+		0,  0, 0.5, 1
+	);
+	mat4_t res;
+	mat4_mul(&res, &correction, m);
+	return res;
+}
+
+
+// -----------------------------------------------------------------------------
+// Init
+
+static void render_init_device(void) {
+	uint32_t platform_extensions_len = 0;
+	const char **platform_extensions = platform_vulkan_extensions(&platform_extensions_len);
+
+	vk_check(vkCreateInstance(&(VkInstanceCreateInfo){
+		.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO,
+		.pApplicationInfo = &(VkApplicationInfo){
+			.sType = VK_STRUCTURE_TYPE_APPLICATION_INFO,
+			.pApplicationName = SYSTEM_WINDOW_NAME,
+			.apiVersion = VK_API_VERSION_1_0
+		},
+		.enabledExtensionCount = platform_extensions_len,
+		.ppEnabledExtensionNames = platform_extensions
+	}, NULL, &instance), "vkCreateInstance");
+
+	surface = platform_vulkan_create_surface(instance);
+
+	// Prefer a discrete gpu, but take anything with a graphics queue (that
+	// can present to our surface); lavapipe is fine.
+	VkPhysicalDevice devices[16];
+	uint32_t devices_len = len(devices);
+	vkEnumeratePhysicalDevices(instance, &devices_len, devices);
+
+	int best_score = -1;
+	for (uint32_t i = 0; i < devices_len; i++) {
+		VkQueueFamilyProperties families[16];
+		uint32_t families_len = len(families);
+		vkGetPhysicalDeviceQueueFamilyProperties(devices[i], &families_len, families);
+
+		for (uint32_t f = 0; f < families_len; f++) {
+			VkBool32 can_present = VK_TRUE;
+			if (surface) {
+				vkGetPhysicalDeviceSurfaceSupportKHR(devices[i], f, surface, &can_present);
+			}
+			if (!(families[f].queueFlags & VK_QUEUE_GRAPHICS_BIT) || !can_present) {
+				continue;
+			}
+
+			VkPhysicalDeviceProperties props;
+			vkGetPhysicalDeviceProperties(devices[i], &props);
+			int score =
+				props.deviceType == VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU ? 3 :
+				props.deviceType == VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU ? 2 : 1;
+			if (score > best_score) {
+				best_score = score;
+				physical_device = devices[i];
+				queue_family = f;
+			}
+			break;
+		}
+	}
+	error_if(best_score < 0, "No suitable Vulkan device");
+
+	vkGetPhysicalDeviceProperties(physical_device, &device_properties);
+	vkGetPhysicalDeviceMemoryProperties(physical_device, &memory_properties);
+	error_if(device_properties.limits.minUniformBufferOffsetAlignment > RENDER_VIEW_STRIDE, "RENDER_VIEW_STRIDE too small");
+	printf("vulkan device: %s\n", device_properties.deviceName);
+
+	VkPhysicalDeviceFeatures features;
+	vkGetPhysicalDeviceFeatures(physical_device, &features);
+	has_anisotropy = features.samplerAnisotropy;
+
+	const char *device_extensions[] = {VK_KHR_SWAPCHAIN_EXTENSION_NAME};
+	vk_check(vkCreateDevice(physical_device, &(VkDeviceCreateInfo){
+		.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO,
+		.queueCreateInfoCount = 1,
+		.pQueueCreateInfos = &(VkDeviceQueueCreateInfo){
+			.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO,
+			.queueFamilyIndex = queue_family,
+			.queueCount = 1,
+			.pQueuePriorities = &(float){1.0}
+		},
+		.enabledExtensionCount = surface ? 1 : 0,
+		.ppEnabledExtensionNames = device_extensions,
+		.pEnabledFeatures = &(VkPhysicalDeviceFeatures){
+			.samplerAnisotropy = has_anisotropy
+		}
+	}, NULL, &device), "vkCreateDevice");
+	vkGetDeviceQueue(device, queue_family, 0, &queue);
+
+	VkFormat depth_formats[] = {VK_FORMAT_D32_SFLOAT, VK_FORMAT_X8_D24_UNORM_PACK32, VK_FORMAT_D24_UNORM_S8_UINT, VK_FORMAT_D16_UNORM};
+	depth_format = VK_FORMAT_UNDEFINED;
+	for (int i = 0; i < len(depth_formats) && depth_format == VK_FORMAT_UNDEFINED; i++) {
+		VkFormatProperties props;
+		vkGetPhysicalDeviceFormatProperties(physical_device, depth_formats[i], &props);
+		if (props.optimalTilingFeatures & VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT) {
+			depth_format = depth_formats[i];
+		}
+	}
+	error_if(depth_format == VK_FORMAT_UNDEFINED, "No Vulkan depth format");
+
+	if (surface) {
+		VkSurfaceFormatKHR formats[32];
+		uint32_t formats_len = len(formats);
+		vkGetPhysicalDeviceSurfaceFormatsKHR(physical_device, surface, &formats_len, formats);
+		screen_format = formats[0].format;
+		for (uint32_t i = 0; i < formats_len; i++) {
+			if (formats[i].format == VK_FORMAT_B8G8R8A8_UNORM || formats[i].format == VK_FORMAT_R8G8B8A8_UNORM) {
+				screen_format = formats[i].format;
+				break;
+			}
+		}
+	}
+}
+
+static VkRenderPass render_create_pass(VkFormat color_format, VkImageLayout final_layout, bool has_depth) {
+	VkAttachmentDescription attachments[] = {
+		{
+			.format = color_format,
+			.samples = VK_SAMPLE_COUNT_1_BIT,
+			.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR,
+			.storeOp = VK_ATTACHMENT_STORE_OP_STORE,
+			.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE,
+			.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE,
+			.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+			.finalLayout = final_layout
+		},
+		{
+			.format = depth_format,
+			.samples = VK_SAMPLE_COUNT_1_BIT,
+			.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR,
+			.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE,
+			.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE,
+			.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE,
+			.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+			.finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL
+		}
+	};
+	VkSubpassDependency dependencies[] = {
+		{
+			// Wait for the previous user of the color attachment (last frame's
+			// post pass reading it, or the swapchain acquire)
+			.srcSubpass = VK_SUBPASS_EXTERNAL,
+			.dstSubpass = 0,
+			.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+			.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT,
+			.srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+			.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT
+		},
+		{
+			// The post pass samples the scene
+			.srcSubpass = 0,
+			.dstSubpass = VK_SUBPASS_EXTERNAL,
+			.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+			.dstStageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+			.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+			.dstAccessMask = VK_ACCESS_SHADER_READ_BIT
+		}
+	};
+
+	VkRenderPass pass;
+	vk_check(vkCreateRenderPass(device, &(VkRenderPassCreateInfo){
+		.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO,
+		.attachmentCount = has_depth ? 2 : 1,
+		.pAttachments = attachments,
+		.subpassCount = 1,
+		.pSubpasses = &(VkSubpassDescription){
+			.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS,
+			.colorAttachmentCount = 1,
+			.pColorAttachments = &(VkAttachmentReference){0, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL},
+			.pDepthStencilAttachment = has_depth
+				? &(VkAttachmentReference){1, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL}
+				: NULL
+		},
+		.dependencyCount = len(dependencies),
+		.pDependencies = dependencies
+	}, NULL, &pass), "vkCreateRenderPass");
+	return pass;
+}
+
+static VkPipeline render_create_pipeline(
+	VkPipelineLayout layout, VkRenderPass pass,
+	VkShaderModule vs, VkShaderModule fs, bool has_vertices, uint32_t state
+) {
+	VkVertexInputAttributeDescription attributes[] = {
+		{0, 0, VK_FORMAT_R32G32B32_SFLOAT, offsetof(vertex_t, pos)},
+		{1, 0, VK_FORMAT_R32G32_SFLOAT, offsetof(vertex_t, uv)},
+		{2, 0, VK_FORMAT_R8G8B8A8_UNORM, offsetof(vertex_t, color)},
+	};
+	VkDynamicState dynamic_states[] = {
+		VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR, VK_DYNAMIC_STATE_DEPTH_BIAS
+	};
+
+	VkPipeline pipeline;
+	vk_check(vkCreateGraphicsPipelines(device, VK_NULL_HANDLE, 1, &(VkGraphicsPipelineCreateInfo){
+		.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO,
+		.stageCount = 2,
+		.pStages = (VkPipelineShaderStageCreateInfo[]){
+			{
+				.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+				.stage = VK_SHADER_STAGE_VERTEX_BIT,
+				.module = vs,
+				.pName = "main"
+			},
+			{
+				.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+				.stage = VK_SHADER_STAGE_FRAGMENT_BIT,
+				.module = fs,
+				.pName = "main"
+			}
+		},
+		.pVertexInputState = &(VkPipelineVertexInputStateCreateInfo){
+			.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO,
+			.vertexBindingDescriptionCount = has_vertices ? 1 : 0,
+			.pVertexBindingDescriptions = &(VkVertexInputBindingDescription){0, sizeof(vertex_t), VK_VERTEX_INPUT_RATE_VERTEX},
+			.vertexAttributeDescriptionCount = has_vertices ? len(attributes) : 0,
+			.pVertexAttributeDescriptions = attributes
+		},
+		.pInputAssemblyState = &(VkPipelineInputAssemblyStateCreateInfo){
+			.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO,
+			.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST
+		},
+		.pViewportState = &(VkPipelineViewportStateCreateInfo){
+			.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO,
+			.viewportCount = 1,
+			.scissorCount = 1
+		},
+		.pRasterizationState = &(VkPipelineRasterizationStateCreateInfo){
+			.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO,
+			.polygonMode = VK_POLYGON_MODE_FILL,
+			.cullMode = flags_is(state, RENDER_PIPELINE_CULL) ? VK_CULL_MODE_BACK_BIT : VK_CULL_MODE_NONE,
+			.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE,
+			.depthBiasEnable = has_vertices,
+			.lineWidth = 1.0
+		},
+		.pMultisampleState = &(VkPipelineMultisampleStateCreateInfo){
+			.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO,
+			.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT
+		},
+		.pDepthStencilState = &(VkPipelineDepthStencilStateCreateInfo){
+			.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO,
+			.depthTestEnable = flags_is(state, RENDER_PIPELINE_DEPTH_TEST),
+			.depthWriteEnable = flags_is(state, RENDER_PIPELINE_DEPTH_WRITE),
+			.depthCompareOp = flags_is(state, RENDER_PIPELINE_DEPTH_FAR)
+				? VK_COMPARE_OP_LESS_OR_EQUAL
+				: VK_COMPARE_OP_LESS
+		},
+		.pColorBlendState = &(VkPipelineColorBlendStateCreateInfo){
+			.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO,
+			.attachmentCount = 1,
+			.pAttachments = &(VkPipelineColorBlendAttachmentState){
+				.blendEnable = has_vertices,
+				.srcColorBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA,
+				.dstColorBlendFactor = flags_is(state, RENDER_PIPELINE_BLEND_LIGHTER)
+					? VK_BLEND_FACTOR_ONE
+					: VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA,
+				.colorBlendOp = VK_BLEND_OP_ADD,
+				.srcAlphaBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA,
+				.dstAlphaBlendFactor = flags_is(state, RENDER_PIPELINE_BLEND_LIGHTER)
+					? VK_BLEND_FACTOR_ONE
+					: VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA,
+				.alphaBlendOp = VK_BLEND_OP_ADD,
+				.colorWriteMask =
+					VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT |
+					VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT
+			}
+		},
+		.pDynamicState = &(VkPipelineDynamicStateCreateInfo){
+			.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO,
+			.dynamicStateCount = has_vertices ? 3 : 2,
+			.pDynamicStates = dynamic_states
+		},
+		.layout = layout,
+		.renderPass = pass,
+		.subpass = 0
+	}, NULL, &pipeline), "vkCreateGraphicsPipelines");
+	return pipeline;
+}
+
+static void render_init_pipelines(void) {
+	scene_pass = render_create_pass(VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, true);
+
+	// Both post passes are compatible; they only differ in the final layout
+	post_pass = render_create_pass(screen_format, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, false);
+	if (surface) {
+		post_pass_present = render_create_pass(screen_format, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR, false);
+	}
+
+	// Layouts
+	vk_check(vkCreateDescriptorSetLayout(device, &(VkDescriptorSetLayoutCreateInfo){
+		.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+		.bindingCount = 2,
+		.pBindings = (VkDescriptorSetLayoutBinding[]){
+			{0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 1, VK_SHADER_STAGE_VERTEX_BIT, NULL},
+			{1, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_FRAGMENT_BIT, NULL}
+		}
+	}, NULL, &scene_set_layout), "vkCreateDescriptorSetLayout");
+
+	vk_check(vkCreateDescriptorSetLayout(device, &(VkDescriptorSetLayoutCreateInfo){
+		.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+		.bindingCount = 1,
+		.pBindings = &(VkDescriptorSetLayoutBinding){
+			0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_FRAGMENT_BIT, NULL
+		}
+	}, NULL, &post_set_layout), "vkCreateDescriptorSetLayout");
+
+	vk_check(vkCreatePipelineLayout(device, &(VkPipelineLayoutCreateInfo){
+		.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+		.setLayoutCount = 1,
+		.pSetLayouts = &scene_set_layout,
+		.pushConstantRangeCount = 1,
+		.pPushConstantRanges = &(VkPushConstantRange){VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(render_draw_t)}
+	}, NULL, &scene_pipeline_layout), "vkCreatePipelineLayout");
+
+	vk_check(vkCreatePipelineLayout(device, &(VkPipelineLayoutCreateInfo){
+		.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+		.setLayoutCount = 1,
+		.pSetLayouts = &post_set_layout,
+		.pushConstantRangeCount = 1,
+		.pPushConstantRanges = &(VkPushConstantRange){VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(render_post_t)}
+	}, NULL, &post_pipeline_layout), "vkCreatePipelineLayout");
+
+	// Pipelines
+	VkShaderModule game_vs = render_shader_module(game_vert, sizeof(game_vert));
+	VkShaderModule game_fs = render_shader_module(game_frag, sizeof(game_frag));
+	for (uint32_t state = 0; state < RENDER_PIPELINES_MAX; state++) {
+		scene_pipelines[state] = render_create_pipeline(scene_pipeline_layout, scene_pass, game_vs, game_fs, true, state);
+	}
+
+	VkShaderModule post_vs = render_shader_module(post_vert, sizeof(post_vert));
+	VkShaderModule post_default_fs = render_shader_module(post_default_frag, sizeof(post_default_frag));
+	VkShaderModule post_crt_fs = render_shader_module(post_crt_frag, sizeof(post_crt_frag));
+	post_pipelines[RENDER_POST_NONE] = render_create_pipeline(post_pipeline_layout, post_pass, post_vs, post_default_fs, false, 0);
+	post_pipelines[RENDER_POST_CRT] = render_create_pipeline(post_pipeline_layout, post_pass, post_vs, post_crt_fs, false, 0);
+
+	vkDestroyShaderModule(device, game_vs, NULL);
+	vkDestroyShaderModule(device, game_fs, NULL);
+	vkDestroyShaderModule(device, post_vs, NULL);
+	vkDestroyShaderModule(device, post_default_fs, NULL);
+	vkDestroyShaderModule(device, post_crt_fs, NULL);
+
+	// Samplers
+	vk_check(vkCreateSampler(device, &(VkSamplerCreateInfo){
+		.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO,
+		.magFilter = VK_FILTER_NEAREST,
+		.minFilter = VK_FILTER_LINEAR,
+		.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR,
+		.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+		.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+		.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+		.anisotropyEnable = has_anisotropy,
+		.maxAnisotropy = has_anisotropy ? device_properties.limits.maxSamplerAnisotropy : 1,
+		.maxLod = RENDER_USE_MIPMAPS ? ATLAS_MIP_LEVELS : 0
+	}, NULL, &atlas_sampler_linear), "vkCreateSampler");
+
+	VkSamplerCreateInfo nearest_info = {
+		.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO,
+		.magFilter = VK_FILTER_NEAREST,
+		.minFilter = VK_FILTER_NEAREST,
+		.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST,
+		.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+		.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+		.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+		.maxLod = 0
+	};
+	vk_check(vkCreateSampler(device, &nearest_info, NULL, &atlas_sampler_nearest), "vkCreateSampler");
+	vk_check(vkCreateSampler(device, &nearest_info, NULL, &backbuffer_sampler), "vkCreateSampler");
+}
+
+static void render_init_frames(void) {
+	vk_check(vkCreateDescriptorPool(device, &(VkDescriptorPoolCreateInfo){
+		.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
+		.maxSets = RENDER_FRAMES_IN_FLIGHT + 1,
+		.poolSizeCount = 2,
+		.pPoolSizes = (VkDescriptorPoolSize[]){
+			{VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, RENDER_FRAMES_IN_FLIGHT},
+			{VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, RENDER_FRAMES_IN_FLIGHT + 1}
+		}
+	}, NULL, &descriptor_pool), "vkCreateDescriptorPool");
+
+	vk_check(vkAllocateDescriptorSets(device, &(VkDescriptorSetAllocateInfo){
+		.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+		.descriptorPool = descriptor_pool,
+		.descriptorSetCount = 1,
+		.pSetLayouts = &post_set_layout
+	}, &post_descriptor_set), "vkAllocateDescriptorSets");
+
+	for (int i = 0; i < RENDER_FRAMES_IN_FLIGHT; i++) {
+		render_frame_t *f = &frames[i];
+		vk_check(vkCreateCommandPool(device, &(VkCommandPoolCreateInfo){
+			.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+			.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT,
+			.queueFamilyIndex = queue_family
+		}, NULL, &f->command_pool), "vkCreateCommandPool");
+
+		vk_check(vkAllocateCommandBuffers(device, &(VkCommandBufferAllocateInfo){
+			.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+			.commandPool = f->command_pool,
+			.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+			.commandBufferCount = 1
+		}, &f->command_buffer), "vkAllocateCommandBuffers");
+
+		vk_check(vkCreateFence(device, &(VkFenceCreateInfo){
+			.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO,
+			.flags = VK_FENCE_CREATE_SIGNALED_BIT
+		}, NULL, &f->fence), "vkCreateFence");
+
+		vk_check(vkCreateSemaphore(device, &(VkSemaphoreCreateInfo){
+			.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO
+		}, NULL, &f->image_available), "vkCreateSemaphore");
+
+		f->vertices = render_buffer_create(RENDER_FRAME_TRIS_MAX * sizeof(tris_t), VK_BUFFER_USAGE_VERTEX_BUFFER_BIT);
+		f->views = render_buffer_create(RENDER_FRAME_VIEWS_MAX * RENDER_VIEW_STRIDE, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT);
+
+		vk_check(vkAllocateDescriptorSets(device, &(VkDescriptorSetAllocateInfo){
+			.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+			.descriptorPool = descriptor_pool,
+			.descriptorSetCount = 1,
+			.pSetLayouts = &scene_set_layout
+		}, &f->descriptor_set), "vkAllocateDescriptorSets");
+
+		vkUpdateDescriptorSets(device, 1, &(VkWriteDescriptorSet){
+			.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+			.dstSet = f->descriptor_set,
+			.dstBinding = 0,
+			.descriptorCount = 1,
+			.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC,
+			.pBufferInfo = &(VkDescriptorBufferInfo){f->views.buffer, 0, sizeof(render_view_t)}
+		}, 0, NULL);
+	}
+
+	// Uploads
+	vk_check(vkCreateCommandPool(device, &(VkCommandPoolCreateInfo){
+		.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+		.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT,
+		.queueFamilyIndex = queue_family
+	}, NULL, &upload.command_pool), "vkCreateCommandPool");
+
+	vk_check(vkAllocateCommandBuffers(device, &(VkCommandBufferAllocateInfo){
+		.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+		.commandPool = upload.command_pool,
+		.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+		.commandBufferCount = 1
+	}, &upload.command_buffer), "vkAllocateCommandBuffers");
+
+	vk_check(vkCreateFence(device, &(VkFenceCreateInfo){
+		.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO,
+		.flags = VK_FENCE_CREATE_SIGNALED_BIT
+	}, NULL, &upload.fence), "vkCreateFence");
+
+	upload.staging = render_buffer_create(RENDER_STAGING_SIZE, VK_BUFFER_USAGE_TRANSFER_SRC_BIT);
+}
+
+static void render_update_atlas_sampler(void) {
+	VkSampler sampler = render_res == RENDER_RES_NATIVE
+		? atlas_sampler_linear
+		: atlas_sampler_nearest;
+	for (int i = 0; i < RENDER_FRAMES_IN_FLIGHT; i++) {
+		vkUpdateDescriptorSets(device, 1, &(VkWriteDescriptorSet){
+			.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+			.dstSet = frames[i].descriptor_set,
+			.dstBinding = 1,
+			.descriptorCount = 1,
+			.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+			.pImageInfo = &(VkDescriptorImageInfo){sampler, atlas.view, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL}
+		}, 0, NULL);
+	}
+}
+
+void global_init(void) {
+	view_mat = mat4_identity();
+	sprite_mat = mat4_identity();
+	projection_mat_2d = mat4_identity();
+	projection_mat_3d = mat4_identity();
+	draw.model = mat4_identity();
+}
+
+void render_init(vec2i_t size) {
+	render_init_device();
+	render_init_pipelines();
+	render_init_frames();
+
+	uint32_t atlas_size = ATLAS_SIZE * ATLAS_GRID;
+	atlas = render_image_create(
+		vec2i(atlas_size, atlas_size), ATLAS_MIP_LEVELS, VK_FORMAT_R8G8B8A8_UNORM,
+		VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
+		VK_IMAGE_ASPECT_COLOR_BIT
+	);
+
+	pipeline_state = RENDER_PIPELINE_CULL | RENDER_PIPELINE_DEPTH_TEST | RENDER_PIPELINE_DEPTH_WRITE;
+	render_set_screen_size(size);
+	render_set_view(vec3(0, 0, 0), vec3(0, 0, 0));
+
+	rgba_t white_pixels[4] = {
+		rgba(128,128,128,255), rgba(128,128,128,255),
+		rgba(128,128,128,255), rgba(128,128,128,255)
+	};
+	RENDER_NO_TEXTURE = render_texture_create(2, 2, white_pixels);
+}
+
+void render_cleanup(void) {
+	render_capture_stop();
+	vkDeviceWaitIdle(device);
+}
+
+
+// -----------------------------------------------------------------------------
+// Swapchain and backbuffer
+
+static void render_destroy_swapchain_framebuffers(void) {
+	for (uint32_t i = 0; i < swapchain_images_len; i++) {
+		vkDestroyFramebuffer(device, swapchain_framebuffers[i], NULL);
+		vkDestroyImageView(device, swapchain_views[i], NULL);
+		vkDestroySemaphore(device, swapchain_render_finished[i], NULL);
+	}
+	swapchain_images_len = 0;
+}
+
+static void render_recreate_swapchain(void) {
+	swapchain_is_dirty = false;
+	if (!surface) {
+		return;
+	}
+
+	vkDeviceWaitIdle(device);
+	render_destroy_swapchain_framebuffers();
+
+	VkSurfaceCapabilitiesKHR caps;
+	vkGetPhysicalDeviceSurfaceCapabilitiesKHR(physical_device, surface, &caps);
+	VkExtent2D extent = caps.currentExtent;
+	if (extent.width == 0xffffffff) {
+		extent.width = maxint(caps.minImageExtent.width, minint(screen_size.x, caps.maxImageExtent.width));
+		extent.height = maxint(caps.minImageExtent.height, minint(screen_size.y, caps.maxImageExtent.height));
+	}
+
+	// Minimized; we'll draw into the offscreen target until we get a size
+	if (extent.width == 0 || extent.height == 0) {
+		vkDestroySwapchainKHR(device, swapchain, NULL);
+		swapchain = VK_NULL_HANDLE;
+		return;
+	}
+
+	uint32_t images_len = caps.minImageCount + 1;
+	if (caps.maxImageCount && images_len > caps.maxImageCount) {
+		images_len = caps.maxImageCount;
+	}
+
+	VkCompositeAlphaFlagBitsKHR composite_alpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR;
+	if (!(caps.supportedCompositeAlpha & composite_alpha)) {
+		composite_alpha = VK_COMPOSITE_ALPHA_INHERIT_BIT_KHR;
+	}
+
+	VkSwapchainKHR old_swapchain = swapchain;
+	vk_check(vkCreateSwapchainKHR(device, &(VkSwapchainCreateInfoKHR){
+		.sType = VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR,
+		.surface = surface,
+		.minImageCount = images_len,
+		.imageFormat = screen_format,
+		.imageColorSpace = VK_COLOR_SPACE_SRGB_NONLINEAR_KHR,
+		.imageExtent = extent,
+		.imageArrayLayers = 1,
+		.imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT,
+		.imageSharingMode = VK_SHARING_MODE_EXCLUSIVE,
+		.preTransform = caps.currentTransform,
+		.compositeAlpha = composite_alpha,
+		.presentMode = VK_PRESENT_MODE_FIFO_KHR,
+		.clipped = VK_TRUE,
+		.oldSwapchain = old_swapchain
+	}, NULL, &swapchain), "vkCreateSwapchainKHR");
+	if (old_swapchain) {
+		vkDestroySwapchainKHR(device, old_swapchain, NULL);
+	}
+
+	swapchain_size = vec2i(extent.width, extent.height);
+	swapchain_images_len = len(swapchain_images);
+	vkGetSwapchainImagesKHR(device, swapchain, &swapchain_images_len, swapchain_images);
+
+	for (uint32_t i = 0; i < swapchain_images_len; i++) {
+		vk_check(vkCreateImageView(device, &(VkImageViewCreateInfo){
+			.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
+			.image = swapchain_images[i],
+			.viewType = VK_IMAGE_VIEW_TYPE_2D,
+			.format = screen_format,
+			.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1}
+		}, NULL, &swapchain_views[i]), "vkCreateImageView");
+
+		vk_check(vkCreateFramebuffer(device, &(VkFramebufferCreateInfo){
+			.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO,
+			.renderPass = post_pass_present,
+			.attachmentCount = 1,
+			.pAttachments = &swapchain_views[i],
+			.width = extent.width,
+			.height = extent.height,
+			.layers = 1
+		}, NULL, &swapchain_framebuffers[i]), "vkCreateFramebuffer");
+
+		vk_check(vkCreateSemaphore(device, &(VkSemaphoreCreateInfo){
+			.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO
+		}, NULL, &swapchain_render_finished[i]), "vkCreateSemaphore");
+	}
+}
+
+static void render_recreate_backbuffer(void) {
+	backbuffer_is_dirty = false;
+	vkDeviceWaitIdle(device);
+
+	if (backbuffer_framebuffer) {
+		vkDestroyFramebuffer(device, backbuffer_framebuffer, NULL);
+		vkDestroyFramebuffer(device, screen_framebuffer, NULL);
+		render_image_destroy(&backbuffer);
+		render_image_destroy(&backbuffer_depth);
+		render_image_destroy(&screen);
+	}
+
+	vec2i_t bb_size = vec2i(maxint(backbuffer_size.x, 1), maxint(backbuffer_size.y, 1));
+	backbuffer = render_image_create(
+		bb_size, 1, VK_FORMAT_R8G8B8A8_UNORM,
+		VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
+		VK_IMAGE_ASPECT_COLOR_BIT
+	);
+	backbuffer_depth = render_image_create(
+		bb_size, 1, depth_format,
+		VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT,
+		VK_IMAGE_ASPECT_DEPTH_BIT
+	);
+	vk_check(vkCreateFramebuffer(device, &(VkFramebufferCreateInfo){
+		.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO,
+		.renderPass = scene_pass,
+		.attachmentCount = 2,
+		.pAttachments = (VkImageView[]){backbuffer.view, backbuffer_depth.view},
+		.width = bb_size.x,
+		.height = bb_size.y,
+		.layers = 1
+	}, NULL, &backbuffer_framebuffer), "vkCreateFramebuffer");
+
+	vec2i_t s_size = vec2i(maxint(screen_size.x, 1), maxint(screen_size.y, 1));
+	screen = render_image_create(
+		s_size, 1, screen_format,
+		VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
+		VK_IMAGE_ASPECT_COLOR_BIT
+	);
+	vk_check(vkCreateFramebuffer(device, &(VkFramebufferCreateInfo){
+		.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO,
+		.renderPass = post_pass,
+		.attachmentCount = 1,
+		.pAttachments = &screen.view,
+		.width = s_size.x,
+		.height = s_size.y,
+		.layers = 1
+	}, NULL, &screen_framebuffer), "vkCreateFramebuffer");
+
+	vkUpdateDescriptorSets(device, 1, &(VkWriteDescriptorSet){
+		.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+		.dstSet = post_descriptor_set,
+		.dstBinding = 0,
+		.descriptorCount = 1,
+		.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+		.pImageInfo = &(VkDescriptorImageInfo){backbuffer_sampler, backbuffer.view, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL}
+	}, 0, NULL);
+	render_update_atlas_sampler();
+}
+
+
+static mat4_t render_setup_2d_projection_mat(vec2i_t size) {
+	float near = -1;
+	float far = 1;
+	float left = 0;
+	float right = size.x;
+	float bottom = size.y;
+	float top = 0;
+	float lr = 1 / (left - right);
+	float bt = 1 / (bottom - top);
+	float nf = 1 / (near - far);
+	return mat4(
+		-2 * lr,  0,  0,  0,
+		0,  -2 * bt,  0,  0,
+		0,        0,  2 * nf,    0,
+		(left + right) * lr, (top + bottom) * bt, (far + near) * nf, 1
+	);
+}
+
+static mat4_t render_setup_3d_projection_mat(vec2i_t size) {
+	// See render_gl.c; a vertical fov of 73.75deg
+	float aspect = (float)size.x / (float)size.y;
+	float fov = (73.75 / 180.0) * 3.14159265358;
+	float f = 1.0 / tan(fov / 2);
+	float nf = 1.0 / (NEAR_PLANE - FAR_PLANE);
+	return mat4(
+		f / aspect, 0, 0, 0,
+		0, f, 0, 0,
+		0, 0, (FAR_PLANE + NEAR_PLANE) * nf, -1,
+		0, 0, 2 * FAR_PLANE * NEAR_PLANE * nf, 0
+	);
+}
+
+void render_set_screen_size(vec2i_t size) {
+	screen_size = size;
+	swapchain_is_dirty = true;
+	render_set_resolution(render_res);
+}
+
+void render_set_resolution(render_resolution_t res) {
+	render_res = res;
+
+	if (res == RENDER_RES_NATIVE) {
+		backbuffer_size = screen_size;
+	}
+	else {
+		float aspect = (float)screen_size.x / (float)screen_size.y;
+		if (res == RENDER_RES_240P) {
+			backbuffer_size = vec2i(240.0 * aspect, 240);
+		}
+		else if (res == RENDER_RES_480P) {
+			backbuffer_size = vec2i(480.0 * aspect, 480);
+		}
+		else {
+			die("Invalid resolution: %d", res);
+		}
+	}
+
+	// The images are recreated with the next frame; we may be in the middle of
+	// one now.
+	backbuffer_is_dirty = true;
+	projection_mat_2d = render_setup_2d_projection_mat(backbuffer_size);
+	projection_mat_3d = render_setup_3d_projection_mat(backbuffer_size);
+}
+
+void render_set_post_effect(render_post_effect_t post) {
+	error_if(post < 0 || post > NUM_RENDER_POST_EFFCTS, "Invalid post effect %d", post);
+	post_effect = post;
+}
+
+vec2i_t render_size(void) {
+	return backbuffer_size;
+}
+
+
+// -----------------------------------------------------------------------------
+// Texture uploads
+
+static void render_upload_begin(void) {
+	if (upload.is_recording) {
+		return;
+	}
+
+	// Wait for the last batch, so we can reuse the staging buffer
+	vkWaitForFences(device, 1, &upload.fence, VK_TRUE, UINT64_MAX);
+	vkResetFences(device, 1, &upload.fence);
+	vkResetCommandPool(device, upload.command_pool, 0);
+	vkBeginCommandBuffer(upload.command_buffer, &(VkCommandBufferBeginInfo){
+		.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+		.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT
+	});
+
+	// Earlier frames may still sample the atlas
+	render_image_barrier(
+		upload.command_buffer, atlas.image, 0, ATLAS_MIP_LEVELS,
+		atlas_is_initialized ? VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL : VK_IMAGE_LAYOUT_UNDEFINED,
+		VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+		0, VK_ACCESS_TRANSFER_WRITE_BIT,
+		VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT
+	);
+	atlas_is_initialized = true;
+	upload.staging_len = 0;
+	upload.is_recording = true;
+}
+
+static void render_upload_submit(bool wait) {
+	if (!upload.is_recording) {
+		return;
+	}
+
+	VkCommandBuffer cb = upload.command_buffer;
+	uint32_t first_shader_read_mip = 0;
+	if (upload.mipmap_is_dirty) {
+		int32_t size = ATLAS_SIZE * ATLAS_GRID;
+		for (uint32_t i = 1; i < ATLAS_MIP_LEVELS; i++) {
+			render_image_barrier(
+				cb, atlas.image, i - 1, 1,
+				VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+				VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_TRANSFER_READ_BIT,
+				VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT
+			);
+			vkCmdBlitImage(
+				cb,
+				atlas.image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+				atlas.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+				1, &(VkImageBlit){
+					.srcSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, i - 1, 0, 1},
+					.srcOffsets = {{0, 0, 0}, {size, size, 1}},
+					.dstSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, i, 0, 1},
+					.dstOffsets = {{0, 0, 0}, {size / 2, size / 2, 1}}
+				},
+				VK_FILTER_LINEAR
+			);
+			render_image_barrier(
+				cb, atlas.image, i - 1, 1,
+				VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+				VK_ACCESS_TRANSFER_READ_BIT, VK_ACCESS_SHADER_READ_BIT,
+				VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT
+			);
+			size /= 2;
+		}
+		first_shader_read_mip = ATLAS_MIP_LEVELS - 1;
+		upload.mipmap_is_dirty = false;
+	}
+
+	render_image_barrier(
+		cb, atlas.image, first_shader_read_mip, ATLAS_MIP_LEVELS - first_shader_read_mip,
+		VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+		VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT,
+		VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT
+	);
+	vkEndCommandBuffer(cb);
+
+	// Submitted ahead of the frame on the same queue; the barriers above order
+	// it against the frame's draws.
+	vk_check(vkQueueSubmit(queue, 1, &(VkSubmitInfo){
+		.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+		.commandBufferCount = 1,
+		.pCommandBuffers = &cb
+	}, upload.fence), "vkQueueSubmit");
+	upload.is_recording = false;
+
+	if (wait) {
+		vkWaitForFences(device, 1, &upload.fence, VK_TRUE, UINT64_MAX);
+	}
+}
+
+// Returns a pointer into the staging buffer for w * h pixels, that are copied
+// to x, y in the atlas
+static rgba_t *render_upload_pixels(uint32_t x, uint32_t y, uint32_t w, uint32_t h) {
+	uint32_t bytes = w * h * sizeof(rgba_t);
+	error_if(bytes > RENDER_STAGING_SIZE, "Texture too large for RENDER_STAGING_SIZE");
+	if (upload.is_recording && upload.staging_len + bytes > RENDER_STAGING_SIZE) {
+		render_upload_submit(true);
+	}
+	render_upload_begin();
+
+	uint32_t offset = upload.staging_len;
+	upload.staging_len += (bytes + 15) & ~15;
+	vkCmdCopyBufferToImage(
+		upload.command_buffer, upload.staging.buffer,
+		atlas.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+		1, &(VkBufferImageCopy){
+			.bufferOffset = offset,
+			.imageSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1},
+			.imageOffset = {x, y, 0},
+			.imageExtent = {w, h, 1}
+		}
+	);
+	return (rgba_t *)((uint8_t *)upload.staging.mapped + offset);
+}
+
+
+// -----------------------------------------------------------------------------
+// Frame
+
+void render_frame_prepare(void) {
+	frame = &frames[frame_index % RENDER_FRAMES_IN_FLIGHT];
+	vkWaitForFences(device, 1, &frame->fence, VK_TRUE, UINT64_MAX);
+	render_capture_readback(frame_index % RENDER_FRAMES_IN_FLIGHT);
+
+	if (backbuffer_is_dirty) {
+		render_recreate_backbuffer();
+	}
+	if (swapchain_is_dirty) {
+		render_recreate_swapchain();
+	}
+
+	swapchain_image_acquired = false;
+	if (swapchain) {
+		VkResult res = vkAcquireNextImageKHR(device, swapchain, UINT64_MAX, frame->image_available, VK_NULL_HANDLE, &swapchain_image_index);
+		if (res == VK_ERROR_OUT_OF_DATE_KHR) {
+			swapchain_is_dirty = true;
+		}
+		else {
+			error_if(res != VK_SUCCESS && res != VK_SUBOPTIMAL_KHR, "vkAcquireNextImageKHR failed: %d", res);
+			swapchain_image_acquired = true;
+		}
+	}
+
+	vkResetFences(device, 1, &frame->fence);
+	vkResetCommandPool(device, frame->command_pool, 0);
+	vkBeginCommandBuffer(frame->command_buffer, &(VkCommandBufferBeginInfo){
+		.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+		.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT
+	});
+
+	vec2i_t bb_size = vec2i(maxint(backbuffer_size.x, 1), maxint(backbuffer_size.y, 1));
+	vkCmdBeginRenderPass(frame->command_buffer, &(VkRenderPassBeginInfo){
+		.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO,
+		.renderPass = scene_pass,
+		.framebuffer = backbuffer_framebuffer,
+		.renderArea = {{0, 0}, {bb_size.x, bb_size.y}},
+		.clearValueCount = 2,
+		.pClearValues = (VkClearValue[]){
+			{.color = {{0, 0, 0, 1}}},
+			{.depthStencil = {1, 0}}
+		}
+	}, VK_SUBPASS_CONTENTS_INLINE);
+	vkCmdSetScissor(frame->command_buffer, 0, 1, &(VkRect2D){{0, 0}, {bb_size.x, bb_size.y}});
+	VkDeviceSize offset = 0;
+	vkCmdBindVertexBuffers(frame->command_buffer, 0, 1, &frame->vertices.buffer, &offset);
+
+	frame_is_recording = true;
+	tris_len = 0;
+	tris_drawn = 0;
+	views_len = 0;
+
+	// Force all state to be recorded with the first draw
+	pipeline_state_recorded = RENDER_PIPELINES_MAX;
+	view_is_dirty = true;
+	draw_is_dirty = true;
+	viewport_is_dirty = true;
+	depth_offset_recorded = -1;
+
+	flags_add(pipeline_state, RENDER_PIPELINE_DEPTH_TEST | RENDER_PIPELINE_DEPTH_WRITE);
+	depth_offset = 0;
+	draw.screen[0] = 0;
+	draw.screen[1] = 0;
+}
+
+void render_frame_end(void) {
+	render_flush();
+
+	VkCommandBuffer cb = frame->command_buffer;
+	vkCmdEndRenderPass(cb);
+	render_capture_frame(cb);
+
+	VkFramebuffer fb = screen_framebuffer;
+	vec2i_t fb_size = vec2i(maxint(screen_size.x, 1), maxint(screen_size.y, 1));
+	VkRenderPass pass = post_pass;
+	if (swapchain_image_acquired) {
+		fb = swapchain_framebuffers[swapchain_image_index];
+		fb_size = swapchain_size;
+		pass = post_pass_present;
+	}
+
+	vkCmdBeginRenderPass(cb, &(VkRenderPassBeginInfo){
+		.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO,
+		.renderPass = pass,
+		.framebuffer = fb,
+		.renderArea = {{0, 0}, {fb_size.x, fb_size.y}},
+		.clearValueCount = 1,
+		.pClearValues = &(VkClearValue){.color = {{0, 0, 0, 1}}}
+	}, VK_SUBPASS_CONTENTS_INLINE);
+	vkCmdSetViewport(cb, 0, 1, &(VkViewport){0, 0, fb_size.x, fb_size.y, 0, 1});
+	vkCmdSetScissor(cb, 0, 1, &(VkRect2D){{0, 0}, {fb_size.x, fb_size.y}});
+	vkCmdBindPipeline(cb, VK_PIPELINE_BIND_POINT_GRAPHICS, post_pipelines[post_effect]);
+	vkCmdBindDescriptorSets(cb, VK_PIPELINE_BIND_POINT_GRAPHICS, post_pipeline_layout, 0, 1, &post_descriptor_set, 0, NULL);
+	render_post_t post = {{fb_size.x, fb_size.y}, system_cycle_time()};
+	vkCmdPushConstants(cb, post_pipeline_layout, VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(post), &post);
+	vkCmdDraw(cb, 3, 1, 0, 0);
+	vkCmdEndRenderPass(cb);
+	vkEndCommandBuffer(cb);
+
+	render_upload_submit(false);
+
+	VkSemaphore render_finished = swapchain_image_acquired
+		? swapchain_render_finished[swapchain_image_index]
+		: VK_NULL_HANDLE;
+	vk_check(vkQueueSubmit(queue, 1, &(VkSubmitInfo){
+		.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+		.waitSemaphoreCount = swapchain_image_acquired ? 1 : 0,
+		.pWaitSemaphores = &frame->image_available,
+		.pWaitDstStageMask = &(VkPipelineStageFlags){VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT},
+		.commandBufferCount = 1,
+		.pCommandBuffers = &cb,
+		.signalSemaphoreCount = swapchain_image_acquired ? 1 : 0,
+		.pSignalSemaphores = &render_finished
+	}, frame->fence), "vkQueueSubmit");
+
+	if (swapchain_image_acquired) {
+		VkResult res = vkQueuePresentKHR(queue, &(VkPresentInfoKHR){
+			.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR,
+			.waitSemaphoreCount = 1,
+			.pWaitSemaphores = &render_finished,
+			.swapchainCount = 1,
+			.pSwapchains = &swapchain,
+			.pImageIndices = &swapchain_image_index
+		});
+		if (res == VK_ERROR_OUT_OF_DATE_KHR || res == VK_SUBOPTIMAL_KHR) {
+			swapchain_is_dirty = true;
+		}
+	}
+
+	frame_is_recording = false;
+	frame_index++;
+}
+
+static void render_flush(void) {
+	if (!frame_is_recording || tris_len == tris_drawn) {
+		return;
+	}
+
+	VkCommandBuffer cb = frame->command_buffer;
+	if (pipeline_state != pipeline_state_recorded) {
+		vkCmdBindPipeline(cb, VK_PIPELINE_BIND_POINT_GRAPHICS, scene_pipelines[pipeline_state]);
+
+		// Depth far puts everything onto the far plane; see render_gl.c
+		if (flags_is(pipeline_state, RENDER_PIPELINE_DEPTH_FAR) != flags_is(pipeline_state_recorded, RENDER_PIPELINE_DEPTH_FAR)) {
+			viewport_is_dirty = true;
+		}
+		pipeline_state_recorded = pipeline_state;
+	}
+
+	if (viewport_is_dirty) {
+		float min_depth = flags_is(pipeline_state, RENDER_PIPELINE_DEPTH_FAR) ? 1 : 0;
+		vkCmdSetViewport(cb, 0, 1, &(VkViewport){0, 0, maxint(backbuffer_size.x, 1), maxint(backbuffer_size.y, 1), min_depth, 1});
+		viewport_is_dirty = false;
+	}
+
+	if (depth_offset != depth_offset_recorded) {
+		// Same as glPolygonOffset(offset, 1.0)
+		if (depth_offset == 0) {
+			vkCmdSetDepthBias(cb, 0, 0, 0);
+		}
+		else {
+			vkCmdSetDepthBias(cb, 1.0, 0, depth_offset);
+		}
+		depth_offset_recorded = depth_offset;
+	}
+
+	if (view_is_dirty) {
+		error_if(views_len >= RENDER_FRAME_VIEWS_MAX, "RENDER_FRAME_VIEWS_MAX reached");
+		uint32_t offset = views_len * RENDER_VIEW_STRIDE;
+		memcpy((uint8_t *)frame->views.mapped + offset, &view, sizeof(view));
+		vkCmdBindDescriptorSets(cb, VK_PIPELINE_BIND_POINT_GRAPHICS, scene_pipeline_layout, 0, 1, &frame->descriptor_set, 1, &offset);
+		views_len++;
+		view_is_dirty = false;
+	}
+
+	if (draw_is_dirty) {
+		vkCmdPushConstants(cb, scene_pipeline_layout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(draw), &draw);
+		draw_is_dirty = false;
+	}
+
+	vkCmdDraw(cb, (tris_len - tris_drawn) * 3, 1, tris_drawn * 3, 0);
+	tris_drawn = tris_len;
+}
+
+
+// -----------------------------------------------------------------------------
+// State
+
+void render_set_view(vec3_t pos, vec3_t angles) {
+	render_flush();
+	render_set_depth_write(true);
+	render_set_depth_test(true);
+
+	view_mat = mat4_identity();
+	mat4_set_translation(&view_mat, vec3(0, 0, 0));
+	mat4_set_roll_pitch_yaw(&view_mat, vec3(angles.x, -angles.y + M_PI, angles.z + M_PI));
+	mat4_translate(&view_mat, vec3_inv(pos));
+	mat4_set_yaw_pitch_roll(&sprite_mat, vec3(-angles.x, angles.y - M_PI, 0));
+
+	render_set_model_mat(&mat4_identity());
+
+	view.view = view_mat;
+	view.projection = render_clip_correct(&projection_mat_3d);
+	view.camera_pos[0] = pos.x;
+	view.camera_pos[1] = pos.y;
+	view.camera_pos[2] = pos.z;
+	view.fade[0] = fadeout.x;
+	view.fade[1] = fadeout.y;
+	view_is_dirty = true;
+}
+
+void render_set_view_2d(void) {
+	render_flush();
+	render_set_depth_test(false);
+	render_set_depth_write(false);
+
+	render_set_model_mat(&mat4_identity());
+
+	view.view = mat4_identity();
+	view.projection = render_clip_correct(&projection_mat_2d);
+	view.camera_pos[0] = 0;
+	view.camera_pos[1] = 0;
+	view.camera_pos[2] = 0;
+	view_is_dirty = true;
+}
+
+void render_set_model_mat(mat4_t *m) {
+	render_flush();
+	draw.model = *m;
+	draw_is_dirty = true;
+}
+
+static void render_set_pipeline_flag(uint32_t flag, bool enabled) {
+	uint32_t state = enabled
+		? pipeline_state | flag
+		: pipeline_state & ~flag;
+	if (state != pipeline_state) {
+		render_flush();
+		pipeline_state = state;
+	}
+}
+
+void render_set_depth_write(bool enabled) {
+	render_set_pipeline_flag(RENDER_PIPELINE_DEPTH_WRITE, enabled);
+}
+
+void render_set_depth_test(bool enabled) {
+	render_set_pipeline_flag(RENDER_PIPELINE_DEPTH_TEST, enabled);
+}
+
+void render_set_depth_offset(float offset) {
+	if (offset != depth_offset) {
+		render_flush();
+		depth_offset = offset;
+	}
+}
+
+void render_set_depth_far(bool enabled) {
+	render_set_pipeline_flag(RENDER_PIPELINE_DEPTH_FAR, enabled);
+}
+
+void render_set_screen_position(vec2_t pos) {
+	render_flush();
+	// Vulkan's clip space y is already flipped; see render_clip_correct()
+	draw.screen[0] = pos.x;
+	draw.screen[1] = pos.y;
+	draw_is_dirty = true;
+}
+
+void render_set_blend_mode(render_blend_mode_t mode) {
+	render_set_pipeline_flag(RENDER_PIPELINE_BLEND_LIGHTER, mode == RENDER_BLEND_LIGHTER);
+}
+
+void render_set_cull_backface(bool enabled) {
+	render_set_pipeline_flag(RENDER_PIPELINE_CULL, enabled);
+}
+
+void render_set_fadeout(float near, float far) {
+	// Takes effect with the next render_set_view()
+	fadeout = vec2(near, far);
+}
+
+vec2_t render_fadeout(void) {
+	return fadeout;
+}
+
+vec3_t render_transform(vec3_t pos) {
+	return vec3_transform(vec3_transform(pos, &view_mat), &projection_mat_3d);
+}
+
+mat4_t render_view_projection(void) {
+	mat4_t vp_mat;
+	mat4_mul(&vp_mat, &projection_mat_3d, &view_mat);
+	return vp_mat;
+}
+
+frustum_t render_frustum(void) {
+	frustum_t frustum;
+	mat4_t vp_mat = render_view_projection();
+	frustum_from_mat(&frustum, &vp_mat);
+	return frustum;
+}
+
+
+// -----------------------------------------------------------------------------
+// Geometry
+
+void render_push_tris(tris_t tris, uint16_t texture_index) {
+	error_if(texture_index >= textures_len, "Invalid texture %d", texture_index);
+	error_if(tris_len >= RENDER_FRAME_TRIS_MAX, "RENDER_FRAME_TRIS_MAX reached");
+
+	render_texture_t *t = &textures[texture_index];
+	if (t->load) {
+		render_texture_load(t);
+	}
+	for (int i = 0; i < 3; i++) {
+		tris.vertices[i].uv.x += t->offset.x;
+		tris.vertices[i].uv.y += t->offset.y;
+		if (tris.vertices[i].color_slot) {
+			rgba_t color = palette[tris.vertices[i].color_slot];
+			color.as_rgba.a = tris.vertices[i].color.as_rgba.a;
+			tris.vertices[i].color = color;
+		}
+	}
+	((tris_t *)frame->vertices.mapped)[tris_len++] = tris;
+}
+
+void render_push_sprite(vec3_t pos, vec2i_t size, rgba_t color, uint16_t texture_index) {
+	error_if(texture_index >= textures_len, "Invalid texture %d", texture_index);
+
+	vec3_t p1 = vec3_add(pos, vec3_transform(vec3(-size.x * 0.5, -size.y * 0.5, 0), &sprite_mat));
+	vec3_t p2 = vec3_add(pos, vec3_transform(vec3( size.x * 0.5, -size.y * 0.5, 0), &sprite_mat));
+	vec3_t p3 = vec3_add(pos, vec3_transform(vec3(-size.x * 0.5,  size.y * 0.5, 0), &sprite_mat));
+	vec3_t p4 = vec3_add(pos, vec3_transform(vec3( size.x * 0.5,  size.y * 0.5, 0), &sprite_mat));
+
+	render_texture_t *t = &textures[texture_index];
+	render_push_tris((tris_t){
+		.vertices = {
+			{.pos = p1, .uv = {0, 0}, .color = color},
+			{.pos = p2, .uv = {0 + t->size.x ,0}, .color = color},
+			{.pos = p3, .uv = {0, 0 + t->size.y}, .color = color},
+		}
+	}, texture_index);
+	render_push_tris((tris_t){
+		.vertices = {
+			{.pos = p3, .uv = {0, 0 + t->size.y}, .color = color},
+			{.pos = p2, .uv = {0 + t->size.x, 0}, .color = color},
+			{.pos = p4, .uv = {0 + t->size.x, 0 + t->size.y}, .color = color},
+		}
+	}, texture_index);
+}
+
+void render_push_2d(vec2i_t pos, vec2i_t size, rgba_t color, uint16_t texture_index) {
+	render_push_2d_tile(pos, vec2i(0, 0), render_texture_size(texture_index), size, color, texture_index);
+}
+
+void render_push_2d_tile(vec2i_t pos, vec2i_t uv_offset, vec2i_t uv_size, vec2i_t size, rgba_t color, uint16_t texture_index) {
+	error_if(texture_index >= textures_len, "Invalid texture %d", texture_index);
+	render_push_tris((tris_t){
+		.vertices = {
+			{.pos = {pos.x, pos.y + size.y, 0}, .uv = {uv_offset.x , uv_offset.y + uv_size.y}, .color = color},
+			{.pos = {pos.x + size.x, pos.y, 0}, .uv = {uv_offset.x +  uv_size.x, uv_offset.y}, .color = color},
+			{.pos = {pos.x, pos.y, 0}, .uv = {uv_offset.x , uv_offset.y}, .color = color},
+		}
+	}, texture_index);
+
+	render_push_tris((tris_t){
+		.vertices = {
+			{.pos = {pos.x + size.x, pos.y + size.y, 0}, .uv = {uv_offset.x + uv_size.x, uv_offset.y + uv_size.y}, .color = color},
+			{.pos = {pos.x + size.x, pos.y, 0}, .uv = {uv_offset.x + uv_size.x, uv_offset.y}, .color = color},
+			{.pos = {pos.x, pos.y + size.y, 0}, .uv = {uv_offset.x , uv_offset.y + uv_size.y}, .color = color},
+		}
+	}, texture_index);
+}
+
+
+// -----------------------------------------------------------------------------
+// Textures
+
+static void render_atlas_insert(render_texture_t *t, uint32_t tw, uint32_t th, rgba_t *pixels) {
+	uint32_t bw = tw + ATLAS_BORDER * 2;
+	uint32_t bh = th + ATLAS_BORDER * 2;
+
+	// Find a position in the atlas for this texture (with added border);
+	// same as render_gl.c
+	uint32_t grid_width = (bw + ATLAS_GRID - 1) / ATLAS_GRID;
+	uint32_t grid_height = (bh + ATLAS_GRID - 1) / ATLAS_GRID;
+	uint32_t grid_x = 0;
+	uint32_t grid_y = ATLAS_SIZE - grid_height + 1;
+
+	for (uint32_t cx = 0; cx < ATLAS_SIZE - grid_width; cx++) {
+		if (atlas_map[cx] >= grid_y) {
+			continue;
+		}
+
+		uint32_t cy = atlas_map[cx];
+		bool is_best = true;
+
+		for (uint32_t bx = cx; bx < cx + grid_width; bx++) {
+			if (atlas_map[bx] >= grid_y) {
+				is_best = false;
+				cx = bx;
+				break;
+			}
+			if (atlas_map[bx] > cy) {
+				cy = atlas_map[bx];
+			}
+		}
+		if (is_best) {
+			grid_y = cy;
+			grid_x = cx;
+		}
+	}
+
+	error_if(grid_y + grid_height > ATLAS_SIZE, "Render atlas ran out of space");
+
+	for (uint32_t cx = grid_x; cx < grid_x + grid_width; cx++) {
+		atlas_map[cx] = grid_y + grid_height;
+	}
+
+	// Write the texture with its border pixels straight into the staging
+	// buffer
+	uint32_t x = grid_x * ATLAS_GRID;
+	uint32_t y = grid_y * ATLAS_GRID;
+	rgba_t *pb = render_upload_pixels(x, y, bw, bh);
+
+	if (tw && th) {
+		for (int32_t by = 0; by < bh; by++) {
+			int32_t sy = maxint(0, minint(by - ATLAS_BORDER, th - 1));
+			rgba_t *src = pixels + sy * tw;
+			rgba_t *dst = pb + by * bw;
+			for (int32_t bx = 0; bx < ATLAS_BORDER; bx++) {
+				dst[bx] = src[0];
+				dst[bw - ATLAS_BORDER + bx] = src[tw - 1];
+			}
+			memcpy(dst + ATLAS_BORDER, src, tw * sizeof(rgba_t));
+		}
+	}
+
+	upload.mipmap_is_dirty = RENDER_USE_MIPMAPS;
+	*t = (render_texture_t){ {x + ATLAS_BORDER, y + ATLAS_BORDER}, {tw, th} };
+
+	printf("inserted atlas texture (%3dx%3d) at (%3d,%3d)\n", tw, th, grid_x, grid_y);
+}
+
+// Uploads made during a frame are submitted before the frame itself, so a
+// lazy texture can be drawn the same frame it is loaded.
+static void render_texture_load(render_texture_t *t) {
+	rgba_t *pixels = mem_temp_alloc(sizeof(rgba_t) * t->size.x * t->size.y);
+	t->load(t->user, t->size.x, t->size.y, pixels);
+	render_atlas_insert(t, t->size.x, t->size.y, pixels);
+	mem_temp_free(pixels);
+}
+
+uint16_t render_texture_create(uint32_t tw, uint32_t th, rgba_t *pixels) {
+	error_if(textures_len >= TEXTURES_MAX, "TEXTURES_MAX reached");
+	uint16_t texture_index = textures_len;
+	textures_len++;
+	render_atlas_insert(&textures[texture_index], tw, th, pixels);
+	return texture_index;
+}
+
+uint16_t render_texture_create_lazy(uint32_t tw, uint32_t th, render_texture_load_t load, void *user) {
+	error_if(textures_len >= TEXTURES_MAX, "TEXTURES_MAX reached");
+	uint16_t texture_index = textures_len;
+	textures_len++;
+	textures[texture_index] = (render_texture_t){.size = {tw, th}, .load = load, .user = user};
+	return texture_index;
+}
+
+void render_texture_prefetch(uint16_t texture_index) {
+	error_if(texture_index >= textures_len, "Invalid texture %d", texture_index);
+	if (textures[texture_index].load) {
+		render_texture_load(&textures[texture_index]);
+	}
+}
+
+vec2i_t render_texture_size(uint16_t texture_index) {
+	error_if(texture_index >= textures_len, "Invalid texture %d", texture_index);
+	return textures[texture_index].size;
+}
+
+void render_texture_replace_pixels(int16_t texture_index, rgba_t *pixels) {
+	error_if(texture_index >= textures_len, "Invalid texture %d", texture_index);
+
+	render_texture_t *t = &textures[texture_index];
+	if (t->load) {
+		render_atlas_insert(t, t->size.x, t->size.y, pixels);
+		return;
+	}
+	rgba_t *dst = render_upload_pixels(t->offset.x, t->offset.y, t->size.x, t->size.y);
+	memcpy(dst, pixels, t->size.x * t->size.y * sizeof(rgba_t));
+}
+
+uint16_t render_palette_alloc(uint16_t len) {
+	error_if(palette_len + len > RENDER_PALETTE_SIZE, "RENDER_PALETTE_SIZE reached");
+	uint16_t start = palette_len;
+	palette_len += len;
+	return start;
+}
+
+void render_set_palette_color(uint16_t slot, rgba_t color) {
+	error_if(slot == 0 || slot >= palette_len, "Invalid palette slot %d", slot);
+	palette[slot] = color;
+}
+
+uint16_t render_palette_len(void) {
+	return palette_len;
+}
+
+void render_palette_reset(uint16_t len) {
+	error_if(len == 0 || len > palette_len, "Invalid palette reset len %d >= %d", len, palette_len);
+	palette_len = len;
+}
+
+uint16_t render_textures_len(void) {
+	return textures_len;
+}
+
+void render_textures_reset(uint16_t len) {
+	error_if(len > textures_len, "Invalid texture reset len %d >= %d", len, textures_len);
+	render_flush();
+
+	textures_len = len;
+	clear(atlas_map);
+
+	// Clear completely and recreate the default white texture
+	if (len == 0) {
+		rgba_t white_pixels[4] = {
+			rgba(128,128,128,255), rgba(128,128,128,255),
+			rgba(128,128,128,255), rgba(128,128,128,255)
+		};
+		RENDER_NO_TEXTURE = render_texture_create(2, 2, white_pixels);
+		return;
+	}
+
+	// Replay all texture grid insertions up to the reset len. Lazy textures
+	// may have been inserted after later ones, or not at all.
+	for (int i = 0; i < len; i++) {
+		if (textures[i].load) {
+			continue;
+		}
+		uint32_t grid_x = (textures[i].offset.x - ATLAS_BORDER) / ATLAS_GRID;
+		uint32_t grid_y = (textures[i].offset.y - ATLAS_BORDER) / ATLAS_GRID;
+		uint32_t grid_width = (textures[i].size.x + ATLAS_BORDER * 2 + ATLAS_GRID - 1) / ATLAS_GRID;
+		uint32_t grid_height = (textures[i].size.y + ATLAS_BORDER * 2 + ATLAS_GRID - 1) / ATLAS_GRID;
+		for (uint32_t cx = grid_x; cx < grid_x + grid_width; cx++) {
+			atlas_map[cx] = maxint(atlas_map[cx], grid_y + grid_height);
+		}
+	}
+}
+
+void render_textures_dump(const char *path) {
+	int width = ATLAS_SIZE * ATLAS_GRID;
+	int height = ATLAS_SIZE * ATLAS_GRID;
+	render_buffer_t readback = render_buffer_create(sizeof(rgba_t) * width * height, VK_BUFFER_USAGE_TRANSFER_DST_BIT);
+
+	// Pending uploads first, then copy with the upload command buffer
+	render_upload_submit(false);
+	vkWaitForFences(device, 1, &upload.fence, VK_TRUE, UINT64_MAX);
+	vkResetFences(device, 1, &upload.fence);
+	vkResetCommandPool(device, upload.command_pool, 0);
+
+	VkCommandBuffer cb = upload.command_buffer;
+	vkBeginCommandBuffer(cb, &(VkCommandBufferBeginInfo){
+		.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+		.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT
+	});
+	render_image_barrier(
+		cb, atlas.image, 0, 1,
+		VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+		0, VK_ACCESS_TRANSFER_READ_BIT,
+		VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT
+	);
+	vkCmdCopyImageToBuffer(
+		cb, atlas.image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, readback.buffer,
+		1, &(VkBufferImageCopy){
+			.imageSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1},
+			.imageExtent = {width, height, 1}
+		}
+	);
+	render_image_barrier(
+		cb, atlas.image, 0, 1,
+		VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+		0, VK_ACCESS_SHADER_READ_BIT,
+		VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT
+	);
+	render_host_read_barrier(cb);
+	vkEndCommandBuffer(cb);
+
+	vk_check(vkQueueSubmit(queue, 1, &(VkSubmitInfo){
+		.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+		.commandBufferCount = 1,
+		.pCommandBuffers = &cb
+	}, upload.fence), "vkQueueSubmit");
+	vkWaitForFences(device, 1, &upload.fence, VK_TRUE, UINT64_MAX);
+
+	stbi_write_png(path, width, height, 4, readback.mapped, 0);
+	render_buffer_destroy(&readback);
+}
+
+// Meshes are not implemented for Vulkan yet; everything is pushed each frame
+bool render_mesh_begin(uint32_t tris_len) {
+	return false;
+}
+
+uint16_t render_mesh_end(void) {
+	die("render_mesh_end() without render_mesh_begin()");
+	return RENDER_NO_MESH;
+}
+
+void render_mesh_draw(uint16_t mesh) {
+	die("Invalid mesh %d", mesh);
+}
+
+uint16_t render_meshes_len(void) {
+	return 0;
+}
+
+void render_meshes_reset(uint16_t len) {}
+
+// Video planes are not supported; the frames are drawn as a texture
+bool render_video_begin(vec2i_t size, vec2i_t plane_size) {
+	return false;
+}
+
+void render_video_upload(uint8_t *planes) {
+	die("render_video_upload() without render_video_begin()");
+}
+
+void render_push_video(vec2i_t pos, vec2i_t size) {
+	die("render_push_video() without render_video_begin()");
+}
+
+void render_video_end(void) {}
+
+
+// -----------------------------------------------------------------------------
+// Frame capture
+
+// The backbuffer is copied into a readback buffer of the frame after the scene
+// pass. That buffer is only read in render_frame_prepare(), after the frame's
+// fence was waited on anyway, so we never wait for the gpu. As in
+// render_gl.c, the pixels are handed to a writer thread and frames are dropped
+// if that falls behind.
+#define RENDER_CAPTURE_QUEUE_LEN 8
+
+typedef struct {
+	bool enabled;
+	bool is_y4m;
+	char path[256];
+	FILE *file;
+	vec2i_t size;
+	uint8_t *yuv;
+
+	render_buffer_t buffers[RENDER_FRAMES_IN_FLIGHT];
+	bool buffer_is_pending[RENDER_FRAMES_IN_FLIGHT];
+	uint32_t frames_captured;
+	uint32_t frames_dropped;
+
+	// Single producer (render thread), single consumer (writer thread)
+	struct {
+		uint32_t index;
+		rgba_t *pixels;
+	} queue[RENDER_CAPTURE_QUEUE_LEN];
+	uint32_t queue_read_pos;
+	uint32_t queue_write_pos;
+	uint32_t stop;
+	void *thread;
+} render_capture_t;
+
+static render_capture_t capture;
+
+static void render_capture_write(uint32_t index, rgba_t *pixels) {
+	int32_t w = capture.size.x;
+	int32_t h = capture.size.y;
+
+	// Unlike GL, rows are already top to bottom
+	if (!capture.is_y4m) {
+		char path[280];
+		snprintf(path, sizeof(path), "%s_%05d.png", capture.path, index);
+		stbi_write_png(path, w, h, 4, pixels, 0);
+		return;
+	}
+
+	// BT.601, 4:4:4
+	uint8_t *py = capture.yuv;
+	uint8_t *pu = py + w * h;
+	uint8_t *pv = pu + w * h;
+	for (int32_t i = 0; i < w * h; i++) {
+		int32_t r = pixels[i].as_rgba.r;
+		int32_t g = pixels[i].as_rgba.g;
+		int32_t b = pixels[i].as_rgba.b;
+		*py++ = (( 66 * r + 129 * g +  25 * b + 128) >> 8) + 16;
+		*pu++ = ((-38 * r -  74 * g + 112 * b + 128) >> 8) + 128;
+		*pv++ = ((112 * r -  94 * g -  18 * b + 128) >> 8) + 128;
+	}
+	fputs("FRAME\n", capture.file);
+	fwrite(capture.yuv, 1, w * h * 3, capture.file);
+}
+
+static void render_capture_write_queued(void) {
+	uint32_t write_pos = atomic_load_acquire(&capture.queue_write_pos);
+	while (capture.queue_read_pos != write_pos) {
+		uint32_t i = capture.queue_read_pos % RENDER_CAPTURE_QUEUE_LEN;
+		render_capture_write(capture.queue[i].index, capture.queue[i].pixels);
+		atomic_store_release(&capture.queue_read_pos, capture.queue_read_pos + 1);
+	}
+}
+
+static void render_capture_thread(void *user) {
+	while (true) {
+		// Check the stop flag first, so that everything queued before it was
+		// set is still written
+		uint32_t stop = atomic_load_acquire(&capture.stop);
+		render_capture_write_queued();
+		if (stop) {
+			break;
+		}
+		platform_sleep(0.002);
+	}
+}
+
+// Called with the fence of the frame that owns the buffer waited on
+static void render_capture_readback(uint32_t slot) {
+	if (!capture.buffer_is_pending[slot]) {
+		return;
+	}
+	capture.buffer_is_pending[slot] = false;
+
+	uint32_t write_pos = capture.queue_write_pos;
+	if (write_pos - atomic_load_acquire(&capture.queue_read_pos) >= RENDER_CAPTURE_QUEUE_LEN) {
+		capture.frames_dropped++;
+	}
+	else {
+		uint32_t i = write_pos % RENDER_CAPTURE_QUEUE_LEN;
+		memcpy(capture.queue[i].pixels, capture.buffers[slot].mapped, capture.size.x * capture.size.y * sizeof(rgba_t));
+		capture.queue[i].index = capture.frames_captured;
+		atomic_store_release(&capture.queue_write_pos, write_pos + 1);
+	}
+	capture.frames_captured++;
+
+	// Without a thread we have to write it ourselves
+	if (!capture.thread) {
+		render_capture_write_queued();
+	}
+}
+
+void render_capture_start(const char *path) {
+	error_if(capture.enabled, "Capture already running");
+
+	capture = (render_capture_t){0};
+	capture.size = backbuffer_size;
+	snprintf(capture.path, sizeof(capture.path), "%s", path);
+	capture.is_y4m = str_ends_with(path, ".y4m");
+
+	if (capture.is_y4m) {
+		capture.file = fopen(path, "wb");
+		if (!capture.file) {
+			printf("capture: failed to open %s\n", path);
+			return;
+		}
+		fprintf(capture.file, "YUV4MPEG2 W%d H%d F60:1 Ip A1:1 C444\n", capture.size.x, capture.size.y);
+		capture.yuv = malloc(capture.size.x * capture.size.y * 3);
+	}
+
+	uint32_t bytes = capture.size.x * capture.size.y * sizeof(rgba_t);
+	for (int i = 0; i < RENDER_FRAMES_IN_FLIGHT; i++) {
+		capture.buffers[i] = render_buffer_create(bytes, VK_BUFFER_USAGE_TRANSFER_DST_BIT);
+	}
+	for (int i = 0; i < RENDER_CAPTURE_QUEUE_LEN; i++) {
+		capture.queue[i].pixels = malloc(bytes);
+	}
+
+	capture.thread = platform_thread_create(render_capture_thread, NULL);
+	capture.enabled = true;
+	printf("capture: %dx%d to %s\n", capture.size.x, capture.size.y, path);
+}
+
+void render_capture_stop(void) {
+	if (!capture.enabled) {
+		return;
+	}
+	capture.enabled = false;
+
+	// Read back whatever is still in flight, oldest first
+	vkDeviceWaitIdle(device);
+	for (uint32_t i = 0; i < RENDER_FRAMES_IN_FLIGHT; i++) {
+		render_capture_readback((frame_index + i) % RENDER_FRAMES_IN_FLIGHT);
+	}
+
+	if (capture.thread) {
+		atomic_store_release(&capture.stop, 1);
+		platform_thread_join(capture.thread);
+	}
+
+	for (int i = 0; i < RENDER_FRAMES_IN_FLIGHT; i++) {
+		render_buffer_destroy(&capture.buffers[i]);
+	}
+	for (int i = 0; i < RENDER_CAPTURE_QUEUE_LEN; i++) {
+		free(capture.queue[i].pixels);
+	}
+	if (capture.file) {
+		fclose(capture.file);
+		free(capture.yuv);
+	}
+	printf("capture: %d frames, %d dropped\n", capture.frames_captured - capture.frames_dropped, capture.frames_dropped);
+}
+
+// Recorded between the scene and the post pass, while the backbuffer holds
+// the scene
+static void render_capture_frame(VkCommandBuffer cb) {
+	if (!capture.enabled) {
+		return;
+	}
+	if (backbuffer_size.x != capture.size.x || backbuffer_size.y != capture.size.y) {
+		printf("capture: resolution changed\n");
+		render_capture_stop();
+		return;
+	}
+
+	// The scene pass' external dependency already made the color writes
+	// available and ends in the fragment shader stage; chain onto that, so we
+	// are also ordered after its transition to the final layout.
+	uint32_t slot = frame_index % RENDER_FRAMES_IN_FLIGHT;
+	render_image_barrier(
+		cb, backbuffer.image, 0, 1,
+		VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+		0, VK_ACCESS_TRANSFER_READ_BIT,
+		VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT
+	);
+	vkCmdCopyImageToBuffer(
+		cb, backbuffer.image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, capture.buffers[slot].buffer,
+		1, &(VkBufferImageCopy){
+			.imageSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1},
+			.imageExtent = {capture.size.x, capture.size.y, 1}
+		}
+	);
+	render_image_barrier(
+		cb, backbuffer.image, 0, 1,
+		VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+		0, VK_ACCESS_SHADER_READ_BIT,
+		VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT
+	);
+	render_host_read_barrier(cb);
+	capture.buffer_is_pending[slot] = true;
+}
@@ -0,0 +1,20 @@
+#version 450
+
+// Vulkan port of SHADER_GAME_FS in render_gl.c
+
+layout(location = 0) in vec4 v_color;
+layout(location = 1) in vec2 v_uv;
+
+layout(location = 0) out vec4 out_color;
+
+layout(set = 0, binding = 1) uniform sampler2D atlas;
+
+void main() {
+	vec4 tex_color = texture(atlas, v_uv);
+	vec4 color = tex_color * v_color;
+	if (color.a == 0.0) {
+		discard;
+	}
+	color.rgb = color.rgb * 2.0;
+	out_color = color;
+}
@@ -0,0 +1,33 @@
+#version 450
+
+// Vulkan port of SHADER_GAME_VS in render_gl.c
+
+layout(location = 0) in vec3 pos;
+layout(location = 1) in vec2 uv;
+layout(location = 2) in vec4 color;
+
+layout(location = 0) out vec4 v_color;
+layout(location = 1) out vec2 v_uv;
+
+layout(set = 0, binding = 0) uniform view_t {
+	mat4 view;
+	mat4 projection;
+	vec4 camera_pos;
+	vec2 fade;
+} u;
+
+layout(push_constant) uniform draw_t {
+	mat4 model;
+	vec2 screen;
+} draw;
+
+void main() {
+	gl_Position = u.projection * u.view * draw.model * vec4(pos, 1.0);
+	gl_Position.xy += draw.screen.xy * gl_Position.w;
+	v_color = color;
+	v_color.a *= smoothstep(
+		u.fade.y, u.fade.x, // fadeout far, near
+		length(vec4(u.camera_pos.xyz, 1.0) - draw.model * vec4(pos, 1.0))
+	);
+	v_uv = uv / 2048.0; // ATLAS_GRID * ATLAS_SIZE
+}
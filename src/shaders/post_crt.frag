@@ -0,0 +1,63 @@
+#version 450
+
+// Vulkan port of SHADER_POST_FS_CRT in render_gl.c
+// CRT effect based on https://www.shadertoy.com/view/Ms23DR 
+// by https://github.com/mattiasgustavsson/
+
+layout(location = 0) in vec2 v_uv;
+
+layout(location = 0) out vec4 out_color;
+
+layout(set = 0, binding = 0) uniform sampler2D backbuffer;
+
+layout(push_constant) uniform post_t {
+	vec2 screen_size;
+	float time;
+} post;
+
+vec2 curve(vec2 uv) {
+	uv = (uv - 0.5) * 2.0;
+	uv *= 1.1;	
+	uv.x *= 1.0 + pow((abs(uv.y) / 5.0), 2.0);
+	uv.y *= 1.0 + pow((abs(uv.x) / 4.0), 2.0);
+	uv  = (uv / 2.0) + 0.5;
+	uv =  uv *0.92 + 0.04;
+	return uv;
+}
+
+void main(){
+	float time = post.time;
+	vec2 screen_size = post.screen_size;
+	vec2 uv = curve(gl_FragCoord.xy / screen_size);
+	vec3 color;
+	float x =  sin(0.3*time+uv.y*21.0)*sin(0.7*time+uv.y*29.0)*sin(0.3+0.33*time+uv.y*31.0)*0.0017;
+
+	color.r = texture(backbuffer, vec2(x+uv.x+0.001,uv.y+0.001)).x+0.05;
+	color.g = texture(backbuffer, vec2(x+uv.x+0.000,uv.y-0.002)).y+0.05;
+	color.b = texture(backbuffer, vec2(x+uv.x-0.002,uv.y+0.000)).z+0.05;
+	color.r += 0.08*texture(backbuffer, 0.75*vec2(x+0.025, -0.027)+vec2(uv.x+0.001,uv.y+0.001)).x;
+	color.g += 0.05*texture(backbuffer, 0.75*vec2(x+-0.022, -0.02)+vec2(uv.x+0.000,uv.y-0.002)).y;
+	color.b += 0.08*texture(backbuffer, 0.75*vec2(x+-0.02, -0.018)+vec2(uv.x-0.002,uv.y+0.000)).z;
+
+	color = clamp(color*0.6+0.4*color*color*1.0,0.0,1.0);
+
+	float vignette = (0.0 + 1.0*16.0*uv.x*uv.y*(1.0-uv.x)*(1.0-uv.y));
+	color *= vec3(pow(vignette, 0.25));
+
+	color *= vec3(0.95,1.05,0.95);
+	color *= 2.8;
+
+	float scanlines = clamp( 0.35+0.35*sin(3.5*time+uv.y*screen_size.y*1.5), 0.0, 1.0);
+	
+	float s = pow(scanlines,1.7);
+	color = color * vec3(0.4+0.7*s);
+
+	color *= 1.0+0.01*sin(110.0*time);
+	if (uv.x < 0.0 || uv.x > 1.0)
+		color *= 0.0;
+	if (uv.y < 0.0 || uv.y > 1.0)
+		color *= 0.0;
+	
+	color*=1.0-0.65*vec3(clamp((mod(gl_FragCoord.x, 2.0)-1.0)*2.0,0.0,1.0));
+	out_color = vec4(color,1.0);
+}
@@ -0,0 +1,11 @@
+#version 450
+
+layout(location = 0) in vec2 v_uv;
+
+layout(location = 0) out vec4 out_color;
+
+layout(set = 0, binding = 0) uniform sampler2D backbuffer;
+
+void main() {
+	out_color = texture(backbuffer, v_uv);
+}
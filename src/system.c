@@ -12,6 +12,7 @@ static double time_scaled;
 static double time_scale = 1.0;
 static double tick_last;
 static double cycle_time = 0;
+static double frame_time;
 
 void system_init() {
 	time_real = platform_now();
@@ -21,6 +22,7 @@ void system_init() {
 }
 
 void system_cleanup() {
+	mem_telemetry_report("exit");
 	render_cleanup();
 	input_cleanup();
 }
@@ -48,7 +50,9 @@ void system_update() {
 	game_update();
 
 	render_frame_end();
+	frame_time = platform_now() - time_real_now;
 	input_clear();
+	mem_frame_reset();
 	mem_temp_check();
 }
 
@@ -76,6 +80,10 @@ double system_time() {
 	return time_scaled;
 }
 
+double system_frame_time() {
+	return frame_time;
+}
+
 double system_cycle_time() {
 	return cycle_time;
 }
@@ -15,6 +15,7 @@ void system_resize(vec2i_t size);
 
 double system_time(void);
 double system_tick(void);
+double system_frame_time(void); // Real time of the last frame's update and rendering
 double system_cycle_time(void);
 void system_reset_cycle_time(void);
 double system_time_scale_get(void);
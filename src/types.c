@@ -119,3 +119,54 @@ void mat4_mul(mat4_t *res, mat4_t *a, mat4_t *b) {
 	res->m[14] = b->m[12] * a->m[2] + b->m[13] * a->m[6] + b->m[14] * a->m[10] + b->m[15] * a->m[14];
 	res->m[15] = b->m[12] * a->m[3] + b->m[13] * a->m[7] + b->m[14] * a->m[11] + b->m[15] * a->m[15];
 }
+
+// Gribb/Hartmann plane extraction from a combined view projection matrix. 
+// Plane normals point inwards; planes are normalized so that distances are
+// in world units.
+
+void frustum_from_mat(frustum_t *frustum, mat4_t *m) {
+	float rows[6][4] = {
+		{m->m[3] + m->m[0], m->m[7] + m->m[4], m->m[11] + m->m[ 8], m->m[15] + m->m[12]}, // left
+		{m->m[3] - m->m[0], m->m[7] - m->m[4], m->m[11] - m->m[ 8], m->m[15] - m->m[12]}, // right
+		{m->m[3] + m->m[1], m->m[7] + m->m[5], m->m[11] + m->m[ 9], m->m[15] + m->m[13]}, // bottom
+		{m->m[3] - m->m[1], m->m[7] - m->m[5], m->m[11] - m->m[ 9], m->m[15] - m->m[13]}, // top
+		{m->m[3] + m->m[2], m->m[7] + m->m[6], m->m[11] + m->m[10], m->m[15] + m->m[14]}, // near
+		{m->m[3] - m->m[2], m->m[7] - m->m[6], m->m[11] - m->m[10], m->m[15] - m->m[14]}, // far
+	};
+
+	for (int i = 0; i < 6; i++) {
+		float length = sqrt(rows[i][0] * rows[i][0] + rows[i][1] * rows[i][1] + rows[i][2] * rows[i][2]);
+		if (length == 0) {
+			length = 1;
+		}
+		frustum->planes[i].normal = vec3(rows[i][0] / length, rows[i][1] / length, rows[i][2] / length);
+		frustum->planes[i].distance = rows[i][3] / length;
+	}
+}
+
+bool frustum_test_sphere(frustum_t *frustum, vec3_t center, float radius) {
+	for (int i = 0; i < 6; i++) {
+		plane_t *p = &frustum->planes[i];
+		if (vec3_dot(p->normal, center) + p->distance < -radius) {
+			return false;
+		}
+	}
+	return true;
+}
+
+bool frustum_test_aabb(frustum_t *frustum, vec3_t min, vec3_t max) {
+	for (int i = 0; i < 6; i++) {
+		plane_t *p = &frustum->planes[i];
+
+		// Test the box corner that is furthest along the plane normal
+		vec3_t v = vec3(
+			p->normal.x >= 0 ? max.x : min.x,
+			p->normal.y >= 0 ? max.y : min.y,
+			p->normal.z >= 0 ? max.z : min.z
+		);
+		if (vec3_dot(p->normal, v) + p->distance < 0) {
+			return false;
+		}
+	}
+	return true;
+}
@@ -40,12 +40,22 @@ typedef struct {
 	vec3_t pos;
 	vec2_t uv;
 	rgba_t color;
+	uint16_t color_slot; // Render palette slot that replaces color; 0 for none
 } vertex_t;
 
 typedef struct {
 	vertex_t vertices[3];
 } tris_t;
 
+typedef struct {
+	vec3_t normal;
+	float distance;
+} plane_t;
+
+typedef struct {
+	plane_t planes[6];
+} frustum_t;
+
 #define vec2(X, Y) ((vec2_t){X, Y})
 #define vec3(X, Y, Z) ((vec3_t){X, Y, Z})
 #define vec2i(X, Y) ((vec2i_t){X, Y})
@@ -236,4 +246,8 @@ void mat4_set_roll_pitch_yaw(mat4_t *mat, vec3_t rot);
 void mat4_translate(mat4_t *mat, vec3_t translation);
 void mat4_mul(mat4_t *res, mat4_t *a, mat4_t *b);
 
+void frustum_from_mat(frustum_t *frustum, mat4_t *view_projection);
+bool frustum_test_sphere(frustum_t *frustum, vec3_t center, float radius);
+bool frustum_test_aabb(frustum_t *frustum, vec3_t min, vec3_t max);
+
 #endif
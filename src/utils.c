@@ -5,6 +5,13 @@
 #include "utils.h"
 #include "mem.h"
 
+#if (defined(__unix__) || defined(__APPLE__)) && !defined(__EMSCRIPTEN__) && !defined(__plan9__)
+	#include <sys/mman.h>
+	#include <fcntl.h>
+	#include <unistd.h>
+	#define FILE_MAP_MMAP
+#endif
+
 char temp_path[64];
 char *get_path(const char *dir, const char *file) {
 	strcpy(temp_path, dir);
@@ -43,6 +50,63 @@ uint8_t *file_load(char *path, uint32_t *bytes_read) {
 	return bytes;
 }
 
+int32_t file_size(char *path) {
+	struct stat s;
+	return stat(path, &s) == 0 ? s.st_size : -1;
+}
+
+int64_t file_mtime(char *path) {
+	struct stat s;
+	return stat(path, &s) == 0 ? (int64_t)s.st_mtime : -1;
+}
+
+// Maps a file copy-on-write; writes to the mapping never end up in the file.
+// Without mmap, the file is read into malloc'd memory instead.
+uint8_t *file_map(char *path, uint32_t *size) {
+	#if defined(FILE_MAP_MMAP)
+		int fd = open(path, O_RDONLY);
+		if (fd < 0) {
+			return NULL;
+		}
+		struct stat s;
+		if (fstat(fd, &s) != 0 || s.st_size <= 0) {
+			close(fd);
+			return NULL;
+		}
+		uint8_t *bytes = mmap(NULL, s.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+		close(fd);
+		if (bytes == MAP_FAILED) {
+			return NULL;
+		}
+		*size = s.st_size;
+		return bytes;
+	#else
+		FILE *f = fopen(path, "rb");
+		if (!f) {
+			return NULL;
+		}
+		fseek(f, 0, SEEK_END);
+		int32_t len = ftell(f);
+		fseek(f, 0, SEEK_SET);
+		uint8_t *bytes = len > 0 ? malloc(len) : NULL;
+		if (bytes && fread(bytes, 1, len, f) != len) {
+			free(bytes);
+			bytes = NULL;
+		}
+		fclose(f);
+		*size = len;
+		return bytes;
+	#endif
+}
+
+void file_unmap(uint8_t *bytes, uint32_t size) {
+	#if defined(FILE_MAP_MMAP)
+		munmap(bytes, size);
+	#else
+		free(bytes);
+	#endif
+}
+
 uint32_t file_store(char *path, void *bytes, int32_t len) {
 	FILE *f = fopen(path, "wb");
 	error_if(!f, "Could not open file for writing: %s", path);
@@ -55,10 +119,25 @@ uint32_t file_store(char *path, void *bytes, int32_t len) {
 	return len;
 }
 
+// 64 bit FNV-1a. Start with HASH_INIT, or pass a previous hash to continue it
+uint64_t hash_bytes(uint64_t hash, const void *bytes, uint32_t len) {
+	const uint8_t *p = bytes;
+	for (uint32_t i = 0; i < len; i++) {
+		hash = (hash ^ p[i]) * 0x100000001b3ULL;
+	}
+	return hash;
+}
+
 bool str_starts_with(const char *haystack, const char *needle) {
 	return (strncmp(haystack, needle, strlen(needle)) == 0);
 }
 
+bool str_ends_with(const char *haystack, const char *needle) {
+	size_t haystack_len = strlen(haystack);
+	size_t needle_len = strlen(needle);
+	return haystack_len >= needle_len && strcmp(haystack + haystack_len - needle_len, needle) == 0;
+}
+
 float rand_float(float min, float max) {
 	return min + ((float)rand() / (float)RAND_MAX) * (max - min);
 }
@@ -96,17 +96,34 @@ minfloat(float a, float b)
 
 char *get_path(const char *dir, const char *file);
 bool str_starts_with(const char *haystack, const char *needle);
+bool str_ends_with(const char *haystack, const char *needle);
 float rand_float(float min, float max);
 int32_t rand_int(int32_t min, int32_t max); 
 
 bool file_exists(char *path);
 uint8_t *file_load(char *path, uint32_t *bytes_read);
 uint32_t file_store(char *path, void *bytes, int32_t len);
+int32_t file_size(char *path);
+int64_t file_mtime(char *path); // Seconds; -1 if the file doesn't exist
+uint8_t *file_map(char *path, uint32_t *size);
+void file_unmap(uint8_t *bytes, uint32_t size);
+
+#define HASH_INIT 0xcbf29ce484222325ULL
+uint64_t hash_bytes(uint64_t hash, const void *bytes, uint32_t len);
 
 #ifdef __plan9__
 
+// The Plan 9 compilers lack the atomic builtins; all of its targets we run on
+// keep stores in order anyway.
+#define atomic_load_acquire(P) (*(volatile uint32_t *)(P))
+#define atomic_store_release(P, V) (*(volatile uint32_t *)(P) = (V))
+
 #else
 
+// For indices shared between exactly one producer and one consumer thread
+#define atomic_load_acquire(P) __atomic_load_n(P, __ATOMIC_ACQUIRE)
+#define atomic_store_release(P, V) __atomic_store_n(P, V, __ATOMIC_RELEASE)
+
 #define sort(LIST, LEN, COMPARE_FUNC) \
 	for (uint32_t sort_i = 1, sort_j; sort_i < (LEN); sort_i++) { \
 		sort_j = sort_i; \
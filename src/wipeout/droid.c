@@ -16,10 +16,39 @@
 #include "game.h"
 
 static Object *droid_model;
+static uint16_t droid_color_slots;
 
 void droid_load() {
 	texture_list_t droid_textures = image_get_compressed_textures("wipeout/common/rescu.cmp");
 	droid_model = objects_load("wipeout/common/rescu.prm", droid_textures);
+
+	// The lights on the first 11 primitives cycle through three colors, 
+	// set in droid_draw(); the 4th vertex of quads stays grey
+	droid_color_slots = render_palette_alloc(3);
+	Prm prm = {.primitive = droid_model->primitives};
+	for (int i = 0; i < 11; i++) {
+		uint16_t slot = droid_color_slots + (i < 2 ? 0 : (i < 6 ? 1 : 2));
+
+		switch (prm.f3->type) {
+			case PRM_TYPE_GT3:
+				for (int v = 0; v < 3; v++) {
+					object_set_color_slot(droid_model, i, v, slot);
+				}
+				prm.gt3++;
+				break;
+
+			case PRM_TYPE_GT4:
+				for (int v = 0; v < 3; v++) {
+					object_set_color_slot(droid_model, i, v, slot);
+				}
+				prm.gt4->colour[3].as_rgba.r = 40;
+				prm.gt4->colour[3].as_rgba.g = 40;
+				prm.gt4->colour[3].as_rgba.b = 40;
+				prm.gt4++;
+				break;
+		}
+	}
+	object_bake(droid_model);
 }
 
 void droid_init(droid_t *droid, ship_t *ship) {
@@ -47,70 +76,21 @@ void droid_init(droid_t *droid, ship_t *ship) {
 void droid_draw(droid_t *droid) {
 	droid->cycle_timer += system_tick() * M_PI * 2;
 
-	Prm prm = {.primitive = droid_model->primitives};
 	int rf = sin(droid->cycle_timer) * 127 + 128;
 	int gf = sin(droid->cycle_timer + 0.2) * 127 + 128;
 	int bf = sin(droid->cycle_timer * 0.5 + 0.1) * 127 + 128;
 
-	int r, g, b;
-
-	for (int i = 0; i < 11; i++) {
-		if (i < 2) {
-			r = 40;
-			g = gf;
-			b = 40;
-		}
-		else if (i < 6) {
-			r = bf >> 1;
-			b = bf;
-			g = bf >> 1;
-		}
-		else {
-			r = rf;
-			b = 40;
-			g = 40;
-		}
-
-		switch (prm.f3->type) {
-			case PRM_TYPE_GT3:
-				prm.gt3->colour[0].as_rgba.r = r;
-				prm.gt3->colour[0].as_rgba.g = g;
-				prm.gt3->colour[0].as_rgba.b = b;
-
-				prm.gt3->colour[1].as_rgba.r = r;
-				prm.gt3->colour[1].as_rgba.g = g;
-				prm.gt3->colour[1].as_rgba.b = b;
-
-				prm.gt3->colour[2].as_rgba.r = r;
-				prm.gt3->colour[2].as_rgba.g = g;
-				prm.gt3->colour[2].as_rgba.b = b;
-				prm.gt3++;
-				break;
-
-			case PRM_TYPE_GT4:
-				prm.gt4->colour[0].as_rgba.r = r;
-				prm.gt4->colour[0].as_rgba.g = g;
-				prm.gt4->colour[0].as_rgba.b = b;
-
-				prm.gt4->colour[1].as_rgba.r = r;
-				prm.gt4->colour[1].as_rgba.g = g;
-				prm.gt4->colour[1].as_rgba.b = b;
-
-				prm.gt4->colour[2].as_rgba.r = r;
-				prm.gt4->colour[2].as_rgba.g = g;
-				prm.gt4->colour[2].as_rgba.b = b;
-
-				prm.gt4->colour[3].as_rgba.r = 40;
-				prm.gt4->colour[3].as_rgba.g = 40;
-				prm.gt4->colour[3].as_rgba.b = 40;
-				prm.gt4++;
-				break;
-		}
-	}
+	render_set_palette_color(droid_color_slots + 0, rgba(40, gf, 40, 255));
+	render_set_palette_color(droid_color_slots + 1, rgba(bf >> 1, bf >> 1, bf, 255));
+	render_set_palette_color(droid_color_slots + 2, rgba(rf, 40, 40, 255));
 
 	mat4_set_translation(&droid->mat, droid->position);
 	mat4_set_yaw_pitch_roll(&droid->mat, droid->angle);
-	object_draw(droid_model, &droid->mat);
+
+	frustum_t frustum = render_frustum();
+	if (object_is_visible(droid_model, &droid->mat, &frustum)) {
+		object_draw(droid_model, &droid->mat);
+	}
 }
 
 void droid_update(droid_t *droid, ship_t *ship) {
@@ -20,6 +20,7 @@
 #include "main_menu.h"
 #include "title.h"
 #include "intro.h"
+#include "pack.h"
 
 #define TURN_ACCEL(V) NTSC_ACCELERATION(ANGLE_NORM_TO_RADIAN(FIXED_TO_FLOAT(YAW_VELOCITY(V))))
 #define TURN_VEL(V)   NTSC_VELOCITY(ANGLE_NORM_TO_RADIAN(FIXED_TO_FLOAT(YAW_VELOCITY(V))))
@@ -487,21 +488,27 @@ game_t g = {0};
 
 
 struct {
+	const char *name;
 	void (*init)(void);
 	void (*update)(void);
 } game_scenes[] = {
-	[GAME_SCENE_INTRO] = {intro_init, intro_update},
-	[GAME_SCENE_TITLE] = {title_init, title_update},
-	[GAME_SCENE_MAIN_MENU] = {main_menu_init, main_menu_update},
-	[GAME_SCENE_RACE] = {race_init, race_update},
+	[GAME_SCENE_INTRO] = {"intro", intro_init, intro_update},
+	[GAME_SCENE_TITLE] = {"title", title_init, title_update},
+	[GAME_SCENE_MAIN_MENU] = {"main menu", main_menu_init, main_menu_update},
+	[GAME_SCENE_RACE] = {"race", race_init, race_update},
 };
 
 static game_scene_t scene_current = GAME_SCENE_NONE;
 static game_scene_t scene_next = GAME_SCENE_NONE;
 static int global_textures_len = 0;
+static int global_meshes_len = 0;
+static int global_palette_len = 0;
+static int global_packs_len = 0;
 static void *global_mem_mark = 0;
 
 void game_init() {
+	g.draw_distance = 1;
+
 	if (file_exists("save.dat")) {
 		uint32_t size;
 		save_t *save_file = (save_t *)file_load("save.dat", &size);
@@ -527,6 +534,11 @@ void game_init() {
 	weapons_load();
 
 	global_textures_len = render_textures_len();
+	global_meshes_len = render_meshes_len();
+	global_palette_len = render_palette_len();
+	global_packs_len = pack_mapped_len();
+	// Everything above stays loaded; scenes allocate from their own arena
+	mem_set_bump_arena(MEM_ARENA_SCENE);
 	global_mem_mark = mem_mark();
 
 	sfx_music_mode(SFX_MUSIC_PAUSED);
@@ -580,6 +592,32 @@ void game_init() {
 	game_set_scene(GAME_SCENE_INTRO);
 }
 
+static void game_update_draw_distance() {
+	// The frame time is taken from the last whole frame, including the time
+	// the renderer took to submit it. It's smoothed over many frames and
+	// clamped, so a single slow frame (e.g. loading a scene) barely counts.
+	static float frame_time = 0;
+	double last_frame_time = minfloat(system_frame_time(), 0.1);
+	if (last_frame_time <= 0) {
+		return;
+	}
+	frame_time = frame_time > 0
+		? frame_time * 0.95 + last_frame_time * 0.05
+		: last_frame_time;
+
+	if (frame_time > DRAW_DISTANCE_FRAME_BUDGET) {
+		g.draw_distance -= DRAW_DISTANCE_SHRINK_SPEED * system_tick();
+	}
+	else if (frame_time < DRAW_DISTANCE_FRAME_BUDGET * DRAW_DISTANCE_HEADROOM) {
+		g.draw_distance += DRAW_DISTANCE_GROW_SPEED * system_tick();
+	}
+	g.draw_distance = maxfloat(DRAW_DISTANCE_MIN, minfloat(g.draw_distance, 1));
+
+	// Cull radius and fade shrink together, so scenery fades out instead of
+	// popping
+	render_set_fadeout(RENDER_FADEOUT_NEAR * g.draw_distance, RENDER_FADEOUT_FAR * g.draw_distance);
+}
+
 void game_set_scene(game_scene_t scene) {
 	sfx_reset();
 	scene_next = scene;
@@ -605,10 +643,14 @@ void game_update() {
 
 
 	if (scene_next != GAME_SCENE_NONE) {
+		mem_telemetry_report(scene_current != GAME_SCENE_NONE ? game_scenes[scene_current].name : "global assets");
 		scene_current = scene_next;
 		scene_next = GAME_SCENE_NONE;
-		render_textures_reset(global_textures_len);
+		image_textures_reset(global_textures_len);
+		render_meshes_reset(global_meshes_len);
+		render_palette_reset(global_palette_len);
 		mem_reset(global_mem_mark);
+		pack_unmap_to(global_packs_len);
 		system_reset_cycle_time();
 
 		if (scene_current != GAME_SCENE_NONE) {
@@ -633,5 +675,6 @@ void game_update() {
 	if (g.frame_time > 0) {
 		g.frame_rate = ((double)g.frame_rate * 0.95) + (1.0/g.frame_time) * 0.05;
 	}
+	game_update_draw_distance();
 }
 
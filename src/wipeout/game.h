@@ -19,6 +19,14 @@
 #define QUALIFYING_RANK 3
 #define SAVE_DATA_MAGIC 0x64736f77
 
+// The draw distance is scaled down when a frame takes longer than the budget
+// and grown back (slower) when there's enough headroom
+#define DRAW_DISTANCE_FRAME_BUDGET (1.0/60.0)
+#define DRAW_DISTANCE_HEADROOM 0.75
+#define DRAW_DISTANCE_MIN 0.4
+#define DRAW_DISTANCE_SHRINK_SPEED 0.5
+#define DRAW_DISTANCE_GROW_SPEED 0.1
+
 typedef enum {
 	A_UP,
 	A_DOWN,
@@ -193,6 +201,7 @@ typedef struct {
 typedef struct {
 	float frame_time;
 	float frame_rate;
+	float draw_distance; // Scale for the fade out distances, adjusted to the frame budget
 	
 	int race_class;
 	int race_type;
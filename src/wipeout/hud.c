@@ -2,6 +2,7 @@
 #include "../mem.h"
 #include "../utils.h"
 #include "../system.h"
+#include "../occlusion.h"
 
 #include "object.h"
 #include "track.h"
@@ -13,6 +14,7 @@
 #include "image.h"
 #include "ship_ai.h"
 #include "game.h"
+#include "scene.h"
 #include "ui.h"
 
 static texture_list_t weapon_icon_textures;
@@ -236,6 +238,19 @@ void hud_draw(ship_t *ship) {
 	if (save.show_fps) {
 		ui_draw_text("FPS", ui_scaled(vec2i(16, 78)), UI_SIZE_8, UI_COLOR_ACCENT);
 		ui_draw_number((int)(g.frame_rate), ui_scaled(vec2i(16, 90)), UI_SIZE_8, UI_COLOR_DEFAULT);
+
+		ui_draw_text("SECTIONS CULLED", ui_scaled(vec2i(16, 106)), UI_SIZE_8, UI_COLOR_ACCENT);
+		ui_draw_number(g.track.draw_stats.sections_culled, ui_scaled(vec2i(16, 118)), UI_SIZE_8, UI_COLOR_DEFAULT);
+		ui_draw_text("TRIS CULLED", ui_scaled(vec2i(16, 134)), UI_SIZE_8, UI_COLOR_ACCENT);
+		ui_draw_number(g.track.draw_stats.tris_culled, ui_scaled(vec2i(16, 146)), UI_SIZE_8, UI_COLOR_DEFAULT);
+		ui_draw_text("OBJECTS CULLED", ui_scaled(vec2i(16, 162)), UI_SIZE_8, UI_COLOR_ACCENT);
+		ui_draw_number(scene_get_draw_stats().objects_culled, ui_scaled(vec2i(16, 174)), UI_SIZE_8, UI_COLOR_DEFAULT);
+		ui_draw_text("OCCLUDED", ui_scaled(vec2i(16, 190)), UI_SIZE_8, UI_COLOR_ACCENT);
+		ui_draw_number(occlusion_stats().rejected, ui_scaled(vec2i(16, 202)), UI_SIZE_8, UI_COLOR_DEFAULT);
+		ui_draw_text("LOD TRIS SAVED", ui_scaled(vec2i(16, 218)), UI_SIZE_8, UI_COLOR_ACCENT);
+		ui_draw_number(scene_get_draw_stats().lod_tris_saved, ui_scaled(vec2i(16, 230)), UI_SIZE_8, UI_COLOR_DEFAULT);
+		ui_draw_text("DRAW DISTANCE", ui_scaled(vec2i(16, 246)), UI_SIZE_8, UI_COLOR_ACCENT);
+		ui_draw_number((int)render_fadeout().y, ui_scaled(vec2i(16, 258)), UI_SIZE_8, UI_COLOR_DEFAULT);
 	}
 
 	// Lap Record
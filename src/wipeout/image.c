@@ -13,8 +13,14 @@
 #include "game.h"
 #include "hud.h"
 #include "image.h"
+#include "pack.h"
+#include "../jobs.h"
 
 
+#if defined(__SSE2__)
+	#include <emmintrin.h>
+#endif
+
 #define STB_IMAGE_WRITE_IMPLEMENTATION
 #include "../libs/stb_image_write.h"
 
@@ -43,33 +49,44 @@ image_t *image_alloc(uint32_t width, uint32_t height) {
 	return image;
 }
 
-image_t *image_load_from_bytes(uint8_t *bytes, bool transparent) {
+typedef struct {
+	uint32_t type;
+	uint16_t *palette;
+	uint32_t palette_len;
+	int32_t width;
+	int32_t height;
+	int32_t entries;
+	uint32_t data; // Offset of the pixel data
+} tim_header_t;
+
+static tim_header_t tim_read_header(uint8_t *bytes) {
+	tim_header_t tim = {0};
 	uint32_t p = 0;
 
 	uint32_t magic = get_i32_le(bytes, &p);
-	uint32_t type = get_i32_le(bytes, &p);
-	uint16_t *palette = NULL;
+	tim.type = get_i32_le(bytes, &p);
 
 	if (
-		type == TIM_TYPE_PALETTED_4_BPP ||
-		type == TIM_TYPE_PALETTED_8_BPP
+		tim.type == TIM_TYPE_PALETTED_4_BPP ||
+		tim.type == TIM_TYPE_PALETTED_8_BPP
 	) {
 		uint32_t header_length = get_i32_le(bytes, &p);
 		uint16_t palette_x = get_i16_le(bytes, &p);
 		uint16_t palette_y = get_i16_le(bytes, &p);
 		uint16_t palette_colors = get_i16_le(bytes, &p);
 		uint16_t palettes = get_i16_le(bytes, &p);
-		palette = (uint16_t *)(bytes + p);
+		tim.palette = (uint16_t *)(bytes + p);
+		tim.palette_len = palette_colors;
 		p += palette_colors * 2;
 	}
 
 	uint32_t data_size = get_i32_le(bytes, &p);
 
 	int32_t pixels_per_16bit = 1;
-	if (type == TIM_TYPE_PALETTED_8_BPP) {
+	if (tim.type == TIM_TYPE_PALETTED_8_BPP) {
 		pixels_per_16bit = 2;
 	}
-	else if (type == TIM_TYPE_PALETTED_4_BPP) {
+	else if (tim.type == TIM_TYPE_PALETTED_4_BPP) {
 		pixels_per_16bit = 4;
 	}
 
@@ -78,35 +95,117 @@ image_t *image_load_from_bytes(uint8_t *bytes, bool transparent) {
 	uint16_t entries_per_row  = get_i16_le(bytes, &p);
 	uint16_t rows = get_i16_le(bytes, &p);
 
-	int32_t width = entries_per_row * pixels_per_16bit;
-	int32_t height = rows;
-	int32_t entries = entries_per_row * rows;
+	tim.width = entries_per_row * pixels_per_16bit;
+	tim.height = rows;
+	tim.entries = entries_per_row * rows;
+	tim.data = p;
+	return tim;
+}
 
-	image_t *image = image_alloc(width, height);
+void image_size_from_bytes(uint8_t *bytes, uint32_t *width, uint32_t *height) {
+	tim_header_t tim = tim_read_header(bytes);
+	*width = tim.width;
+	*height = tim.height;
+}
+
+// The original per pixel decoder. Kept as the reference for the benchmark.
+void image_decode_from_bytes_reference(uint8_t *bytes, bool transparent, rgba_t *pixels) {
+	tim_header_t tim = tim_read_header(bytes);
+	uint16_t *palette = tim.palette;
+	uint32_t p = tim.data;
+	int32_t entries = tim.entries;
 	int32_t pixel_pos = 0;
 
-	if (type == TIM_TYPE_TRUE_COLOR_16_BPP) {
+	if (tim.type == TIM_TYPE_TRUE_COLOR_16_BPP) {
 		for (int i = 0; i < entries; i++) {
-			image->pixels[pixel_pos++] = tim_16bit_to_rgba(get_i16_le(bytes, &p), transparent);
+			pixels[pixel_pos++] = tim_16bit_to_rgba(get_i16_le(bytes, &p), transparent);
 		}
 	}
-	else if (type == TIM_TYPE_PALETTED_8_BPP) {
+	else if (tim.type == TIM_TYPE_PALETTED_8_BPP) {
 		for (int i = 0; i < entries; i++) {
 			int32_t palette_pos = get_i16_le(bytes, &p);
-			image->pixels[pixel_pos++] = tim_16bit_to_rgba(palette[(palette_pos >> 0) & 0xff], transparent);
-			image->pixels[pixel_pos++] = tim_16bit_to_rgba(palette[(palette_pos >> 8) & 0xff], transparent);
+			pixels[pixel_pos++] = tim_16bit_to_rgba(palette[(palette_pos >> 0) & 0xff], transparent);
+			pixels[pixel_pos++] = tim_16bit_to_rgba(palette[(palette_pos >> 8) & 0xff], transparent);
 		}
 	}
-	else if (type == TIM_TYPE_PALETTED_4_BPP) {
+	else if (tim.type == TIM_TYPE_PALETTED_4_BPP) {
 		for (int i = 0; i < entries; i++) {
 			int32_t palette_pos = get_i16_le(bytes, &p);
-			image->pixels[pixel_pos++] = tim_16bit_to_rgba(palette[(palette_pos >>  0) & 0xf], transparent);
-			image->pixels[pixel_pos++] = tim_16bit_to_rgba(palette[(palette_pos >>  4) & 0xf], transparent);
-			image->pixels[pixel_pos++] = tim_16bit_to_rgba(palette[(palette_pos >>  8) & 0xf], transparent);
-			image->pixels[pixel_pos++] = tim_16bit_to_rgba(palette[(palette_pos >> 12) & 0xf], transparent);
+			pixels[pixel_pos++] = tim_16bit_to_rgba(palette[(palette_pos >>  0) & 0xf], transparent);
+			pixels[pixel_pos++] = tim_16bit_to_rgba(palette[(palette_pos >>  4) & 0xf], transparent);
+			pixels[pixel_pos++] = tim_16bit_to_rgba(palette[(palette_pos >>  8) & 0xf], transparent);
+			pixels[pixel_pos++] = tim_16bit_to_rgba(palette[(palette_pos >> 12) & 0xf], transparent);
 		}
 	}
+}
+
+static void tim_decode_16bpp(uint8_t *data, int32_t len, bool transparent, rgba_t *pixels) {
+	int32_t i = 0;
+
+	#if defined(__SSE2__)
+		// 8 pixels at once. Each channel is shifted into the low or high byte
+		// of a 16 bit lane, so interleaving the r|g and b|a lanes gives rgba.
+		__m128i mask_5 = _mm_set1_epi16(0x1f);
+		__m128i alpha = _mm_set1_epi16((short)0xff00);
+		__m128i alpha_bits = _mm_set1_epi16(transparent ? 0x7fff : (short)0xffff);
+		for (; i + 8 <= len; i += 8) {
+			__m128i c = _mm_loadu_si128((__m128i *)(data + i * 2));
+			__m128i r = _mm_slli_epi16(_mm_and_si128(c, mask_5), 3);
+			__m128i g = _mm_slli_epi16(_mm_and_si128(_mm_srli_epi16(c, 5), mask_5), 3 + 8);
+			__m128i b = _mm_slli_epi16(_mm_and_si128(_mm_srli_epi16(c, 10), mask_5), 3);
+			__m128i is_clear = _mm_cmpeq_epi16(_mm_and_si128(c, alpha_bits), _mm_setzero_si128());
+			__m128i rg = _mm_or_si128(r, g);
+			__m128i ba = _mm_or_si128(b, _mm_andnot_si128(is_clear, alpha));
+			_mm_storeu_si128((__m128i *)(pixels + i + 0), _mm_unpacklo_epi16(rg, ba));
+			_mm_storeu_si128((__m128i *)(pixels + i + 4), _mm_unpackhi_epi16(rg, ba));
+		}
+	#endif
 
+	for (; i < len; i++) {
+		pixels[i] = tim_16bit_to_rgba(data[i * 2] | (data[i * 2 + 1] << 8), transparent);
+	}
+}
+
+// Paletted TIMs look up each index in a palette that is already converted to
+// rgba, with the transparency rules applied. Indices past the end of a short
+// palette are transparent black.
+static void tim_expand_palette(tim_header_t *tim, bool transparent, rgba_t *palette, uint32_t len) {
+	for (int i = 0; i < len; i++) {
+		palette[i] = i < tim->palette_len
+			? tim_16bit_to_rgba(tim->palette[i], transparent)
+			: rgba(0, 0, 0, 0);
+	}
+}
+
+void image_decode_from_bytes(uint8_t *bytes, bool transparent, rgba_t *pixels) {
+	tim_header_t tim = tim_read_header(bytes);
+	uint8_t *data = bytes + tim.data;
+
+	if (tim.type == TIM_TYPE_TRUE_COLOR_16_BPP) {
+		tim_decode_16bpp(data, tim.entries, transparent, pixels);
+	}
+	else if (tim.type == TIM_TYPE_PALETTED_8_BPP) {
+		rgba_t palette[256];
+		tim_expand_palette(&tim, transparent, palette, 256);
+		for (int i = 0; i < tim.entries * 2; i++) {
+			pixels[i] = palette[data[i]];
+		}
+	}
+	else if (tim.type == TIM_TYPE_PALETTED_4_BPP) {
+		rgba_t palette[16];
+		tim_expand_palette(&tim, transparent, palette, 16);
+		for (int i = 0; i < tim.entries * 2; i++) {
+			pixels[i * 2 + 0] = palette[data[i] & 0xf];
+			pixels[i * 2 + 1] = palette[data[i] >> 4];
+		}
+	}
+}
+
+image_t *image_load_from_bytes(uint8_t *bytes, bool transparent) {
+	uint32_t width, height;
+	image_size_from_bytes(bytes, &width, &height);
+	image_t *image = image_alloc(width, height);
+	image_decode_from_bytes(bytes, transparent, image->pixels);
 	return image;
 }
 
@@ -117,7 +216,12 @@ image_t *image_load_from_bytes(uint8_t *bytes, bool transparent) {
 #define LZSS_END_OF_STREAM    0
 #define LZSS_MOD_WINDOW(a)    ((a) & (LZSS_WINDOW_SIZE - 1))
 
-void lzss_decompress(uint8_t *in_data, uint8_t *out_data) {
+#define LZSS_LITERAL_BITS     (1 + 8)
+#define LZSS_MATCH_BITS       (1 + LZSS_INDEX_BIT_COUNT + LZSS_LENGTH_BIT_COUNT)
+
+// The original decoder, reading one bit at a time. Kept as the reference for
+// the benchmark.
+void lzss_decompress_reference(uint8_t *in_data, uint8_t *out_data) {
 	int16_t i;
 	int16_t current_position;
 	uint8_t cc;
@@ -223,11 +327,106 @@ void lzss_decompress(uint8_t *in_data, uint8_t *out_data) {
 	}
 }
 
+static inline uint64_t lzss_load_u64_be(uint8_t *p) {
+	return
+		((uint64_t)p[0] << 56) | ((uint64_t)p[1] << 48) |
+		((uint64_t)p[2] << 40) | ((uint64_t)p[3] << 32) |
+		((uint64_t)p[4] << 24) | ((uint64_t)p[5] << 16) |
+		((uint64_t)p[6] <<  8) | ((uint64_t)p[7] <<  0);
+}
+
+// Produces the same bytes as lzss_decompress_reference(), but keeps the input
+// in a 64 bit buffer with the next bit at the top, so each literal or match
+// is taken out with a few shifts. All fields have a fixed width, so no
+// lookup tables are needed. The output doubles as the window: the window
+// position of each output byte is its offset + 1, so a match starts the
+// distance between the current and the match position back in the output.
+void lzss_decompress(uint8_t *in_data, uint32_t in_size, uint8_t *out_data, uint32_t out_size) {
+	uint8_t *in_end = in_data + in_size;
+	uint8_t *out = out_data;
+	uint8_t *out_end = out_data + out_size;
+	uint64_t bits = 0;
+	int32_t bits_len = 0;
+
+	while (true) {
+		// Refill with whole bytes. Past the end of the input the buffer runs
+		// dry with zeros, which read as the end of stream marker.
+		if (bits_len < LZSS_MATCH_BITS) {
+			if (in_end - in_data >= 8) {
+				bits |= lzss_load_u64_be(in_data) >> bits_len;
+				int32_t bytes = (63 - bits_len) >> 3;
+				in_data += bytes;
+				bits_len += bytes * 8;
+				// The bits below bits_len are those of the next byte already,
+				// so or-ing it in again with the next refill doesn't hurt.
+			}
+			else {
+				while (bits_len <= 56 && in_data < in_end) {
+					bits |= (uint64_t)(*in_data++) << (56 - bits_len);
+					bits_len += 8;
+				}
+			}
+		}
+
+		if (bits >> 63) {
+			error_if(out >= out_end, "LZSS data exceeds %d bytes", out_size);
+			*out++ = (bits >> (64 - LZSS_LITERAL_BITS)) & 0xff;
+			bits <<= LZSS_LITERAL_BITS;
+			bits_len -= LZSS_LITERAL_BITS;
+			continue;
+		}
+
+		uint32_t match_position = (bits >> (64 - 1 - LZSS_INDEX_BIT_COUNT)) & (LZSS_WINDOW_SIZE - 1);
+		if (match_position == LZSS_END_OF_STREAM) {
+			break;
+		}
+		uint32_t match_length = ((bits >> (64 - LZSS_MATCH_BITS)) & ((1 << LZSS_LENGTH_BIT_COUNT) - 1)) + LZSS_BREAK_EVEN + 1;
+		bits <<= LZSS_MATCH_BITS;
+		bits_len -= LZSS_MATCH_BITS;
+
+		uint32_t current_position = LZSS_MOD_WINDOW(out - out_data + 1);
+		uint32_t distance = LZSS_MOD_WINDOW(current_position - match_position);
+		if (distance == 0) {
+			distance = LZSS_WINDOW_SIZE;
+		}
+		error_if(match_length > out_end - out, "LZSS data exceeds %d bytes", out_size);
+
+		uint8_t *src = out - distance;
+		if (distance >= 8 && out_end - out >= 24 && src >= out_data) {
+			// Matches are at most 18 bytes; with the source at least 8 bytes 
+			// back, each 8 byte copy only reads bytes written before it. The
+			// bytes written past the match are overwritten by the next ones.
+			memcpy(out +  0, src +  0, 8);
+			memcpy(out +  8, src +  8, 8);
+			memcpy(out + 16, src + 16, 8);
+			out += match_length;
+		}
+		else if (src >= out_data) {
+			for (uint32_t i = 0; i < match_length; i++) {
+				out[i] = src[i];
+			}
+			out += match_length;
+		}
+		else {
+			// Before the start of the output, the window of the reference
+			// decoder is uninitialized; valid data never reads from there.
+			for (uint32_t i = 0; i < match_length; i++, out++, src++) {
+				*out = src >= out_data ? *src : 0;
+			}
+		}
+	}
+}
+
 cmp_t *image_load_compressed(char *name) {
 	printf("load cmp %s\n", name);
 	uint32_t compressed_size;
 	uint8_t *compressed_bytes = file_load(name, &compressed_size);
+	cmp_t *cmp = image_load_compressed_from_bytes(compressed_bytes, compressed_size);
+	mem_temp_free(compressed_bytes);
+	return cmp;
+}
 
+cmp_t *image_load_compressed_from_bytes(uint8_t *compressed_bytes, uint32_t compressed_size) {
 	uint32_t p = 0;
 	int32_t decompressed_size = 0;
 	int32_t image_count = get_i32_le(compressed_bytes, &p);
@@ -251,61 +450,250 @@ cmp_t *image_load_compressed(char *name) {
 		offset += get_i32_le(compressed_bytes, &p);
 	}
 
-	lzss_decompress(compressed_bytes + p, decompressed_bytes);
-	mem_temp_free(compressed_bytes);
-
+	lzss_decompress(compressed_bytes + p, compressed_size - p, decompressed_bytes, decompressed_size);
 	return cmp;
 }
 
-uint16_t image_get_texture(char *name) {
-	printf("load: %s\n", name);
-	uint32_t size;
-	uint8_t *bytes = file_load(name, &size);
-	image_t *image = image_load_from_bytes(bytes, false);
-	uint32_t texture_index = render_texture_create(image->width, image->height, image->pixels);
-	mem_temp_free(image);
-	mem_temp_free(bytes);
 
+
+// Texture cache - identical images are only uploaded once. Lists from a .cmp
+// are keyed by the hash of the file's contents; with a pack, that is taken
+// from the pack header, so a cached list is found without reading the .cmp.
+// Single images are keyed by the hash of their decoded pixels, so e.g. the
+// same .tim loaded with and without semi transparency is shared when that
+// doesn't change any pixel.
+
+#define IMAGE_CACHE_MAX 128
+
+typedef struct {
+	uint64_t hash;
+	texture_list_t textures;
+} image_cache_entry_t;
+
+static image_cache_entry_t image_cache[IMAGE_CACHE_MAX];
+static uint32_t image_cache_len;
+
+static bool image_cache_find(uint64_t hash, texture_list_t *textures) {
+	for (int i = 0; i < image_cache_len; i++) {
+		if (image_cache[i].hash == hash) {
+			*textures = image_cache[i].textures;
+			return true;
+		}
+	}
+	return false;
+}
+
+static void image_cache_add(uint64_t hash, texture_list_t textures) {
+	// When full, further textures are just not shared
+	if (image_cache_len < IMAGE_CACHE_MAX) {
+		image_cache[image_cache_len++] = (image_cache_entry_t){.hash = hash, .textures = textures};
+	}
+}
+
+static uint64_t image_hash(image_t *image) {
+	uint32_t size[2] = {image->width, image->height};
+	uint64_t hash = hash_bytes(HASH_INIT, size, sizeof(size));
+	return hash_bytes(hash, image->pixels, image->width * image->height * sizeof(rgba_t));
+}
+
+static uint16_t image_texture_create_cached(image_t *image) {
+	uint64_t hash = image_hash(image);
+	texture_list_t textures;
+	if (image_cache_find(hash, &textures)) {
+		return textures.start;
+	}
+	uint16_t texture_index = render_texture_create(image->width, image->height, image->pixels);
+	image_cache_add(hash, (texture_list_t){.start = texture_index, .len = 1});
 	return texture_index;
 }
 
-uint16_t image_get_texture_semi_trans(char *name) {
+void image_textures_reset(uint16_t len) {
+	render_textures_reset(len);
+	for (int i = 0; i < image_cache_len; i++) {
+		if (image_cache[i].textures.start + image_cache[i].textures.len > len) {
+			image_cache[i--] = image_cache[--image_cache_len];
+		}
+	}
+}
+
+static void image_texture_load_mapped(void *user, uint32_t width, uint32_t height, rgba_t *pixels) {
+	memcpy(pixels, user, width * height * sizeof(rgba_t));
+}
+
+// Creates lazy textures for all images in the pack. Only those that are
+// drawn or prefetched are copied from the mapping into the atlas, so the pack
+// stays mapped.
+static texture_list_t image_textures_from_pack(pack_header_t *pack) {
+	texture_list_t list = {.start = render_textures_len(), .len = pack->len};
+	for (int i = 0; i < pack->len; i++) {
+		image_t image = pack_image(pack, i);
+		render_texture_create_lazy(image.width, image.height, image_texture_load_mapped, image.pixels);
+	}
+	return list;
+}
+
+static uint16_t image_get_texture_packed(char *name, bool transparent) {
+	pack_kind_t kind = transparent ? PACK_TEXTURES_SEMI_TRANS : PACK_TEXTURES;
+	pack_header_t *pack = pack_map(name, NULL, kind, sizeof(rgba_t));
+	if (pack && pack->len == 1) {
+		image_t image = pack_image(pack, 0);
+		uint16_t texture_index = image_texture_create_cached(&image);
+		pack_unmap(pack);
+		return texture_index;
+	}
+	else if (pack) {
+		pack_unmap(pack);
+	}
+
 	printf("load: %s\n", name);
 	uint32_t size;
 	uint8_t *bytes = file_load(name, &size);
-	image_t *image = image_load_from_bytes(bytes, true);
-	uint32_t texture_index = render_texture_create(image->width, image->height, image->pixels);
+	image_t *image = image_load_from_bytes(bytes, transparent);
+	uint16_t texture_index = image_texture_create_cached(image);
+	if (pack_write_begin(name, NULL, kind, sizeof(rgba_t), 1)) {
+		pack_write_image(image);
+		pack_write_end();
+	}
 	mem_temp_free(image);
 	mem_temp_free(bytes);
 
 	return texture_index;
 }
 
-texture_list_t image_get_compressed_textures(char *name) {
-	cmp_t *cmp = image_load_compressed(name);
-	texture_list_t list = {.start = render_textures_len(), .len = cmp->len};
+uint16_t image_get_texture(char *name) {
+	return image_get_texture_packed(name, false);
+}
 
-	for (int i = 0; i < cmp->len; i++) {
-		int32_t width, height;
-		image_t *image = image_load_from_bytes(cmp->entries[i], false);
+uint16_t image_get_texture_semi_trans(char *name) {
+	return image_get_texture_packed(name, true);
+}
+
+#define IMAGE_DECODE_BATCH_BYTES (2 * 1024 * 1024)
+
+typedef struct {
+	uint8_t **entries;
+	image_t *images;
+} image_decode_batch_t;
+
+static void image_decode_job(void *user, uint32_t index) {
+	image_decode_batch_t *batch = user;
+	image_decode_from_bytes(batch->entries[index], false, batch->images[index].pixels);
+}
 
-		// char png_name[1024] = {0};
-		// sprintf(png_name, "%s.%d.png", name, i);
-		// stbi_write_png(png_name, image->width, image->height, 4, image->pixels, 0);
+static void image_decode_compressed(cmp_t *cmp, bool write_pack);
 
-		render_texture_create(image->width, image->height, image->pixels);
-		mem_temp_free(image);
+texture_list_t image_get_compressed_textures(char *name) {
+	// The .cmp itself is only read if there's no valid pack
+	uint64_t hash;
+	uint32_t compressed_size = 0;
+	uint8_t *compressed_bytes = NULL;
+	pack_header_t *pack = pack_map(name, NULL, PACK_TEXTURES, sizeof(rgba_t));
+	if (pack) {
+		hash = pack->source_hash;
+	}
+	else {
+		compressed_bytes = file_load(name, &compressed_size);
+		hash = hash_bytes(HASH_INIT, compressed_bytes, compressed_size);
 	}
 
-	mem_temp_free(cmp);
+	texture_list_t cached;
+	if (image_cache_find(hash, &cached)) {
+		if (pack) {
+			pack_unmap(pack);
+		}
+		else {
+			mem_temp_free(compressed_bytes);
+		}
+		return cached;
+	}
+
+	texture_list_t list = {.start = render_textures_len()};
+	if (!pack) {
+		printf("load cmp %s\n", name);
+		cmp_t *cmp = image_load_compressed_from_bytes(compressed_bytes, compressed_size);
+		mem_temp_free(compressed_bytes);
+
+		// Once the pack is written, the textures can be made lazy from it.
+		// Without packs, all of them have to be uploaded now.
+		if (pack_write_begin(name, NULL, PACK_TEXTURES, sizeof(rgba_t), cmp->len)) {
+			image_decode_compressed(cmp, true);
+			pack_write_end();
+			pack = pack_map(name, NULL, PACK_TEXTURES, sizeof(rgba_t));
+		}
+		if (!pack) {
+			image_decode_compressed(cmp, false);
+			list.len = cmp->len;
+		}
+		mem_temp_free(cmp);
+	}
+	if (pack) {
+		list = image_textures_from_pack(pack);
+	}
+
+	image_cache_add(hash, list);
 	return list;
 }
 
+// Decodes all images and either writes them to the pack that is being
+// written, or uploads them.
+static void image_decode_compressed(cmp_t *cmp, bool write_pack) {
+	image_t *images = mem_temp_alloc(sizeof(image_t) * cmp->len);
+	for (int i = 0; i < cmp->len; i++) {
+		image_size_from_bytes(cmp->entries[i], &images[i].width, &images[i].height);
+	}
+
+	// Decode as many images as fit into a batch in parallel, then upload or
+	// write them in order, so the texture indices are the same as with a
+	// serial load.
+	for (uint32_t first = 0, len = 0; first < cmp->len; first += len) {
+		uint32_t pixels_len = 0;
+		for (len = 0; first + len < cmp->len; len++) {
+			uint32_t image_len = images[first + len].width * images[first + len].height;
+			if (len > 0 && (pixels_len + image_len) * sizeof(rgba_t) > IMAGE_DECODE_BATCH_BYTES) {
+				break;
+			}
+			pixels_len += image_len;
+		}
+
+		rgba_t *pixels = mem_temp_alloc(pixels_len * sizeof(rgba_t));
+		for (int i = 0; i < len; i++) {
+			images[first + i].pixels = pixels;
+			pixels += images[first + i].width * images[first + i].height;
+		}
+
+		image_decode_batch_t batch = {.entries = cmp->entries + first, .images = images + first};
+		jobs_run(image_decode_job, &batch, len);
+
+		for (int i = 0; i < len; i++) {
+			image_t *image = &images[first + i];
+
+			// char png_name[1024] = {0};
+			// sprintf(png_name, "%s.%d.png", name, first + i);
+			// stbi_write_png(png_name, image->width, image->height, 4, image->pixels, 0);
+
+			if (write_pack) {
+				pack_write_image(image);
+			}
+			else {
+				render_texture_create(image->width, image->height, image->pixels);
+			}
+		}
+		mem_temp_free(images[first].pixels);
+	}
+	mem_temp_free(images);
+}
+
 uint16_t texture_from_list(texture_list_t tl, uint16_t index) {
 	error_if(index >= tl.len, "Texture %d not in list of len %d", index, tl.len);
 	return tl.start + index;
 }
 
+void texture_list_prefetch(texture_list_t tl) {
+	for (int i = 0; i < tl.len; i++) {
+		render_texture_prefetch(tl.start + i);
+	}
+}
+
 void image_copy(image_t *src, image_t *dst, uint32_t sx, uint32_t sy, uint32_t sw, uint32_t sh, uint32_t dx, uint32_t dy) {
 	rgba_t *src_pixels = src->pixels + sy * src->width + sx;
 	rgba_t *dst_pixels = dst->pixels + dy * dst->width + dx;
@@ -24,11 +24,30 @@ typedef struct {
 image_t *image_alloc(uint32_t width, uint32_t height);
 void image_copy(image_t *src, image_t *dst, uint32_t sx, uint32_t sy, uint32_t sw, uint32_t sh, uint32_t dx, uint32_t dy);
 image_t *image_load_from_bytes(uint8_t *bytes, bool transparent);
+
+// For decoding into memory allocated up front, e.g. on a worker thread.
+// pixels must have room for width * height of the image.
+void image_size_from_bytes(uint8_t *bytes, uint32_t *width, uint32_t *height);
+void image_decode_from_bytes(uint8_t *bytes, bool transparent, rgba_t *pixels);
+void image_decode_from_bytes_reference(uint8_t *bytes, bool transparent, rgba_t *pixels);
 cmp_t *image_load_compressed(char *name);
+cmp_t *image_load_compressed_from_bytes(uint8_t *bytes, uint32_t size);
+
+// out_size must be the exact decompressed size
+void lzss_decompress(uint8_t *in_data, uint32_t in_size, uint8_t *out_data, uint32_t out_size);
+void lzss_decompress_reference(uint8_t *in_data, uint8_t *out_data);
 
 uint16_t image_get_texture(char *name);
 uint16_t image_get_texture_semi_trans(char *name);
+// Textures from a .cmp are lazy if they come from a pack; they only take up
+// room in the atlas once drawn. Lists that are drawn right away can be
+// prefetched, so they don't have to be loaded in the middle of a frame.
 texture_list_t image_get_compressed_textures(char *name);
 uint16_t texture_from_list(texture_list_t tl, uint16_t index);
+void texture_list_prefetch(texture_list_t tl);
+
+// Identical images and .cmp files are uploaded once and share their textures.
+// Textures must be reset through here, so the cache forgets about them.
+void image_textures_reset(uint16_t len);
 
 #endif
@@ -3,6 +3,7 @@
 #include "../utils.h"
 #include "../types.h"
 #include "../mem.h"
+#include "../platform.h"
 
 #include "intro.h"
 #include "ui.h"
@@ -21,21 +22,48 @@ void *realloc_dummmy(void *p, size_t sz) {
 #define PLM_REALLOC realloc_dummmy
 #include "../libs/pl_mpeg.h"
 
+// Both rings are single producer, single consumer. The read and write 
+// positions only ever increase; the capacity must be a power of two, so the 
+// positions can wrap around at 2^32.
 #define INTRO_AUDIO_BUFFER_LEN (64 * 1024)
+#define INTRO_FRAME_QUEUE_LEN 4
+
+typedef struct {
+	double time;
+	rgba_t *pixels; // Converted on the decoder thread, without video planes
+	uint8_t *planes; // Y, Cb and Cr, as render_video_upload() takes them
+} intro_frame_t;
 
 static plm_t *plm;
-static rgba_t *frame_buffer;
 static int16_t texture;
+static bool use_video_planes;
+static vec2i_t plane_size;
+static double video_time;
+static void *decode_thread;
+
+// Flags shared with the decoder thread; uint32_t for atomic_load_acquire()
+static uint32_t decode_stop;
+static uint32_t decode_has_ended;
+
+// Written by the decoder, read by intro_update()
+static intro_frame_t frames[INTRO_FRAME_QUEUE_LEN];
+static uint32_t frames_read_pos;
+static uint32_t frames_write_pos;
+
+// Written by the decoder, read by the audio thread
 static float *audio_buffer;
-static int audio_buffer_read_pos;
-static int audio_buffer_write_pos;
+static uint32_t audio_buffer_read_pos;
+static uint32_t audio_buffer_write_pos;
 
 static void video_cb(plm_t *plm, plm_frame_t *frame, void *user);
 static void audio_cb(plm_t *plm, plm_samples_t *samples, void *user);
 static void audio_mix(float *samples, uint32_t len);
+static void decode(void *user);
+static bool decode_frame(void);
 static void intro_end(void);
 
 void intro_init() {
+	decode_thread = NULL;
 	plm = plm_create_with_filename("wipeout/intro.mpeg");
 	if (!plm) {
 		intro_end();
@@ -48,21 +76,57 @@ void intro_init() {
 	plm_set_audio_enabled(plm, true);
 	plm_set_audio_stream(plm, 0);
 
+	// The decoder's planes are padded to whole 16x16 macroblocks. If the
+	// renderer takes them as they are, all that's left for this thread is to
+	// hand them over.
 	int w = plm_get_width(plm);
 	int h = plm_get_height(plm);
-	frame_buffer = mem_bump(w * h * sizeof(rgba_t));
-	for (int i = 0; i < w * h; i++) {
-		frame_buffer[i] = rgba(0, 0, 0, 255);
+	plane_size = vec2i((w + 15) & ~15, (h + 15) & ~15);
+	use_video_planes = render_video_begin(vec2i(w, h), plane_size);
+	if (use_video_planes) {
+		uint32_t planes_size = plane_size.x * plane_size.y * 3 / 2;
+		for (int i = 0; i < INTRO_FRAME_QUEUE_LEN; i++) {
+			frames[i].planes = mem_bump_uninit(planes_size);
+		}
+
+		// Black is Y 16, Cb and Cr 128
+		memset(frames[0].planes, 16, plane_size.x * plane_size.y);
+		memset(frames[0].planes + plane_size.x * plane_size.y, 128, plane_size.x * plane_size.y / 2);
+		render_video_upload(frames[0].planes);
+	}
+	else {
+		for (int i = 0; i < INTRO_FRAME_QUEUE_LEN; i++) {
+			frames[i].pixels = mem_bump_uninit(w * h * sizeof(rgba_t));
+		}
+		for (int i = 0; i < w * h; i++) {
+			frames[0].pixels[i] = rgba(0, 0, 0, 255);
+		}
+		texture = render_texture_create(w, h, frames[0].pixels);
 	}
-	texture = render_texture_create(w, h, frame_buffer);
+	frames_read_pos = 0;
+	frames_write_pos = 0;
 
-	sfx_set_external_mix_cb(audio_mix);
-	audio_buffer = mem_bump(INTRO_AUDIO_BUFFER_LEN * sizeof(float) * 2);
+	audio_buffer = mem_bump(INTRO_AUDIO_BUFFER_LEN * sizeof(float));
 	audio_buffer_read_pos = 0;
 	audio_buffer_write_pos = 0;
+	sfx_set_external_mix_cb(audio_mix);
+
+	video_time = 0;
+	decode_stop = false;
+	decode_has_ended = false;
+	decode_thread = platform_thread_create(decode, NULL);
 }
 
 static void intro_end(void) {
+	if (decode_thread) {
+		atomic_store_release(&decode_stop, true);
+		platform_thread_join(decode_thread);
+		decode_thread = NULL;
+	}
+	if (use_video_planes) {
+		render_video_end();
+		use_video_planes = false;
+	}
 	sfx_set_external_mix_cb(NULL);
 	game_set_scene(GAME_SCENE_TITLE);
 }
@@ -71,35 +135,112 @@ void intro_update(void) {
 	if (!plm) {
 		return;
 	}
-	plm_decode(plm, system_tick());
+
+	// Without a decoder thread we have to fill the queue ourselves
+	if (!decode_thread) {
+		while (!decode_has_ended && decode_frame()) {}
+	}
+
+	// Show the most recent frame that is due. Frames we were too late for are
+	// skipped.
+	video_time += system_tick();
+	uint32_t read_pos = frames_read_pos;
+	uint32_t write_pos = atomic_load_acquire(&frames_write_pos);
+	intro_frame_t *frame = NULL;
+	while (read_pos != write_pos && frames[read_pos % INTRO_FRAME_QUEUE_LEN].time <= video_time) {
+		frame = &frames[read_pos % INTRO_FRAME_QUEUE_LEN];
+		read_pos++;
+	}
+	if (frame) {
+		if (use_video_planes) {
+			render_video_upload(frame->planes);
+		}
+		else {
+			render_texture_replace_pixels(texture, frame->pixels);
+		}
+		atomic_store_release(&frames_read_pos, read_pos);
+	}
+
 	render_set_view_2d();
-	render_push_2d(vec2i(0,0), render_size(), rgba(128, 128, 128, 255), texture);
-	if (plm_has_ended(plm) || input_pressed(A_MENU_SELECT) || input_pressed(A_MENU_START)) {
+	if (use_video_planes) {
+		render_push_video(vec2i(0,0), render_size());
+	}
+	else {
+		render_push_2d(vec2i(0,0), render_size(), rgba(128, 128, 128, 255), texture);
+	}
+
+	bool has_ended = atomic_load_acquire(&decode_has_ended) && read_pos == write_pos;
+	if (has_ended || input_pressed(A_MENU_SELECT) || input_pressed(A_MENU_START)) {
 		intro_end();
 	}
 }
 
+static void decode(void *user) {
+	while (!atomic_load_acquire(&decode_stop) && !decode_has_ended) {
+		if (!decode_frame()) {
+			platform_sleep(0.25 / plm_get_framerate(plm));
+		}
+	}
+}
+
+static bool decode_frame(void) {
+	// Only decode if there's a free slot in the queue. plm_decode() with a tick
+	// of one frame may still decode two frames, so we need two slots.
+	uint32_t used = frames_write_pos - atomic_load_acquire(&frames_read_pos);
+	if (used + 2 > INTRO_FRAME_QUEUE_LEN) {
+		return false;
+	}
+
+	plm_decode(plm, 1.0 / plm_get_framerate(plm));
+	if (plm_has_ended(plm)) {
+		atomic_store_release(&decode_has_ended, true);
+	}
+	return true;
+}
+
 static void audio_cb(plm_t *plm, plm_samples_t *samples, void *user) {
-	int len = samples->count * 2;
-	for (int i = 0; i < len; i++) {
-		audio_buffer[audio_buffer_write_pos % INTRO_AUDIO_BUFFER_LEN] = samples->interleaved[i];
-		audio_buffer_write_pos++;
+	uint32_t len = samples->count * 2;
+	uint32_t space = INTRO_AUDIO_BUFFER_LEN - (audio_buffer_write_pos - atomic_load_acquire(&audio_buffer_read_pos));
+	if (len > space) {
+		len = space;
 	}
+	for (uint32_t i = 0; i < len; i++) {
+		audio_buffer[(audio_buffer_write_pos + i) & (INTRO_AUDIO_BUFFER_LEN - 1)] = samples->interleaved[i];
+	}
+	atomic_store_release(&audio_buffer_write_pos, audio_buffer_write_pos + len);
 }
 
 static void audio_mix(float *samples, uint32_t len) {
-	int i;
-	for (i = 0; i < len && audio_buffer_read_pos < audio_buffer_write_pos; i++) {
-		samples[i] = audio_buffer[audio_buffer_read_pos % INTRO_AUDIO_BUFFER_LEN];
-		audio_buffer_read_pos++;
+	uint32_t available = atomic_load_acquire(&audio_buffer_write_pos) - audio_buffer_read_pos;
+	uint32_t i;
+	for (i = 0; i < len && i < available; i++) {
+		samples[i] = audio_buffer[(audio_buffer_read_pos + i) & (INTRO_AUDIO_BUFFER_LEN - 1)];
 	}
+	atomic_store_release(&audio_buffer_read_pos, audio_buffer_read_pos + i);
 	for (; i < len; i++) {
 		samples[i] = 0;
 	}
 }
 
 static void video_cb(plm_t *plm, plm_frame_t *frame, void *user) {
-	plm_frame_to_rgba(frame, (uint8_t *)frame_buffer, plm_get_width(plm) * sizeof(rgba_t));
-	render_texture_replace_pixels(texture, frame_buffer);
+	// Copy or convert here, on the decoder thread; intro_update() only has to
+	// upload the planes or pixels. The decoder reuses its planes for the next
+	// frame.
+	intro_frame_t *f = &frames[frames_write_pos % INTRO_FRAME_QUEUE_LEN];
+	f->time = frame->time;
+	if (use_video_planes) {
+		error_if(
+			frame->y.width != plane_size.x || frame->y.height != plane_size.y,
+			"Video plane is %dx%d", frame->y.width, frame->y.height
+		);
+		uint32_t y_size = frame->y.width * frame->y.height;
+		uint32_t c_size = frame->cb.width * frame->cb.height;
+		memcpy(f->planes, frame->y.data, y_size);
+		memcpy(f->planes + y_size, frame->cb.data, c_size);
+		memcpy(f->planes + y_size + c_size, frame->cr.data, c_size);
+	}
+	else {
+		plm_frame_to_rgba(frame, (uint8_t *)f->pixels, plm_get_width(plm) * sizeof(rgba_t));
+	}
+	atomic_store_release(&frames_write_pos, frames_write_pos + 1);
 }
-
@@ -510,6 +510,7 @@ static void objects_unpack_imp(Object **dest_array, int len, Object *src) {
 	int i;
 	for (i = 0; src && i < len; i++) {
 		dest_array[i] = src;
+		object_bake(src);
 		src = src->next;
 	}
 	error_if(i != len, "expected %d models got %d", len, i)
@@ -13,6 +13,7 @@
 #include "scene.h"
 #include "hud.h"
 #include "object.h"
+#include "pack.h"
 
 
 static rgba_t int32_to_rgba(uint32_t v) {
@@ -24,7 +25,33 @@ static rgba_t int32_to_rgba(uint32_t v) {
 	);
 }
 
+static void object_bounds_add(Object *object, vec3_t p, float size) {
+	object->bounds_min = vec3(
+		minfloat(object->bounds_min.x, p.x - size),
+		minfloat(object->bounds_min.y, p.y - size),
+		minfloat(object->bounds_min.z, p.z - size)
+	);
+	object->bounds_max = vec3(
+		maxfloat(object->bounds_max.x, p.x + size),
+		maxfloat(object->bounds_max.y, p.y + size),
+		maxfloat(object->bounds_max.z, p.z + size)
+	);
+}
+
+static int object_primitive_size(int16_t type);
+static int object_primitive_size_max(void);
+static int16_t *object_primitive_texture(Prm prm);
+static Object *objects_load_from_pack(pack_header_t *pack, texture_list_t tl);
+static void objects_write_pack(char *name, Object *list, texture_list_t tl);
+
 Object *objects_load(char *name, texture_list_t tl) {
+	pack_header_t *pack = pack_map(name, NULL, PACK_OBJECTS, sizeof(Object));
+	if (pack) {
+		Object *objectList = objects_load_from_pack(pack, tl);
+		pack_unmap(pack);
+		return objectList;
+	}
+
 	uint32_t length = 0;
 	uint8_t *bytes = file_load(name, &length);
 	if (!bytes) {
@@ -77,7 +104,7 @@ Object *objects_load(char *name, texture_list_t tl) {
 		p += 4; // skeleton sub
 		p += 4; // skeleton next
 
-		object->vertices = mem_bump(object->vertices_len * sizeof(vec3_t));
+		object->vertices = mem_bump_uninit(object->vertices_len * sizeof(vec3_t));
 		for (int i = 0; i < object->vertices_len; i++) {
 			object->vertices[i].x = get_i16(bytes, &p);
 			object->vertices[i].y = get_i16(bytes, &p);
@@ -85,7 +112,13 @@ Object *objects_load(char *name, texture_list_t tl) {
 			p += 2; // padding
 		}
 
-		object->normals = mem_bump(object->normals_len * sizeof(vec3_t));
+		object->bounds_min = object->vertices_len ? object->vertices[0] : vec3(0, 0, 0);
+		object->bounds_max = object->bounds_min;
+		for (int i = 1; i < object->vertices_len; i++) {
+			object_bounds_add(object, object->vertices[i], 0);
+		}
+
+		object->normals = mem_bump_uninit(object->normals_len * sizeof(vec3_t));
 		for (int i = 0; i < object->normals_len; i++) {
 			object->normals[i].x = get_i16(bytes, &p);
 			object->normals[i].y = get_i16(bytes, &p);
@@ -93,15 +126,18 @@ Object *objects_load(char *name, texture_list_t tl) {
 			p += 2; // padding
 		}
 
-		object->primitives = mem_mark();
+		// All primitives are allocated at once, with room for the largest
+		// type each. Every field is read from the file, so the bytes don't
+		// need to be cleared. The unused rest is given back below.
+		uint8_t *prm_bytes = mem_bump_uninit(object->primitives_len * object_primitive_size_max());
+		object->primitives = (Primitive *)prm_bytes;
 		for (int i = 0; i < object->primitives_len; i++) {
-			Prm prm;
+			Prm prm = {.ptr = prm_bytes};
 			int16_t prm_type = get_i16(bytes, &p);
 			int16_t prm_flag = get_i16(bytes, &p);
 
 			switch (prm_type) {
 			case PRM_TYPE_F3:
-				prm.ptr = mem_bump(sizeof(F3));
 				prm.f3->coords[0] = get_i16(bytes, &p);
 				prm.f3->coords[1] = get_i16(bytes, &p);
 				prm.f3->coords[2] = get_i16(bytes, &p);
@@ -110,7 +146,6 @@ Object *objects_load(char *name, texture_list_t tl) {
 				break;
 
 			case PRM_TYPE_F4:
-				prm.ptr = mem_bump(sizeof(F4));
 				prm.f4->coords[0] = get_i16(bytes, &p);
 				prm.f4->coords[1] = get_i16(bytes, &p);
 				prm.f4->coords[2] = get_i16(bytes, &p);
@@ -119,7 +154,6 @@ Object *objects_load(char *name, texture_list_t tl) {
 				break;
 
 			case PRM_TYPE_FT3:
-				prm.ptr = mem_bump(sizeof(FT3));
 				prm.ft3->coords[0] = get_i16(bytes, &p);
 				prm.ft3->coords[1] = get_i16(bytes, &p);
 				prm.ft3->coords[2] = get_i16(bytes, &p);
@@ -139,7 +173,6 @@ Object *objects_load(char *name, texture_list_t tl) {
 				break;
 
 			case PRM_TYPE_FT4:
-				prm.ptr = mem_bump(sizeof(FT4));
 				prm.ft4->coords[0] = get_i16(bytes, &p);
 				prm.ft4->coords[1] = get_i16(bytes, &p);
 				prm.ft4->coords[2] = get_i16(bytes, &p);
@@ -161,7 +194,6 @@ Object *objects_load(char *name, texture_list_t tl) {
 				break;
 
 			case PRM_TYPE_G3:
-				prm.ptr = mem_bump(sizeof(G3));
 				prm.g3->coords[0] = get_i16(bytes, &p);
 				prm.g3->coords[1] = get_i16(bytes, &p);
 				prm.g3->coords[2] = get_i16(bytes, &p);
@@ -172,7 +204,6 @@ Object *objects_load(char *name, texture_list_t tl) {
 				break;
 
 			case PRM_TYPE_G4:
-				prm.ptr = mem_bump(sizeof(G4));
 				prm.g4->coords[0] = get_i16(bytes, &p);
 				prm.g4->coords[1] = get_i16(bytes, &p);
 				prm.g4->coords[2] = get_i16(bytes, &p);
@@ -184,7 +215,6 @@ Object *objects_load(char *name, texture_list_t tl) {
 				break;
 
 			case PRM_TYPE_GT3:
-				prm.ptr = mem_bump(sizeof(GT3));
 				prm.gt3->coords[0] = get_i16(bytes, &p);
 				prm.gt3->coords[1] = get_i16(bytes, &p);
 				prm.gt3->coords[2] = get_i16(bytes, &p);
@@ -205,7 +235,6 @@ Object *objects_load(char *name, texture_list_t tl) {
 				break;
 
 			case PRM_TYPE_GT4:
-				prm.ptr = mem_bump(sizeof(GT4));
 				prm.gt4->coords[0] = get_i16(bytes, &p);
 				prm.gt4->coords[1] = get_i16(bytes, &p);
 				prm.gt4->coords[2] = get_i16(bytes, &p);
@@ -231,7 +260,6 @@ Object *objects_load(char *name, texture_list_t tl) {
 
 
 			case PRM_TYPE_LSF3:
-				prm.ptr = mem_bump(sizeof(LSF3));
 				prm.lsf3->coords[0] = get_i16(bytes, &p);
 				prm.lsf3->coords[1] = get_i16(bytes, &p);
 				prm.lsf3->coords[2] = get_i16(bytes, &p);
@@ -240,7 +268,6 @@ Object *objects_load(char *name, texture_list_t tl) {
 				break;
 
 			case PRM_TYPE_LSF4:
-				prm.ptr = mem_bump(sizeof(LSF4));
 				prm.lsf4->coords[0] = get_i16(bytes, &p);
 				prm.lsf4->coords[1] = get_i16(bytes, &p);
 				prm.lsf4->coords[2] = get_i16(bytes, &p);
@@ -251,7 +278,6 @@ Object *objects_load(char *name, texture_list_t tl) {
 				break;
 
 			case PRM_TYPE_LSFT3:
-				prm.ptr = mem_bump(sizeof(LSFT3));
 				prm.lsft3->coords[0] = get_i16(bytes, &p);
 				prm.lsft3->coords[1] = get_i16(bytes, &p);
 				prm.lsft3->coords[2] = get_i16(bytes, &p);
@@ -270,7 +296,6 @@ Object *objects_load(char *name, texture_list_t tl) {
 				break;
 
 			case PRM_TYPE_LSFT4:
-				prm.ptr = mem_bump(sizeof(LSFT4));
 				prm.lsft4->coords[0] = get_i16(bytes, &p);
 				prm.lsft4->coords[1] = get_i16(bytes, &p);
 				prm.lsft4->coords[2] = get_i16(bytes, &p);
@@ -292,7 +317,6 @@ Object *objects_load(char *name, texture_list_t tl) {
 				break;
 
 			case PRM_TYPE_LSG3:
-				prm.ptr = mem_bump(sizeof(LSG3));
 				prm.lsg3->coords[0] = get_i16(bytes, &p);
 				prm.lsg3->coords[1] = get_i16(bytes, &p);
 				prm.lsg3->coords[2] = get_i16(bytes, &p);
@@ -305,7 +329,6 @@ Object *objects_load(char *name, texture_list_t tl) {
 				break;
 
 			case PRM_TYPE_LSG4:
-				prm.ptr = mem_bump(sizeof(LSG4));
 				prm.lsg4->coords[0] = get_i16(bytes, &p);
 				prm.lsg4->coords[1] = get_i16(bytes, &p);
 				prm.lsg4->coords[2] = get_i16(bytes, &p);
@@ -321,7 +344,6 @@ Object *objects_load(char *name, texture_list_t tl) {
 				break;
 
 			case PRM_TYPE_LSGT3:
-				prm.ptr = mem_bump(sizeof(LSGT3));
 				prm.lsgt3->coords[0] = get_i16(bytes, &p);
 				prm.lsgt3->coords[1] = get_i16(bytes, &p);
 				prm.lsgt3->coords[2] = get_i16(bytes, &p);
@@ -344,7 +366,6 @@ Object *objects_load(char *name, texture_list_t tl) {
 				break;
 
 			case PRM_TYPE_LSGT4:
-				prm.ptr = mem_bump(sizeof(LSGT4));
 				prm.lsgt4->coords[0] = get_i16(bytes, &p);
 				prm.lsgt4->coords[1] = get_i16(bytes, &p);
 				prm.lsgt4->coords[2] = get_i16(bytes, &p);
@@ -373,16 +394,17 @@ Object *objects_load(char *name, texture_list_t tl) {
 
 			case PRM_TYPE_TSPR:
 			case PRM_TYPE_BSPR:
-				prm.ptr = mem_bump(sizeof(SPR));
 				prm.spr->coord = get_i16(bytes, &p);
 				prm.spr->width = get_i16(bytes, &p);
 				prm.spr->height = get_i16(bytes, &p);
 				prm.spr->texture = texture_from_list(tl, get_i16(bytes, &p));
 				prm.spr->colour = int32_to_rgba(get_i32(bytes, &p));
+
+				// Sprites are drawn as billboards offset from their vertex
+				object_bounds_add(object, object->vertices[prm.spr->coord], maxint(prm.spr->width, prm.spr->height));
 				break;
 
 			case PRM_TYPE_SPLINE:
-				prm.ptr = mem_bump(sizeof(Spline));
 				prm.spline->control1.x = get_i32(bytes, &p);
 				prm.spline->control1.y = get_i32(bytes, &p);
 				prm.spline->control1.z = get_i32(bytes, &p);
@@ -399,7 +421,6 @@ Object *objects_load(char *name, texture_list_t tl) {
 				break;
 
 			case PRM_TYPE_POINT_LIGHT:
-				prm.ptr = mem_bump(sizeof(PointLight));
 				prm.pointLight->position.x = get_i32(bytes, &p);
 				prm.pointLight->position.y = get_i32(bytes, &p);
 				prm.pointLight->position.z = get_i32(bytes, &p);
@@ -410,7 +431,6 @@ Object *objects_load(char *name, texture_list_t tl) {
 				break;
 
 			case PRM_TYPE_SPOT_LIGHT:
-				prm.ptr = mem_bump(sizeof(SpotLight));
 				prm.spotLight->position.x = get_i32(bytes, &p);
 				prm.spotLight->position.y = get_i32(bytes, &p);
 				prm.spotLight->position.z = get_i32(bytes, &p);
@@ -427,7 +447,6 @@ Object *objects_load(char *name, texture_list_t tl) {
 				break;
 
 			case PRM_TYPE_INFINITE_LIGHT:
-				prm.ptr = mem_bump(sizeof(InfiniteLight));
 				prm.infiniteLight->direction.x = get_i16(bytes, &p);
 				prm.infiniteLight->direction.y = get_i16(bytes, &p);
 				prm.infiniteLight->direction.z = get_i16(bytes, &p);
@@ -442,23 +461,463 @@ Object *objects_load(char *name, texture_list_t tl) {
 
 			prm.f3->type = prm_type;
 			prm.f3->flag = prm_flag;
+			prm_bytes += object_primitive_size(prm_type);
 		} // each prim
+		mem_reset(prm_bytes);
+
+		object->bounds_center = vec3_mulf(vec3_add(object->bounds_min, object->bounds_max), 0.5);
+		object->radius = vec3_len(vec3_sub(object->bounds_max, object->bounds_center));
+		object->mesh = RENDER_NO_MESH;
 	} // each object
 
 	mem_temp_free(bytes);
+	objects_write_pack(name, objectList, tl);
+	return objectList;
+}
+
+
+// In a pack, the objects are stored exactly as they are laid out in memory
+// after loading: all objects with their vertices, normals and primitives in
+// one contiguous block. Pointers are stored as offset + 1 into this block, so
+// NULL stays NULL; textures are stored relative to the texture list.
+
+static void *object_pack_ptr(void *p, uint8_t *base) {
+	return p ? (void *)(uintptr_t)((uint8_t *)p - base + 1) : NULL;
+}
+
+static void *object_unpack_ptr(void *p, uint8_t *base, uint32_t size) {
+	uintptr_t offset = (uintptr_t)p;
+	error_if(offset > size, "Invalid object pointer in pack");
+	return offset ? base + offset - 1 : NULL;
+}
+
+static void objects_write_pack(char *name, Object *list, texture_list_t tl) {
+	uint8_t *base = (uint8_t *)list;
+	uint32_t size = (uint8_t *)mem_mark() - base;
+	uint32_t len = 0;
+	for (Object *o = list; o; o = o->next) {
+		len++;
+	}
+
+	if (!pack_write_begin(name, NULL, PACK_OBJECTS, sizeof(Object), len)) {
+		return;
+	}
+
+	uint8_t *bytes = mem_temp_alloc(size);
+	memcpy(bytes, base, size);
+	for (Object *o = list; o; o = o->next) {
+		Object *po = (Object *)(bytes + ((uint8_t *)o - base));
+		Prm prm = {.ptr = bytes + ((uint8_t *)o->primitives - base)};
+		for (int i = 0; i < o->primitives_len; i++) {
+			int16_t *texture = object_primitive_texture(prm);
+			if (texture) {
+				*texture -= tl.start;
+			}
+			prm.ptr += object_primitive_size(prm.primitive->type);
+		}
+		po->vertices = object_pack_ptr(o->vertices, base);
+		po->normals = object_pack_ptr(o->normals, base);
+		po->primitives = object_pack_ptr(o->primitives, base);
+		po->next = object_pack_ptr(o->next, base);
+	}
+
+	pack_write_bytes(bytes, size);
+	pack_write_end();
+	mem_temp_free(bytes);
+}
+
+static Object *objects_load_from_pack(pack_header_t *pack, texture_list_t tl) {
+	uint32_t size = pack->data_size;
+	uint8_t *base = mem_bump_uninit(size);
+	memcpy(base, pack_data(pack), size);
+
+	Object *objectList = (Object *)base;
+	for (Object *o = objectList; o; o = o->next) {
+		o->vertices = object_unpack_ptr(o->vertices, base, size);
+		o->normals = object_unpack_ptr(o->normals, base, size);
+		o->primitives = object_unpack_ptr(o->primitives, base, size);
+		o->next = object_unpack_ptr(o->next, base, size);
+
+		Prm prm = {.primitive = o->primitives};
+		for (int i = 0; i < o->primitives_len; i++) {
+			int16_t *texture = object_primitive_texture(prm);
+			if (texture) {
+				*texture = texture_from_list(tl, *texture);
+			}
+			prm.ptr += object_primitive_size(prm.primitive->type);
+		}
+	}
 	return objectList;
 }
 
+static int object_primitive_size_max(void) {
+	static int size_max = 0;
+	if (!size_max) {
+		for (int16_t type = PRM_TYPE_F3; type <= PRM_TYPE_SPOT_LIGHT; type++) {
+			size_max = maxint(size_max, object_primitive_size(type));
+		}
+	}
+	return size_max;
+}
+
+static int object_primitive_size(int16_t type) {
+	switch (type) {
+		case PRM_TYPE_F3: return sizeof(F3);
+		case PRM_TYPE_FT3: return sizeof(FT3);
+		case PRM_TYPE_F4: return sizeof(F4);
+		case PRM_TYPE_FT4: return sizeof(FT4);
+		case PRM_TYPE_G3: return sizeof(G3);
+		case PRM_TYPE_GT3: return sizeof(GT3);
+		case PRM_TYPE_G4: return sizeof(G4);
+		case PRM_TYPE_GT4: return sizeof(GT4);
+		case PRM_TYPE_LSF3: return sizeof(LSF3);
+		case PRM_TYPE_LSFT3: return sizeof(LSFT3);
+		case PRM_TYPE_LSF4: return sizeof(LSF4);
+		case PRM_TYPE_LSFT4: return sizeof(LSFT4);
+		case PRM_TYPE_LSG3: return sizeof(LSG3);
+		case PRM_TYPE_LSGT3: return sizeof(LSGT3);
+		case PRM_TYPE_LSG4: return sizeof(LSG4);
+		case PRM_TYPE_LSGT4: return sizeof(LSGT4);
+		case PRM_TYPE_TSPR: return sizeof(SPR);
+		case PRM_TYPE_BSPR: return sizeof(SPR);
+		case PRM_TYPE_SPLINE: return sizeof(Spline);
+		case PRM_TYPE_POINT_LIGHT: return sizeof(PointLight);
+		case PRM_TYPE_SPOT_LIGHT: return sizeof(SpotLight);
+		case PRM_TYPE_INFINITE_LIGHT: return sizeof(InfiniteLight);
+		default: return 0;
+	}
+}
+
+// Returns the number of coords of a primitive and a pointer to them in 
+// coords. The texture of the primitive is returned in texture; -1 for 
+// untextured ones.
+static int object_primitive_coords(Prm prm, int16_t **coords, int16_t *texture) {
+	*texture = -1;
+	switch (prm.primitive->type) {
+		case PRM_TYPE_F3: *coords = prm.f3->coords; return 3;
+		case PRM_TYPE_FT3: *coords = prm.ft3->coords; *texture = prm.ft3->texture; return 3;
+		case PRM_TYPE_F4: *coords = prm.f4->coords; return 4;
+		case PRM_TYPE_FT4: *coords = prm.ft4->coords; *texture = prm.ft4->texture; return 4;
+		case PRM_TYPE_G3: *coords = prm.g3->coords; return 3;
+		case PRM_TYPE_GT3: *coords = prm.gt3->coords; *texture = prm.gt3->texture; return 3;
+		case PRM_TYPE_G4: *coords = prm.g4->coords; return 4;
+		case PRM_TYPE_GT4: *coords = prm.gt4->coords; *texture = prm.gt4->texture; return 4;
+		case PRM_TYPE_LSF3: *coords = prm.lsf3->coords; return 3;
+		case PRM_TYPE_LSFT3: *coords = prm.lsft3->coords; *texture = prm.lsft3->texture; return 3;
+		case PRM_TYPE_LSF4: *coords = prm.lsf4->coords; return 4;
+		case PRM_TYPE_LSFT4: *coords = prm.lsft4->coords; *texture = prm.lsft4->texture; return 4;
+		case PRM_TYPE_LSG3: *coords = prm.lsg3->coords; return 3;
+		case PRM_TYPE_LSGT3: *coords = prm.lsgt3->coords; *texture = prm.lsgt3->texture; return 3;
+		case PRM_TYPE_LSG4: *coords = prm.lsg4->coords; return 4;
+		case PRM_TYPE_LSGT4: *coords = prm.lsgt4->coords; *texture = prm.lsgt4->texture; return 4;
+		case PRM_TYPE_TSPR:
+		case PRM_TYPE_BSPR: *coords = &prm.spr->coord; *texture = prm.spr->texture; return 1;
+		default: *coords = NULL; return 0;
+	}
+}
+
+static int16_t *object_primitive_texture(Prm prm) {
+	switch (prm.primitive->type) {
+		case PRM_TYPE_FT3: return &prm.ft3->texture;
+		case PRM_TYPE_FT4: return &prm.ft4->texture;
+		case PRM_TYPE_GT3: return &prm.gt3->texture;
+		case PRM_TYPE_GT4: return &prm.gt4->texture;
+		case PRM_TYPE_LSFT3: return &prm.lsft3->texture;
+		case PRM_TYPE_LSFT4: return &prm.lsft4->texture;
+		case PRM_TYPE_LSGT3: return &prm.lsgt3->texture;
+		case PRM_TYPE_LSGT4: return &prm.lsgt4->texture;
+		case PRM_TYPE_TSPR:
+		case PRM_TYPE_BSPR: return &prm.spr->texture;
+		default: return NULL;
+	}
+}
+
+int object_tris_len(Object *object) {
+	Prm poly = {.primitive = object->primitives};
+	int tris_len = 0;
+	for (int i = 0; i < object->primitives_len; i++) {
+		int16_t *coords;
+		int16_t texture;
+		int coords_len = object_primitive_coords(poly, &coords, &texture);
+		tris_len += coords_len == 4 || coords_len == 1 ? 2 : (coords_len == 3 ? 1 : 0);
+		poly.ptr += object_primitive_size(poly.primitive->type);
+	}
+	return tris_len;
+}
+
+// Vertex clustering: all vertices that fall into the same cell of a grid
+// over the object's bounding box are merged into their average position and
+// primitives that collapse are dropped. The uvs are stored per primitive, 
+// so they survive this as is. To keep texture seams intact, vertices that 
+// are shared by primitives with different textures and sprite positions 
+// are never merged.
+
+static Object *object_generate_lod(Object *object, int grid_size) {
+	vec3_t extent = vec3_sub(object->bounds_max, object->bounds_min);
+	float cell_size = maxfloat(maxfloat(extent.x, extent.y), extent.z) / grid_size;
+	if (cell_size <= 0 || object->vertices_len == 0) {
+		return NULL;
+	}
+
+	int vertices_len = object->vertices_len;
+	uint8_t *temp = mem_temp_alloc(vertices_len * (
+		sizeof(int16_t) * 2 + // vertex texture, vertex cluster
+		sizeof(uint8_t) + // vertex is pinned
+		sizeof(int32_t) * 3 + // cluster cell
+		sizeof(vec3_t) + // cluster position sum
+		sizeof(int16_t) // cluster vertex count
+	));
+	int16_t *vertex_texture = (int16_t *)temp;
+	int16_t *vertex_cluster = vertex_texture + vertices_len;
+	int32_t *cluster_cell = (int32_t *)(vertex_cluster + vertices_len);
+	vec3_t *cluster_sum = (vec3_t *)(cluster_cell + vertices_len * 3);
+	int16_t *cluster_count = (int16_t *)(cluster_sum + vertices_len);
+	uint8_t *vertex_pinned = (uint8_t *)(cluster_count + vertices_len);
+
+	// Find all vertices on texture seams
+	for (int i = 0; i < vertices_len; i++) {
+		vertex_texture[i] = -2;
+		vertex_pinned[i] = false;
+	}
+
+	Prm poly = {.primitive = object->primitives};
+	for (int i = 0; i < object->primitives_len; i++) {
+		int prm_size = object_primitive_size(poly.primitive->type);
+		if (prm_size == 0) {
+			mem_temp_free(temp);
+			return NULL;
+		}
+
+		int16_t *coords;
+		int16_t texture;
+		int coords_len = object_primitive_coords(poly, &coords, &texture);
+		for (int c = 0; c < coords_len; c++) {
+			int16_t v = coords[c];
+			if (v < 0 || v >= vertices_len) {
+				mem_temp_free(temp);
+				return NULL;
+			}
+			if (coords_len == 1) {
+				vertex_pinned[v] = true;
+			}
+			else if (vertex_texture[v] == -2) {
+				vertex_texture[v] = texture;
+			}
+			else if (vertex_texture[v] != texture) {
+				vertex_pinned[v] = true;
+			}
+		}
+		poly.ptr += prm_size;
+	}
+
+	// Assign vertices to clusters
+	int clusters_len = 0;
+	for (int i = 0; i < vertices_len; i++) {
+		vec3_t rel = vec3_sub(object->vertices[i], object->bounds_min);
+		int32_t cx = rel.x / cell_size;
+		int32_t cy = rel.y / cell_size;
+		int32_t cz = rel.z / cell_size;
+
+		int cluster = -1;
+		if (!vertex_pinned[i]) {
+			for (int j = 0; j < clusters_len; j++) {
+				if (
+					cluster_count[j] > 0 && 
+					cluster_cell[j * 3 + 0] == cx &&
+					cluster_cell[j * 3 + 1] == cy &&
+					cluster_cell[j * 3 + 2] == cz
+				) {
+					cluster = j;
+					break;
+				}
+			}
+		}
+
+		if (cluster == -1) {
+			cluster = clusters_len++;
+			cluster_cell[cluster * 3 + 0] = cx;
+			cluster_cell[cluster * 3 + 1] = cy;
+			cluster_cell[cluster * 3 + 2] = cz;
+			cluster_sum[cluster] = vec3(0, 0, 0);
+
+			// Pinned vertices get a cluster of their own that nobody else
+			// can join
+			cluster_count[cluster] = vertex_pinned[i] ? -1 : 0;
+		}
+
+		vertex_cluster[i] = cluster;
+		cluster_sum[cluster] = vec3_add(cluster_sum[cluster], object->vertices[i]);
+		if (cluster_count[cluster] >= 0) {
+			cluster_count[cluster]++;
+		}
+	}
+
+	// Build the simplified object; normals and bounds are shared with the 
+	// original
+	Object *lod = mem_bump(sizeof(Object));
+	*lod = *object;
+	lod->next = NULL;
+	for (int i = 0; i < OBJECT_LOD_MAX; i++) {
+		lod->lods[i] = NULL;
+	}
+
+	// Kept primitives take their palette slots with them
+	lod->color_slots = object->color_slots
+		? mem_bump(sizeof(uint16_t) * object->primitives_len * 4)
+		: NULL;
+
+	lod->vertices_len = clusters_len;
+	lod->vertices = mem_bump_uninit(clusters_len * sizeof(vec3_t));
+	for (int i = 0; i < clusters_len; i++) {
+		int count = cluster_count[i] > 0 ? cluster_count[i] : 1;
+		lod->vertices[i] = vec3_divf(cluster_sum[i], count);
+	}
+
+	lod->primitives = mem_mark();
+	lod->primitives_len = 0;
+	poly.primitive = object->primitives;
+	for (int i = 0; i < object->primitives_len; i++) {
+		int prm_size = object_primitive_size(poly.primitive->type);
+		Prm copy = {.ptr = mem_bump_uninit(prm_size)};
+		memcpy(copy.ptr, poly.ptr, prm_size);
+
+		int16_t *coords;
+		int16_t texture;
+		int coords_len = object_primitive_coords(copy, &coords, &texture);
+		for (int c = 0; c < coords_len; c++) {
+			coords[c] = vertex_cluster[coords[c]];
+		}
+
+		// Drop triangles with two merged corners and quads with less than 
+		// three distinct corners left
+		int distinct = coords_len;
+		for (int c = 1; c < coords_len; c++) {
+			for (int d = 0; d < c; d++) {
+				if (coords[c] == coords[d]) {
+					distinct--;
+					break;
+				}
+			}
+		}
+		if (coords_len >= 3 && distinct < 3) {
+			mem_reset(copy.ptr);
+		}
+		else {
+			if (lod->color_slots) {
+				memcpy(&lod->color_slots[lod->primitives_len * 4], &object->color_slots[i * 4], sizeof(uint16_t) * 4);
+			}
+			lod->primitives_len++;
+		}
+		poly.ptr += prm_size;
+	}
+
+	mem_temp_free(temp);
+	return lod;
+}
+
+void object_generate_lods(Object *object) {
+	int tris_len = object_tris_len(object);
+	if (tris_len <= OBJECT_LOD_MIN_TRIS) {
+		return;
+	}
+
+	// Only keep levels that save a meaningful number of triangles over the 
+	// previous one
+	int grid_sizes[OBJECT_LOD_MAX] = {OBJECT_LOD_1_GRID, OBJECT_LOD_2_GRID};
+	int prev_tris_len = tris_len;
+	for (int i = 0; i < OBJECT_LOD_MAX; i++) {
+		void *mark = mem_mark();
+		Object *lod = object_generate_lod(object, grid_sizes[i]);
+		if (!lod) {
+			break;
+		}
+
+		int lod_tris_len = object_tris_len(lod);
+		if (lod_tris_len > prev_tris_len * 0.8) {
+			mem_reset(mark);
+			continue;
+		}
+		object->lods[i] = lod;
+		object_bake(lod);
+		prev_tris_len = lod_tris_len;
+	}
+}
+
+bool object_is_visible(Object *object, mat4_t *mat, frustum_t *frustum) {
+	// We assume mat is a plain rotation + translation, so the radius of the
+	// bounding sphere stays the same in world space
+	vec3_t center = vec3_transform(object->bounds_center, mat);
+	return frustum_test_sphere(frustum, center, object->radius);
+}
+
+// Animated colors are set in the render palette instead of the primitives.
+// Only gouraud shaded primitives have a color per vertex and can use them.
+void object_set_color_slot(Object *object, int primitive, int vertex, uint16_t slot) {
+	error_if(primitive >= object->primitives_len || vertex >= 4, "Invalid color slot for %s", object->name);
+	if (!object->color_slots) {
+		object->color_slots = mem_bump(sizeof(uint16_t) * object->primitives_len * 4);
+	}
+	object->color_slots[primitive * 4 + vertex] = slot;
+
+	// The slots are part of the baked vertices; the object has to be baked
+	// again after setting them. The old mesh stays allocated until the next
+	// reset.
+	object->mesh = RENDER_NO_MESH;
+}
+
+static inline uint16_t object_color_slot(Object *object, int primitive, int vertex) {
+	return object->color_slots ? object->color_slots[primitive * 4 + vertex] : 0;
+}
+
+static void object_push_primitives(Object *object, bool push_tris, bool push_sprites);
+
+// Bakes all tris of the object into a static render mesh, if the renderer
+// supports it. Sprites face the camera, so these are still pushed each frame.
+// Only objects whose vertices and colors don't change after this may be
+// baked; colors that change belong in palette slots, which are resolved
+// when the mesh is drawn.
+// Pushing the tris here loads all textures they use, so textures of baked
+// objects are loaded with the object, not on first use.
+void object_bake(Object *object) {
+	object->mesh = RENDER_NO_MESH;
+	object->sprites_len = 0;
+
+	Prm poly = {.primitive = object->primitives};
+	for (int i = 0; i < object->primitives_len; i++) {
+		if (poly.primitive->type == PRM_TYPE_TSPR || poly.primitive->type == PRM_TYPE_BSPR) {
+			object->sprites_len++;
+		}
+		poly.ptr += object_primitive_size(poly.primitive->type);
+	}
+
+	int tris_len = object_tris_len(object) - object->sprites_len * 2;
+	if (tris_len == 0 || !render_mesh_begin(tris_len)) {
+		return;
+	}
+	object_push_primitives(object, true, false);
+	object->mesh = render_mesh_end();
+}
 
 void object_draw(Object *object, mat4_t *mat) {
+	render_set_model_mat(mat);
+
+	if (object->mesh != RENDER_NO_MESH) {
+		render_mesh_draw(object->mesh);
+		if (object->sprites_len) {
+			object_push_primitives(object, false, true);
+		}
+		return;
+	}
+	object_push_primitives(object, true, true);
+}
+
+static void object_push_primitives(Object *object, bool push_tris, bool push_sprites) {
 	vec3_t *vertex = object->vertices;
 	tris_t _tris;
 
 	Prm poly = {.primitive = object->primitives};
 	int primitives_len = object->primitives_len;
 
-	render_set_model_mat(mat);
-
 	// TODO: check for PRM_SINGLE_SIDED
 
 	for (int i = 0; i < primitives_len; i++) {
@@ -466,6 +925,13 @@ void object_draw(Object *object, mat4_t *mat) {
 		int coord1;
 		int coord2;
 		int coord3;
+
+		bool is_sprite = poly.primitive->type == PRM_TYPE_TSPR || poly.primitive->type == PRM_TYPE_BSPR;
+		if (is_sprite ? !push_sprites : !push_tris) {
+			poly.ptr += object_primitive_size(poly.primitive->type);
+			continue;
+		}
+
 		switch (poly.primitive->type) {
 		case PRM_TYPE_GT3:
 			coord0 = poly.gt3->coords[0];
@@ -475,17 +941,20 @@ void object_draw(Object *object, mat4_t *mat) {
 			_tris.vertices[0] = (vertex_t){
 				vertex[coord2],
 				(vec2_t){poly.gt3->u2, poly.gt3->v2},
-				poly.gt3->colour[2]
+				poly.gt3->colour[2],
+				object_color_slot(object, i, 2)
 			};
 			_tris.vertices[1] = (vertex_t){
 				vertex[coord1],
 				(vec2_t){poly.gt3->u1, poly.gt3->v1},
-				poly.gt3->colour[1]
+				poly.gt3->colour[1],
+				object_color_slot(object, i, 1)
 			};
 			_tris.vertices[2] =  (vertex_t){
 				vertex[coord0],
 				(vec2_t){poly.gt3->u0, poly.gt3->v0},
-				poly.gt3->colour[0]
+				poly.gt3->colour[0],
+				object_color_slot(object, i, 0)
 			};
 			render_push_tris(_tris, poly.gt3->texture);
 
@@ -501,34 +970,40 @@ void object_draw(Object *object, mat4_t *mat) {
 			_tris.vertices[0] = (vertex_t) {
 				vertex[coord2],
 				(vec2_t) {poly.gt4->u2, poly.gt4->v2},
-				poly.gt4->colour[2]
+				poly.gt4->colour[2],
+				object_color_slot(object, i, 2)
 			};
 			_tris.vertices[1] = (vertex_t) {
 				vertex[coord1],
 				(vec2_t) {poly.gt4->u1, poly.gt4->v1},
-				poly.gt4->colour[1]
+				poly.gt4->colour[1],
+				object_color_slot(object, i, 1)
 			};
 			_tris.vertices[2] = (vertex_t) {
 				vertex[coord0],
 				(vec2_t) {poly.gt4->u0, poly.gt4->v0},
-				poly.gt4->colour[0]
+				poly.gt4->colour[0],
+				object_color_slot(object, i, 0)
 			};
 			render_push_tris(_tris, poly.gt4->texture);
 
 			_tris.vertices[0] = (vertex_t) {
 				vertex[coord2],
 				(vec2_t){poly.gt4->u2, poly.gt4->v2},
-				poly.gt4->colour[2]
+				poly.gt4->colour[2],
+				object_color_slot(object, i, 2)
 			};
 			_tris.vertices[1] = (vertex_t) {
 				vertex[coord3],
 				(vec2_t){poly.gt4->u3, poly.gt4->v3},
-				poly.gt4->colour[3]
+				poly.gt4->colour[3],
+				object_color_slot(object, i, 3)
 			};
 			_tris.vertices[2] = (vertex_t) {
 				vertex[coord1],
 				(vec2_t){poly.gt4->u1, poly.gt4->v1},
-				poly.gt4->colour[1]
+				poly.gt4->colour[1],
+				object_color_slot(object, i, 1)
 			};
 			
 			render_push_tris(_tris, poly.gt4->texture);
@@ -612,17 +1087,20 @@ void object_draw(Object *object, mat4_t *mat) {
 			_tris.vertices[0] = (vertex_t) {
 				vertex[coord2],
 				(vec2_t){0, 0},
-				poly.g3->colour[2]
+				poly.g3->colour[2],
+				object_color_slot(object, i, 2)
 			};
 			_tris.vertices[1] = (vertex_t) {
 				vertex[coord1],
 				(vec2_t){0, 0},
-				poly.g3->colour[1]
+				poly.g3->colour[1],
+				object_color_slot(object, i, 1)
 			};
 			_tris.vertices[2] = (vertex_t) {
 				vertex[coord0],
 				(vec2_t){0, 0},
-				poly.g3->colour[0]
+				poly.g3->colour[0],
+				object_color_slot(object, i, 0)
 			};
 			render_push_tris(_tris, RENDER_NO_TEXTURE);
 
@@ -638,34 +1116,40 @@ void object_draw(Object *object, mat4_t *mat) {
 			_tris.vertices[0] = (vertex_t) {
 				vertex[coord2],
 				(vec2_t){0, 0},
-				poly.g4->colour[2]
+				poly.g4->colour[2],
+				object_color_slot(object, i, 2)
 			};
 			_tris.vertices[1] = (vertex_t) {
 				vertex[coord1],
 				(vec2_t){0, 0},
-				poly.g4->colour[1]
+				poly.g4->colour[1],
+				object_color_slot(object, i, 1)
 			};
 			_tris.vertices[2] = (vertex_t) {
 				vertex[coord0],
 				(vec2_t){0, 0},
-				poly.g4->colour[0]
+				poly.g4->colour[0],
+				object_color_slot(object, i, 0)
 			};
 			render_push_tris(_tris, RENDER_NO_TEXTURE);
 
 			_tris.vertices[0] = (vertex_t) {
 				vertex[coord2],
 				(vec2_t){0, 0},
-				poly.g4->colour[2]
+				poly.g4->colour[2],
+				object_color_slot(object, i, 2)
 			};
 			_tris.vertices[1] = (vertex_t) {
 				vertex[coord3],
 				(vec2_t){0, 0},
-				poly.g4->colour[3]
+				poly.g4->colour[3],
+				object_color_slot(object, i, 3)
 			};
 			_tris.vertices[2] = (vertex_t) {
 				vertex[coord1],
 				(vec2_t){0, 0},
-				poly.g4->colour[1]
+				poly.g4->colour[1],
+				object_color_slot(object, i, 1)
 			};
 			render_push_tris(_tris, RENDER_NO_TEXTURE);
 
@@ -327,6 +327,15 @@ typedef struct InfiniteLight {
 #define PRM_TYPE_SPOT_LIGHT        23
 
 
+// Objects with more triangles than this get simplified versions generated
+// by object_generate_lods(). The grid sizes give the number of vertex 
+// clusters along the longest side of the bounding box for each level.
+
+#define OBJECT_LOD_MAX 2
+#define OBJECT_LOD_MIN_TRIS 64
+#define OBJECT_LOD_1_GRID 24
+#define OBJECT_LOD_2_GRID 10
+
 typedef struct Object {
 	char name[16];
 
@@ -341,6 +350,14 @@ typedef struct Object {
 	Primitive *primitives; // Pointer to Z Sort Primitives
 
 	vec3_t origin;
+	vec3_t bounds_min; // Object space bounding box
+	vec3_t bounds_max;
+	vec3_t bounds_center; // Object space bounding sphere
+	float radius;
+	struct Object *lods[OBJECT_LOD_MAX]; // Simplified versions; NULL if none
+	uint16_t *color_slots; // Render palette slot for each primitive vertex; NULL if none
+	uint16_t mesh; // All tris baked into a render mesh; RENDER_NO_MESH if none
+	int16_t sprites_len; // Number of sprite primitives, drawn separately from the mesh
 	int32_t extent; // Flags for object characteristics
 	int16_t flags; // Next object in list
 	struct Object *next; // Next object in list
@@ -379,5 +396,10 @@ typedef union Prm {
 
 Object *objects_load(char *name, texture_list_t tl);
 void object_draw(Object *object, mat4_t *mat);
+void object_bake(Object *object);
+void object_generate_lods(Object *object);
+void object_set_color_slot(Object *object, int primitive, int vertex, uint16_t slot);
+int object_tris_len(Object *object);
+bool object_is_visible(Object *object, mat4_t *mat, frustum_t *frustum);
 
 #endif
@@ -0,0 +1,213 @@
+#include <stdlib.h>
+
+#include "../utils.h"
+
+#include "pack.h"
+
+typedef struct {
+	pack_header_t *header;
+	uint32_t size;
+} pack_mapped_t;
+
+static const char *pack_extensions[PACK_KIND_MAX] = {
+	[PACK_TEXTURES] = "tex.pak",
+	[PACK_TEXTURES_SEMI_TRANS] = "texst.pak",
+	[PACK_TRACK_TILES] = "tiles.pak",
+	[PACK_OBJECTS] = "obj.pak",
+	[PACK_TRACK_FACES] = "faces.pak",
+};
+
+static pack_mapped_t mapped[PACK_MAPPED_MAX];
+static uint32_t mapped_len;
+
+static struct {
+	FILE *file;
+	pack_header_t header;
+	pack_image_t *images;
+	uint32_t images_len;
+} writer;
+
+
+static bool pack_path(char *path, uint32_t path_size, const char *source, pack_kind_t kind) {
+	error_if(kind >= PACK_KIND_MAX, "Invalid pack kind %d", kind);
+	int len = snprintf(path, path_size, "%s.%s", source, pack_extensions[kind]);
+	return len > 0 && len < path_size;
+}
+
+// Fills in the size and modification time of the source and dep; false if
+// one of them doesn't exist.
+static bool pack_inputs(pack_input_t inputs[PACK_INPUTS_MAX], const char *source, const char *dep) {
+	const char *paths[PACK_INPUTS_MAX] = {source, dep};
+	memset(inputs, 0, sizeof(pack_input_t) * PACK_INPUTS_MAX);
+	for (int i = 0; i < PACK_INPUTS_MAX && paths[i]; i++) {
+		inputs[i].size = file_size((char *)paths[i]);
+		inputs[i].mtime = file_mtime((char *)paths[i]);
+		if (inputs[i].size < 0 || inputs[i].mtime < 0) {
+			return false;
+		}
+	}
+	return true;
+}
+
+pack_header_t *pack_map(const char *source, const char *dep, pack_kind_t kind, uint32_t item_size) {
+	char path[256];
+	pack_input_t inputs[PACK_INPUTS_MAX];
+	if (!pack_inputs(inputs, source, dep) || !pack_path(path, sizeof(path), source, kind)) {
+		return NULL;
+	}
+	if (mapped_len >= PACK_MAPPED_MAX) {
+		printf("pack: can't map %s, %d packs mapped already\n", path, mapped_len);
+		return NULL;
+	}
+
+	uint32_t size;
+	pack_header_t *header = (pack_header_t *)file_map(path, &size);
+	if (!header) {
+		return NULL;
+	}
+	if (
+		size < sizeof(pack_header_t) ||
+		header->magic != PACK_MAGIC ||
+		header->version != PACK_VERSION ||
+		header->kind != kind ||
+		header->item_size != item_size ||
+		memcmp(header->inputs, inputs, sizeof(inputs)) != 0 ||
+		header->data_size != size - sizeof(pack_header_t)
+	) {
+		printf("pack: %s is stale\n", path);
+		file_unmap((uint8_t *)header, size);
+		return NULL;
+	}
+
+	printf("pack: %s\n", path);
+	mapped[mapped_len++] = (pack_mapped_t){.header = header, .size = size};
+	return header;
+}
+
+void *pack_data(pack_header_t *pack) {
+	return pack + 1;
+}
+
+image_t pack_image(pack_header_t *pack, uint32_t index) {
+	error_if(index >= pack->len, "Image %d not in pack of len %d", index, pack->len);
+	pack_image_t *images = pack_data(pack);
+	return (image_t){
+		.width = images[index].width,
+		.height = images[index].height,
+		.pixels = (rgba_t *)((uint8_t *)images + images[index].offset)
+	};
+}
+
+void pack_unmap(pack_header_t *pack) {
+	for (int i = 0; i < mapped_len; i++) {
+		if (mapped[i].header == pack) {
+			file_unmap((uint8_t *)pack, mapped[i].size);
+			mapped_len--;
+			memmove(&mapped[i], &mapped[i + 1], sizeof(pack_mapped_t) * (mapped_len - i));
+			return;
+		}
+	}
+	die("Pack 0x%p not mapped", pack);
+}
+
+uint32_t pack_mapped_len(void) {
+	return mapped_len;
+}
+
+void pack_unmap_to(uint32_t len) {
+	error_if(len > mapped_len, "Invalid pack unmap len %d > %d", len, mapped_len);
+	for (int i = len; i < mapped_len; i++) {
+		file_unmap((uint8_t *)mapped[i].header, mapped[i].size);
+	}
+	mapped_len = len;
+}
+
+
+
+// Writing. The header is written last, so a pack that was cut short is
+// never taken as valid.
+
+bool pack_write_begin(const char *source, const char *dep, pack_kind_t kind, uint32_t item_size, uint32_t len) {
+	#if defined(__EMSCRIPTEN__)
+		// The file system lives in memory; a pack would just double the data
+		return false;
+	#endif
+
+	error_if(writer.file, "pack_write_begin() while writing a pack");
+
+	// pack_map() only fails for this reason when the pack wasn't even
+	// looked at; don't replace a pack that may be fresh
+	if (mapped_len >= PACK_MAPPED_MAX) {
+		return false;
+	}
+
+	char path[256];
+	writer.header = (pack_header_t){
+		.version = PACK_VERSION,
+		.kind = kind,
+		.item_size = item_size,
+		.len = len,
+	};
+	if (!pack_inputs(writer.header.inputs, source, dep) || !pack_path(path, sizeof(path), source, kind)) {
+		return false;
+	}
+
+	uint32_t source_size;
+	uint8_t *source_bytes = file_map((char *)source, &source_size);
+	if (!source_bytes) {
+		return false;
+	}
+	writer.header.source_hash = hash_bytes(HASH_INIT, source_bytes, source_size);
+	file_unmap(source_bytes, source_size);
+
+	writer.file = fopen(path, "wb");
+	if (!writer.file) {
+		printf("pack: can't write %s\n", path);
+		return false;
+	}
+	printf("pack: writing %s\n", path);
+
+	// Image lists start with a table of all images; filled in at the end
+	bool is_image_list = (kind == PACK_TEXTURES || kind == PACK_TEXTURES_SEMI_TRANS || kind == PACK_TRACK_TILES);
+	writer.images = is_image_list ? calloc(len, sizeof(pack_image_t)) : NULL;
+	writer.images_len = 0;
+
+	fwrite(&writer.header, sizeof(pack_header_t), 1, writer.file);
+	if (writer.images) {
+		fwrite(writer.images, sizeof(pack_image_t), len, writer.file);
+		writer.header.data_size = sizeof(pack_image_t) * len;
+	}
+	return true;
+}
+
+void pack_write_image(image_t *image) {
+	error_if(!writer.images || writer.images_len >= writer.header.len, "Invalid pack image %d", writer.images_len);
+	writer.images[writer.images_len++] = (pack_image_t){
+		.width = image->width,
+		.height = image->height,
+		.offset = writer.header.data_size
+	};
+	pack_write_bytes(image->pixels, image->width * image->height * sizeof(rgba_t));
+}
+
+void pack_write_bytes(void *bytes, uint32_t size) {
+	error_if(!writer.file, "pack_write_bytes() without pack_write_begin()");
+	fwrite(bytes, 1, size, writer.file);
+	writer.header.data_size += size;
+}
+
+void pack_write_end(void) {
+	error_if(!writer.file, "pack_write_end() without pack_write_begin()");
+
+	writer.header.magic = PACK_MAGIC;
+	fseek(writer.file, 0, SEEK_SET);
+	fwrite(&writer.header, sizeof(pack_header_t), 1, writer.file);
+	if (writer.images) {
+		error_if(writer.images_len != writer.header.len, "Expected %d pack images, got %d", writer.header.len, writer.images_len);
+		fwrite(writer.images, sizeof(pack_image_t), writer.images_len, writer.file);
+		free(writer.images);
+		writer.images = NULL;
+	}
+	fclose(writer.file);
+	writer.file = NULL;
+}
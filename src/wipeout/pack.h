@@ -0,0 +1,74 @@
+#ifndef PACK_H
+#define PACK_H
+
+#include "../types.h"
+#include "image.h"
+
+// Packs hold assets that are already decoded into their runtime layout, so
+// they can be used without parsing. Each source file gets its own pack next
+// to it, e.g. track02/library.cmp -> track02/library.cmp.tiles.pak, written
+// the first time the source is loaded. Some packs are built from a second
+// input file as well, e.g. the tiles also depend on the library.ttf. A pack
+// is ignored and rewritten if its version, the size or modification time of
+// any of its inputs or the size of the stored struct don't match anymore.
+// The pack also keeps a hash of the source's contents, so assets can be
+// told apart by content without reading the source.
+
+#define PACK_MAGIC 0x4b415057 // "WPAK"
+#define PACK_VERSION 3
+#define PACK_MAPPED_MAX 128
+#define PACK_INPUTS_MAX 2 // The source and an optional dependency
+
+typedef enum {
+	PACK_TEXTURES,            // pack_image_t list; .cmp or .tim
+	PACK_TEXTURES_SEMI_TRANS, // pack_image_t list; .tim with semi transparency
+	PACK_TRACK_TILES,         // pack_image_t list; high, med and far res tiles
+	PACK_OBJECTS,             // Object list, pointers stored as offsets
+	PACK_TRACK_FACES,         // track_face_t array
+	PACK_KIND_MAX
+} pack_kind_t;
+
+typedef struct {
+	int64_t mtime;
+	int32_t size;
+	uint32_t reserved;
+} pack_input_t;
+
+typedef struct {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t kind;
+	uint32_t item_size; // sizeof() the stored struct, to catch layout changes
+	uint32_t len; // Number of items
+	uint32_t data_size; // Bytes following the header
+	pack_input_t inputs[PACK_INPUTS_MAX]; // Unused ones are zeroed
+	uint64_t source_hash; // hash_bytes() of the source file
+} pack_header_t;
+
+typedef struct {
+	uint32_t width;
+	uint32_t height;
+	uint32_t offset; // Of the pixels, from the start of the data
+} pack_image_t;
+
+// Returns the mapped pack for this source or NULL if there's none, it's
+// stale or PACK_MAPPED_MAX packs are mapped already. dep is the path of a
+// second input the pack is built from, or NULL. Packs that are not unmapped
+// by the loader stay mapped until pack_unmap_to() is called with a len from
+// before they were mapped, when the scene is unloaded.
+pack_header_t *pack_map(const char *source, const char *dep, pack_kind_t kind, uint32_t item_size);
+void *pack_data(pack_header_t *pack);
+image_t pack_image(pack_header_t *pack, uint32_t index); // Pixels point into the mapping
+void pack_unmap(pack_header_t *pack);
+uint32_t pack_mapped_len(void);
+void pack_unmap_to(uint32_t len);
+
+// Writing a pack. pack_write_begin() returns false if packs can't be written
+// here, or if no more packs can be mapped, in which case the existing one may
+// well be fresh. The other calls must only be made if it returned true.
+bool pack_write_begin(const char *source, const char *dep, pack_kind_t kind, uint32_t item_size, uint32_t len);
+void pack_write_image(image_t *image);
+void pack_write_bytes(void *bytes, uint32_t size);
+void pack_write_end(void);
+
+#endif
@@ -3,6 +3,7 @@
 #include "../platform.h"
 #include "../system.h"
 #include "../utils.h"
+#include "../occlusion.h"
 
 #include "object.h"
 #include "track.h"
@@ -104,11 +105,19 @@ void race_update() {
 
 	// Draw 3D
 	render_set_view(g.camera.position, g.camera.angle);
+	track_draw_occluders(&g.camera);
 
+	// Draw all fully opaque geometry first, so that the sky only fills the 
+	// remaining background. Geometry that is partially faded out needs to
+	// be drawn on top of the sky.
 	render_set_cull_backface(false);
-	scene_draw(&g.camera);	
-	track_draw(&g.camera);
+	scene_draw(&g.camera, false);	
+	track_draw(&g.camera, false);
+	scene_draw_sky(&g.camera);
+	scene_draw(&g.camera, true);	
+	track_draw(&g.camera, true);
 	render_set_cull_backface(true);
+	occlusion_end();
 
 	ships_draw();
 	droid_draw(&g.droid);
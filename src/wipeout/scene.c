@@ -1,6 +1,7 @@
 #include "../mem.h"
 #include "../utils.h"
 #include "../system.h"
+#include "../occlusion.h"
 
 #include "object.h"
 #include "track.h"
@@ -17,6 +18,16 @@
 #define SCENE_OIL_PUMPS_MAX 2
 #define SCENE_RED_LIGHTS_MAX 4
 #define SCENE_STANDS_MAX 20
+#define SCENE_AURORA_PRIMITIVES_MAX 80
+#define SCENE_AURORA_COLORS_MAX 320
+
+#define SCENE_BVH_LEAF_SIZE 4
+#define SCENE_BVH_STACK_MAX 64
+
+// Objects smaller than this on screen (diameter in pixels) use their 
+// simplified versions
+#define SCENE_LOD_1_SIZE 160.0
+#define SCENE_LOD_2_SIZE 48.0
 
 static Object *scene_objects;
 static Object *sky_object;
@@ -38,23 +49,59 @@ typedef struct {
 static scene_stand_t stands[SCENE_STANDS_MAX];
 static int stands_len;
 
+// Static bounding volume hierarchy over all scene objects, built once in
+// scene_load(). Leaves reference a range in bvh_items.
+
+typedef struct {
+	Object *object;
+	vec3_t center; // World space bounding sphere
+	float radius;
+	int16_t tris_len[OBJECT_LOD_MAX + 1]; // Full detail and each lod
+} scene_bvh_item_t;
+
+typedef struct {
+	vec3_t min;
+	vec3_t max;
+	int16_t left; // Child node indices; -1 for leaves
+	int16_t right;
+	int16_t start; // Item range for leaves
+	int16_t len;
+} scene_bvh_node_t;
+
+static scene_bvh_item_t *bvh_items;
+static int bvh_items_len;
+static scene_bvh_node_t *bvh_nodes;
+static int bvh_nodes_len;
+
+static scene_draw_stats_t draw_stats;
+
+static uint16_t red_light_color_slot;
+static uint16_t start_boom_color_slots; // One for each of the three lights
+
+// The aurora colors depend only on the sky vertex; each animated vertex gets
+// a palette slot
 static struct {
 	bool enabled;
-	GT4	*primitives[80];
-	int16_t *coords[80];
-	int16_t grey_coords[80];	
+	uint16_t color_slots;
+	int16_t coords[SCENE_AURORA_COLORS_MAX]; // Sky vertex for each slot
+	int colors_len;
 } aurora_borealis;
 
-void scene_pulsate_red_light(Object *obj);
+void scene_pulsate_red_lights(void);
 void scene_move_oil_pump(Object *obj);
 void scene_update_aurora_borealis(void);
+static void scene_bvh_build(void);
+static int16_t scene_bvh_build_node(int start, int len);
+static Object *scene_object_lod(Object *obj, int level);
 
 void scene_load(const char *base_path, float sky_y_offset) {
 	texture_list_t scene_textures = image_get_compressed_textures(get_path(base_path, "scene.cmp"));
+	texture_list_prefetch(scene_textures);
 	scene_objects = objects_load(get_path(base_path, "scene.prm"), scene_textures);
 	
 	texture_list_t sky_textures = image_get_compressed_textures(get_path(base_path, "sky.cmp"));
 	sky_object = objects_load(get_path(base_path, "sky.prm") , sky_textures);
+	object_bake(sky_object);
 	sky_offset = vec3(0, sky_y_offset, 0);
 
 	// Collect all objects that need to be updated each frame
@@ -62,6 +109,8 @@ void scene_load(const char *base_path, float sky_y_offset) {
 	oil_pumps_len = 0;
 	red_lights_len = 0;
 	stands_len = 0;
+	red_light_color_slot = render_palette_alloc(1);
+	start_boom_color_slots = render_palette_alloc(3);
 
 	Object *obj = scene_objects;
 	while (obj) {
@@ -70,10 +119,18 @@ void scene_load(const char *base_path, float sky_y_offset) {
 		if (str_starts_with(obj->name, "start")) {
 			error_if(start_booms_len >= SCENE_START_BOOMS_MAX, "SCENE_START_BOOMS_MAX reached");
 			start_booms[start_booms_len++] = obj;
+			for (int i = 0; i < 3; i++) {
+				for (int v = 0; v < 4; v++) {
+					object_set_color_slot(obj, i, v, start_boom_color_slots + i);
+				}
+			}
 		}
 		else if (str_starts_with(obj->name, "redl")) {
 			error_if(red_lights_len >= SCENE_RED_LIGHTS_MAX, "SCENE_RED_LIGHTS_MAX reached");
 			red_lights[red_lights_len++] = obj;
+			for (int v = 0; v < 4; v++) {
+				object_set_color_slot(obj, 0, v, red_light_color_slot);
+			}
 		}
 		else if (str_starts_with(obj->name, "donkey")) {
 			error_if(oil_pumps_len >= SCENE_OIL_PUMPS_MAX, "SCENE_OIL_PUMPS_MAX reached");
@@ -90,9 +147,167 @@ void scene_load(const char *base_path, float sky_y_offset) {
 		obj = obj->next;
 	}
 
+	scene_bvh_build();
 	aurora_borealis.enabled = false;
 }
 
+static void scene_bvh_build(void) {
+	bvh_items_len = 0;
+	for (Object *obj = scene_objects; obj; obj = obj->next) {
+		bvh_items_len++;
+	}
+
+	bvh_items = mem_bump(sizeof(scene_bvh_item_t) * bvh_items_len);
+	bvh_nodes = mem_bump(sizeof(scene_bvh_node_t) * maxint(1, bvh_items_len * 2));
+	bvh_nodes_len = 0;
+
+	int tris_len = 0;
+	int tris_lod_len[OBJECT_LOD_MAX] = {0};
+	int lod_objects_len = 0;
+
+	int i = 0;
+	for (Object *obj = scene_objects; obj; obj = obj->next, i++) {
+		scene_bvh_item_t *item = &bvh_items[i];
+		item->object = obj;
+
+		// Oil pumps rotate around their origin; give them a sphere that 
+		// contains all possible orientations
+		if (str_starts_with(obj->name, "donkey")) {
+			item->center = obj->origin;
+			item->radius = vec3_len(obj->bounds_center) + obj->radius;
+		}
+		else {
+			item->center = vec3_transform(obj->bounds_center, &obj->mat);
+			item->radius = obj->radius;
+		}
+
+		// Start booms and red lights change colors through their palette
+		// slots, so all objects can be baked
+		object_bake(obj);
+		object_generate_lods(obj);
+
+		item->tris_len[0] = object_tris_len(obj);
+		tris_len += item->tris_len[0];
+		for (int l = 0; l < OBJECT_LOD_MAX; l++) {
+			Object *lod = scene_object_lod(obj, l + 1);
+			item->tris_len[l + 1] = lod == obj ? item->tris_len[l] : object_tris_len(lod);
+			tris_lod_len[l] += item->tris_len[l + 1];
+		}
+		if (obj->lods[0] || obj->lods[1]) {
+			lod_objects_len++;
+		}
+	}
+
+	printf(
+		"scene: lods for %d of %d objects, tris %d; lod 1: %d (-%d); lod 2: %d (-%d)\n", 
+		lod_objects_len, bvh_items_len, tris_len,
+		tris_lod_len[0], tris_len - tris_lod_len[0],
+		tris_lod_len[1], tris_len - tris_lod_len[1]
+	);
+
+	if (bvh_items_len) {
+		scene_bvh_build_node(0, bvh_items_len);
+	}
+}
+
+// Returns the simplified version of an object for the given level, falling 
+// back to the next more detailed one, if it has none
+static Object *scene_object_lod(Object *obj, int level) {
+	for (int l = level - 1; l >= 0; l--) {
+		if (obj->lods[l]) {
+			return obj->lods[l];
+		}
+	}
+	return obj;
+}
+
+static float scene_bvh_item_center(scene_bvh_item_t *item, int axis) {
+	return axis == 0 ? item->center.x : (axis == 1 ? item->center.y : item->center.z);
+}
+
+// Reorders the items in start..start+len so that the one at nth is the one
+// that would be there if they were sorted by their center on the axis; all
+// items before it are smaller or equal, all after it larger or equal
+static void scene_bvh_select(int start, int len, int nth, int axis) {
+	int lo = start;
+	int hi = start + len - 1;
+	while (lo < hi) {
+		float pivot = scene_bvh_item_center(&bvh_items[(lo + hi) / 2], axis);
+		int i = lo;
+		int j = hi;
+		while (i <= j) {
+			while (scene_bvh_item_center(&bvh_items[i], axis) < pivot) {
+				i++;
+			}
+			while (scene_bvh_item_center(&bvh_items[j], axis) > pivot) {
+				j--;
+			}
+			if (i <= j) {
+				scene_bvh_item_t tmp = bvh_items[i];
+				bvh_items[i] = bvh_items[j];
+				bvh_items[j] = tmp;
+				i++;
+				j--;
+			}
+		}
+		if (nth <= j) {
+			hi = j;
+		}
+		else if (nth >= i) {
+			lo = i;
+		}
+		else {
+			break;
+		}
+	}
+}
+
+static int16_t scene_bvh_build_node(int start, int len) {
+	int16_t index = bvh_nodes_len++;
+	scene_bvh_node_t *node = &bvh_nodes[index];
+
+	// Bounds of all spheres; also include the origin, since that's what the
+	// draw distance is measured against
+	node->min = bvh_items[start].object->origin;
+	node->max = node->min;
+	for (int i = start; i < start + len; i++) {
+		scene_bvh_item_t *item = &bvh_items[i];
+		vec3_t o = item->object->origin;
+		node->min = vec3(
+			minfloat(node->min.x, minfloat(o.x, item->center.x - item->radius)),
+			minfloat(node->min.y, minfloat(o.y, item->center.y - item->radius)),
+			minfloat(node->min.z, minfloat(o.z, item->center.z - item->radius))
+		);
+		node->max = vec3(
+			maxfloat(node->max.x, maxfloat(o.x, item->center.x + item->radius)),
+			maxfloat(node->max.y, maxfloat(o.y, item->center.y + item->radius)),
+			maxfloat(node->max.z, maxfloat(o.z, item->center.z + item->radius))
+		);
+	}
+
+	node->start = start;
+	node->len = len;
+	node->left = -1;
+	node->right = -1;
+
+	if (len <= SCENE_BVH_LEAF_SIZE) {
+		return index;
+	}
+
+	// Split at the median of the item centers on the longest axis, so both
+	// halves get the same number of items and the tree stays balanced
+	vec3_t size = vec3_sub(node->max, node->min);
+	int axis = (size.x > size.y && size.x > size.z) ? 0 : (size.y > size.z ? 1 : 2);
+	int left_len = len / 2;
+	scene_bvh_select(start, len, start + left_len, axis);
+
+	int16_t left = scene_bvh_build_node(start, left_len);
+	int16_t right = scene_bvh_build_node(start + left_len, len - left_len);
+	bvh_nodes[index].left = left;
+	bvh_nodes[index].right = right;
+	return index;
+}
+
 void scene_init() {
 	scene_set_start_booms(0);
 	for (int i = 0; i < stands_len; i++) {
@@ -101,8 +316,8 @@ void scene_init() {
 }
 
 void scene_update() {
-	for (int i = 0; i < red_lights_len; i++) {
-		scene_pulsate_red_light(red_lights[i]);
+	if (red_lights_len) {
+		scene_pulsate_red_lights();
 	}
 	for (int i = 0; i < oil_pumps_len; i++) {
 		scene_move_oil_pump(oil_pumps[i]);
@@ -116,28 +331,98 @@ void scene_update() {
 	}
 }
 
-void scene_draw(camera_t *camera) {
-	// Sky
+void scene_draw_sky(camera_t *camera) {
+	// The sky is drawn after all opaque geometry, pinned to the far plane. 
+	// With the depth test it only fills the pixels that are still empty.
 	render_set_depth_write(false);
+	render_set_depth_far(true);
 	mat4_set_translation(&sky_object->mat, vec3_add(camera->position, sky_offset));
 	object_draw(sky_object, &sky_object->mat);
+	render_set_depth_far(false);
 	render_set_depth_write(true);
+}
 
-	// Nearby objects
+void scene_draw(camera_t *camera, bool faded) {
+	// Nearby objects in the view frustum
 	vec3_t cam_pos = camera->position;
-	Object *object = scene_objects;
-	float max_dist_sq = RENDER_FADEOUT_FAR * RENDER_FADEOUT_FAR;
-	while (object) {
-		vec3_t d = vec3_sub(cam_pos, object->origin);
-		float dist_sq = d.x * d.x + d.y * d.y + d.z * d.z;
-
-		if (dist_sq < max_dist_sq) {
-			object_draw(object, &object->mat);
+	vec2_t fadeout = render_fadeout();
+	float fadeout_near_sq = fadeout.x * fadeout.x;
+
+	// Fully opaque objects are all closer than the fade out near distance
+	float max_dist = faded ? fadeout.y : fadeout.x;
+	float max_dist_sq = max_dist * max_dist;
+	frustum_t frustum = render_frustum();
+
+	if (!faded) {
+		draw_stats.objects_drawn = 0;
+		draw_stats.objects_culled = bvh_items_len;
+		draw_stats.lod_tris_saved = 0;
+	}
+
+	// Scale from radius over distance to the object's diameter in pixels 
+	// for the 73.75deg vertical fov of the 3d projection
+	float lod_scale = render_size().y * 1.333;
+
+	int16_t stack[SCENE_BVH_STACK_MAX];
+	int stack_len = 0;
+	if (bvh_nodes_len) {
+		stack[stack_len++] = 0;
+	}
+
+	while (stack_len) {
+		scene_bvh_node_t *node = &bvh_nodes[stack[--stack_len]];
+
+		// Distance from the camera to the closest point of the node's box
+		vec3_t d = vec3(
+			maxfloat(maxfloat(node->min.x - cam_pos.x, 0), cam_pos.x - node->max.x),
+			maxfloat(maxfloat(node->min.y - cam_pos.y, 0), cam_pos.y - node->max.y),
+			maxfloat(maxfloat(node->min.z - cam_pos.z, 0), cam_pos.z - node->max.z)
+		);
+		if (
+			d.x * d.x + d.y * d.y + d.z * d.z >= max_dist_sq ||
+			!frustum_test_aabb(&frustum, node->min, node->max)
+		) {
+			continue;
+		}
+
+		if (node->left != -1) {
+			error_if(stack_len + 2 > SCENE_BVH_STACK_MAX, "SCENE_BVH_STACK_MAX reached");
+			stack[stack_len++] = node->right;
+			stack[stack_len++] = node->left;
+			continue;
+		}
+
+		for (int i = node->start; i < node->start + node->len; i++) {
+			scene_bvh_item_t *item = &bvh_items[i];
+			float dist = vec3_len(vec3_sub(cam_pos, item->center));
+			float far_dist = dist + item->radius;
+			if ((far_dist * far_dist >= fadeout_near_sq) != faded) {
+				continue;
+			}
+
+			// Same bounding sphere as the pass test above; the origin of an
+			// object may lie outside of it
+			if (
+				dist - item->radius < max_dist && 
+				frustum_test_sphere(&frustum, item->center, item->radius) &&
+				occlusion_test_aabb(
+					vec3_sub(item->center, vec3(item->radius, item->radius, item->radius)),
+					vec3_add(item->center, vec3(item->radius, item->radius, item->radius))
+				)
+			) {
+				float size = dist > 0 ? item->radius / dist * lod_scale : SCENE_LOD_1_SIZE;
+				int level = size < SCENE_LOD_2_SIZE ? 2 : (size < SCENE_LOD_1_SIZE ? 1 : 0);
+				object_draw(scene_object_lod(item->object, level), &item->object->mat);
+				draw_stats.lod_tris_saved += item->tris_len[0] - item->tris_len[level];
+				draw_stats.objects_drawn++;
+				draw_stats.objects_culled--;
+			}
 		}
-		
-		object = object->next;
 	}
+}
 
+scene_draw_stats_t scene_get_draw_stats(void) {
+	return draw_stats;
 }
 
 void scene_set_start_booms(int light_index) {
@@ -159,46 +444,42 @@ void scene_set_start_booms(int light_index) {
 		color = rgba(0x00, 0xff, 0x00, 0xff);
 	}
 
-	for (int i = 0; i < start_booms_len; i++) {
-		Prm libPoly = {.primitive = start_booms[i]->primitives};
-
-		for (int j = 1; j < light_index; j++) {
-			libPoly.gt4 += 1;
-		}
-
-		for (int j = 0; j < lights_len; j++) {
-			for (int v = 0; v < 4; v++) {
-				libPoly.gt4->colour[v].as_rgba.r = color.as_rgba.r;
-				libPoly.gt4->colour[v].as_rgba.g = color.as_rgba.g;
-				libPoly.gt4->colour[v].as_rgba.b = color.as_rgba.b;
-			}
-			libPoly.gt4 += 1;
-		}
+	// All start booms share the palette slots of their lights
+	int first = maxint(light_index - 1, 0);
+	for (int j = 0; j < lights_len; j++) {
+		render_set_palette_color(start_boom_color_slots + first + j, color);
 	}
 }
 
 
-void scene_pulsate_red_light(Object *obj) {
+void scene_pulsate_red_lights(void) {
 	float _v = sin(system_cycle_time() * M_PI * 2) * 128 + 128;
 	float _min = 0;
 	float _max = 255;
 	uint8_t r = _v > _max ? _max : _v < _min ? _min : _v;
-	Prm libPoly = {.primitive = obj->primitives};
-
-	for (int v = 0; v < 4; v++) {
-		libPoly.gt4->colour[v].as_rgba.r = r;
-		libPoly.gt4->colour[v].as_rgba.g = 0x00;
-		libPoly.gt4->colour[v].as_rgba.b = 0x00;
-	}
+	render_set_palette_color(red_light_color_slot, rgba(r, 0x00, 0x00, 0xff));
 }
 
 void scene_move_oil_pump(Object *pump) {
 	mat4_set_yaw_pitch_roll(&pump->mat, vec3(sin(system_cycle_time() * 0.125 * M_PI * 2), 0, 0));
 }
 
+static uint16_t scene_aurora_color_slot(int16_t coord) {
+	for (int i = 0; i < aurora_borealis.colors_len; i++) {
+		if (aurora_borealis.coords[i] == coord) {
+			return aurora_borealis.color_slots + i;
+		}
+	}
+
+	error_if(aurora_borealis.colors_len >= SCENE_AURORA_COLORS_MAX, "SCENE_AURORA_COLORS_MAX reached");
+	aurora_borealis.coords[aurora_borealis.colors_len] = coord;
+	return aurora_borealis.color_slots + aurora_borealis.colors_len++;
+}
+
 void scene_init_aurora_borealis() {
 	aurora_borealis.enabled = true;
-	clear(aurora_borealis.grey_coords);
+	aurora_borealis.color_slots = render_palette_alloc(SCENE_AURORA_COLORS_MAX);
+	aurora_borealis.colors_len = 0;
 
 	int count = 0;
 	int16_t *coords;
@@ -213,18 +494,15 @@ void scene_init_aurora_borealis() {
 		case PRM_TYPE_GT4:
 			coords = poly.gt4->coords;
 			y = sky_object->vertices[coords[0]].y;
-			if (y < -6000) { // -8000
-				aurora_borealis.primitives[count] = poly.gt4;
-				if (y > -6800) {
-					aurora_borealis.coords[count] = poly.gt4->coords;
-					aurora_borealis.grey_coords[count] = -1;
-				}
-				else if (y < -11000) {
-					aurora_borealis.coords[count] = poly.gt4->coords;
-					aurora_borealis.grey_coords[count] = -2;
-				}
-				else {
-					aurora_borealis.coords[count] = poly.gt4->coords;
+			if (y < -6000 && count < SCENE_AURORA_PRIMITIVES_MAX) { // -8000
+				// The primitives at the two edges of the aurora only animate
+				// two of their vertices and keep their grey on the others
+				bool animate_top = !(y < -11000);
+				bool animate_bottom = !(y > -6800);
+				for (int v = 0; v < 4; v++) {
+					if (v < 2 ? animate_top : animate_bottom) {
+						object_set_color_slot(sky_object, i, v, scene_aurora_color_slot(coords[v]));
+					}
 				}
 				count++;
 			}
@@ -232,33 +510,20 @@ void scene_init_aurora_borealis() {
 			break;
 		}
 	}
+
+	// The mesh baked in scene_load() doesn't have the slots yet
+	object_bake(sky_object);
 }
 
 void scene_update_aurora_borealis(void) {
 	float phase = system_time() / 30.0;
-	for (int i = 0; i < 80; i++) {
-		int16_t *coords = aurora_borealis.coords[i];
-
-		if (aurora_borealis.grey_coords[i] != -2) {
-			aurora_borealis.primitives[i]->colour[0].as_rgba.r = (sin(coords[0] * phase) * 64.0) + 190;
-			aurora_borealis.primitives[i]->colour[0].as_rgba.g = (sin(coords[0] * (phase + 0.054)) * 64.0) + 190;
-			aurora_borealis.primitives[i]->colour[0].as_rgba.b = (sin(coords[0] * (phase + 0.039)) * 64.0) + 190;
-		}
-		if (aurora_borealis.grey_coords[i] != -2) {
-			aurora_borealis.primitives[i]->colour[1].as_rgba.r = (sin(coords[1] * phase) * 64.0) + 190;
-			aurora_borealis.primitives[i]->colour[1].as_rgba.g = (sin(coords[1] * (phase + 0.054)) * 64.0) + 190;
-			aurora_borealis.primitives[i]->colour[1].as_rgba.b = (sin(coords[1] * (phase + 0.039)) * 64.0) + 190;
-		}
-		if (aurora_borealis.grey_coords[i] != -1) {
-			aurora_borealis.primitives[i]->colour[2].as_rgba.r = (sin(coords[2] * phase) * 64.0) + 190;
-			aurora_borealis.primitives[i]->colour[2].as_rgba.g = (sin(coords[2] * (phase + 0.054)) * 64.0) + 190;
-			aurora_borealis.primitives[i]->colour[2].as_rgba.b = (sin(coords[2] * (phase + 0.039)) * 64.0) + 190;
-		}
-
-		if (aurora_borealis.grey_coords[i] != -1) {
-			aurora_borealis.primitives[i]->colour[3].as_rgba.r = (sin(coords[3] * phase) * 64.0) + 190;
-			aurora_borealis.primitives[i]->colour[3].as_rgba.g = (sin(coords[3] * (phase + 0.054)) * 64.0) + 190;
-			aurora_borealis.primitives[i]->colour[3].as_rgba.b = (sin(coords[3] * (phase + 0.039)) * 64.0) + 190;
-		}
+	for (int i = 0; i < aurora_borealis.colors_len; i++) {
+		int16_t coord = aurora_borealis.coords[i];
+		render_set_palette_color(aurora_borealis.color_slots + i, rgba(
+			(sin(coord * phase) * 64.0) + 190,
+			(sin(coord * (phase + 0.054)) * 64.0) + 190,
+			(sin(coord * (phase + 0.039)) * 64.0) + 190,
+			255
+		));
 	}
 }
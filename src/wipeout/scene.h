@@ -4,11 +4,21 @@
 #include "image.h"
 #include "camera.h"
 
+typedef struct {
+	int32_t objects_drawn;
+	int32_t objects_culled;
+	int32_t lod_tris_saved;
+} scene_draw_stats_t;
+
 void scene_load(const char *path, float sky_y_offset);
-void scene_draw(camera_t *camera);
+// Draws either all visible objects that are fully opaque or all that are 
+// (partially) faded out
+void scene_draw(camera_t *camera, bool faded);
+void scene_draw_sky(camera_t *camera);
 void scene_init(void);
 void scene_set_start_booms(int num_lights);
 void scene_init_aurora_borealis(void);
 void scene_update(void);
+scene_draw_stats_t scene_get_draw_stats(void);
 
 #endif
@@ -70,7 +70,7 @@ void sfx_load(void) {
 	uint8_t *vb = file_load("wipeout/sound/wipeout.vb", &vb_size);
 	uint32_t num_samples = (vb_size / 16) * 28;
 
-	int16_t *sample_buffer = mem_bump(num_samples * sizeof(int16_t));
+	int16_t *sample_buffer = mem_bump_uninit(num_samples * sizeof(int16_t));
 	sources = mem_mark();
 	num_sources = 0;
 
@@ -18,6 +18,7 @@
 
 void ships_load() {
 	texture_list_t ship_textures = image_get_compressed_textures("wipeout/common/allsh.cmp");
+	texture_list_prefetch(ship_textures);
 	Object *ship_models = objects_load("wipeout/common/allsh.prm", ship_textures);
 
 	texture_list_t collision_textures = image_get_compressed_textures("wipeout/common/alcol.cmp");
@@ -172,11 +173,14 @@ void ships_update() {
 
 void ships_draw() {
 	mat4_t _mat4;
+	frustum_t frustum = render_frustum();
+
 	// Ship models
 	for (int i = 0; i < len(g.ships); i++) {
 		if (
 			flags_is(g.ships[i].flags, SHIP_VIEW_INTERNAL) ||
-			(g.race_type == RACE_TYPE_TIME_TRIAL && i != g.pilot)
+			(g.race_type == RACE_TYPE_TIME_TRIAL && i != g.pilot) ||
+			!object_is_visible(g.ships[i].model, &g.ships[i].mat, &frustum)
 		) {
 			continue;
 		}
@@ -2,45 +2,257 @@
 #include "../utils.h"
 #include "../render.h"
 #include "../system.h"
+#include "../platform.h"
+#include "../occlusion.h"
+#include "../jobs.h"
 
 #include "object.h"
 #include "track.h"
 #include "camera.h"
 #include "object.h"
 #include "game.h"
+#include "pack.h"
+
+// Sub tiles are shared by many tiles and resolutions, so each one that is
+// referenced is decoded once into a cache that lives for the load. Tiles
+// are then assembled from the cache in batches; each tile is copied together
+// by a worker, then the batch is uploaded in order on this thread, so the
+// texture indices are the same as with a serial load.
+
+#define TRACK_TILES_BATCH_LEN 64
+#define TRACK_SUB_TILE_SIZE 32
+
+typedef struct {
+	cmp_t *cmp;
+	uint16_t *indices; // Of the sub tiles to decode
+	rgba_t *pixels; // Room for all sub tiles in the cmp, by sub tile index
+} track_sub_tiles_t;
+
+typedef struct {
+	ttf_t *ttf;
+	rgba_t *sub_tiles;
+	int grid; // Sub tiles per side: 4 for high, 2 for med, 1 for far res
+	uint32_t first;
+	image_t *tiles;
+} track_tiles_batch_t;
+
+static void track_decode_sub_tile(void *user, uint32_t index) {
+	track_sub_tiles_t *sub_tiles = user;
+	uint16_t sub_tile_index = sub_tiles->indices[index];
+	uint8_t *bytes = sub_tiles->cmp->entries[sub_tile_index];
+
+	uint32_t width, height;
+	image_size_from_bytes(bytes, &width, &height);
+	error_if(
+		width != TRACK_SUB_TILE_SIZE || height != TRACK_SUB_TILE_SIZE, 
+		"Track sub tile %d is %dx%d", sub_tile_index, width, height
+	);
+	image_decode_from_bytes(bytes, false, sub_tiles->pixels + sub_tile_index * TRACK_SUB_TILE_SIZE * TRACK_SUB_TILE_SIZE);
+}
 
-void track_load(const char *base_path) {
-	// Load and assemble high res track tiles
+static uint16_t *track_sub_tile_indices(ttf_tile_t *ttf_tile, int grid) {
+	return grid == 4 
+		? ttf_tile->near 
+		: (grid == 2 ? ttf_tile->med : &ttf_tile->far);
+}
 
-	g.track.textures.start = render_textures_len();
-	g.track.textures.len = 0;
+static void track_assemble_tile(void *user, uint32_t index) {
+	track_tiles_batch_t *batch = user;
+	uint16_t *sub_tile_indices = track_sub_tile_indices(&batch->ttf->tiles[batch->first + index], batch->grid);
+
+	for (int tx = 0; tx < batch->grid; tx++) {
+		for (int ty = 0; ty < batch->grid; ty++) {
+			uint16_t sub_tile_index = sub_tile_indices[ty * batch->grid + tx];
+			image_t sub_tile = {
+				.width = TRACK_SUB_TILE_SIZE, 
+				.height = TRACK_SUB_TILE_SIZE, 
+				.pixels = batch->sub_tiles + sub_tile_index * TRACK_SUB_TILE_SIZE * TRACK_SUB_TILE_SIZE
+			};
+			image_copy(
+				&sub_tile, &batch->tiles[index], 0, 0, TRACK_SUB_TILE_SIZE, TRACK_SUB_TILE_SIZE, 
+				tx * TRACK_SUB_TILE_SIZE, ty * TRACK_SUB_TILE_SIZE
+			);
+		}
+	}
+}
 
-	ttf_t *ttf = track_load_tile_format(get_path(base_path, "library.ttf"));
-	cmp_t *cmp = image_load_compressed(get_path(base_path, "library.cmp"));
+static rgba_t *track_decode_sub_tiles(ttf_t *ttf, cmp_t *cmp) {
+	rgba_t *pixels = mem_temp_alloc(cmp->len * TRACK_SUB_TILE_SIZE * TRACK_SUB_TILE_SIZE * sizeof(rgba_t));
+	uint8_t *is_referenced = mem_temp_alloc(cmp->len);
+	uint16_t *indices = mem_temp_alloc(cmp->len * sizeof(uint16_t));
+	memset(is_referenced, 0, cmp->len);
 
-	image_t *temp_tile = image_alloc(128, 128);
+	uint32_t references = 0;
+	uint32_t indices_len = 0;
 	for (int i = 0; i < ttf->len; i++) {
-		for (int tx = 0; tx < 4; tx++) {
-			for (int ty = 0; ty < 4; ty++) {
-				uint32_t sub_tile_index = ttf->tiles[i].near[ty * 4 + tx];
-				image_t *sub_tile = image_load_from_bytes(cmp->entries[sub_tile_index], false);
-				image_copy(sub_tile, temp_tile, 0, 0, 32, 32, tx * 32, ty * 32);
-				mem_temp_free(sub_tile);
+		for (int grid = 4; grid > 0; grid /= 2) {
+			uint16_t *sub_tile_indices = track_sub_tile_indices(&ttf->tiles[i], grid);
+			for (int j = 0; j < grid * grid; j++) {
+				uint16_t sub_tile_index = sub_tile_indices[j];
+				error_if(sub_tile_index >= cmp->len, "Track sub tile %d not in library of len %d", sub_tile_index, cmp->len);
+				if (!is_referenced[sub_tile_index]) {
+					is_referenced[sub_tile_index] = true;
+					indices[indices_len++] = sub_tile_index;
+				}
+				references++;
 			}
 		}
-		render_texture_create(temp_tile->width, temp_tile->height, temp_tile->pixels);
-		g.track.textures.len++;
 	}
 
-	mem_temp_free(temp_tile);
+	double decode_start = platform_real_time();
+	track_sub_tiles_t sub_tiles = {.cmp = cmp, .indices = indices, .pixels = pixels};
+	jobs_run(track_decode_sub_tile, &sub_tiles, indices_len);
+	double decode_time = platform_real_time() - decode_start;
+
+	uint32_t hits = references - indices_len;
+	g.track.load_stats = (track_load_stats_t){
+		.sub_tile_references = references,
+		.sub_tiles_decoded = indices_len,
+		.decode_time = decode_time,
+		.decode_time_saved = indices_len ? decode_time * hits / indices_len : 0
+	};
+
+	mem_temp_free(indices);
+	mem_temp_free(is_referenced);
+	return pixels;
+}
+
+static texture_list_t track_load_tiles_res(ttf_t *ttf, rgba_t *sub_tiles, int grid, bool write_pack) {
+	texture_list_t list = {.start = render_textures_len(), .len = ttf->len};
+	uint32_t size = grid * TRACK_SUB_TILE_SIZE;
+	image_t *tiles = mem_temp_alloc((sizeof(image_t) + size * size * sizeof(rgba_t)) * TRACK_TILES_BATCH_LEN);
+	rgba_t *pixels = (rgba_t *)(tiles + TRACK_TILES_BATCH_LEN);
+	for (int i = 0; i < TRACK_TILES_BATCH_LEN; i++) {
+		tiles[i] = (image_t){.width = size, .height = size, .pixels = pixels + i * size * size};
+	}
+
+	for (uint32_t first = 0; first < ttf->len; first += TRACK_TILES_BATCH_LEN) {
+		uint32_t len = minint(ttf->len - first, TRACK_TILES_BATCH_LEN);
+		track_tiles_batch_t batch = {.ttf = ttf, .sub_tiles = sub_tiles, .grid = grid, .first = first, .tiles = tiles};
+		jobs_run(track_assemble_tile, &batch, len);
+
+		for (int i = 0; i < len; i++) {
+			if (write_pack) {
+				pack_write_image(&tiles[i]);
+			}
+			else {
+				render_texture_create(tiles[i].width, tiles[i].height, tiles[i].pixels);
+			}
+		}
+	}
+
+	mem_temp_free(tiles);
+	return list;
+}
+
+// Returns the mapped pack with the tiles, or NULL if they were uploaded
+static pack_header_t *track_load_tiles(char *ttf_path, char *cmp_path) {
+	ttf_t *ttf = track_load_tile_format(ttf_path);
+	cmp_t *cmp = image_load_compressed(cmp_path);
+	rgba_t *sub_tiles = track_decode_sub_tiles(ttf, cmp);
+
+	// Once the pack is written, the tiles can be made lazy from it. Without
+	// packs, all of them have to be uploaded now.
+	pack_header_t *pack = NULL;
+	if (pack_write_begin(cmp_path, ttf_path, PACK_TRACK_TILES, sizeof(rgba_t), ttf->len * 3)) {
+		for (int grid = 4; grid > 0; grid /= 2) {
+			track_load_tiles_res(ttf, sub_tiles, grid, true);
+		}
+		pack_write_end();
+		pack = pack_map(cmp_path, ttf_path, PACK_TRACK_TILES, sizeof(rgba_t));
+	}
+	if (!pack) {
+		g.track.textures = track_load_tiles_res(ttf, sub_tiles, 4, false); // 128x128
+		g.track.textures_med = track_load_tiles_res(ttf, sub_tiles, 2, false); // 64x64
+		g.track.textures_far = track_load_tiles_res(ttf, sub_tiles, 1, false); // 32x32
+	}
+
+	mem_temp_free(sub_tiles);
 	mem_temp_free(cmp);
 	mem_temp_free(ttf);
+	return pack;
+}
 
-	vec3_t *vertices = track_load_vertices(get_path(base_path, "track.trv"));
-	track_load_faces(get_path(base_path, "track.trf"), vertices);
-	mem_temp_free(vertices);
+static void track_tile_load_mapped(void *user, uint32_t width, uint32_t height, rgba_t *pixels) {
+	memcpy(pixels, user, width * height * sizeof(rgba_t));
+}
 
-	track_load_sections(get_path(base_path, "track.trs"));
+static void track_load_tiles_from_pack(pack_header_t *pack) {
+	// The pack holds the assembled high, med and far res tiles in order. They
+	// are only copied into the atlas when a section first draws them, so
+	// the pack stays mapped.
+	uint32_t len = pack->len / 3;
+	texture_list_t *lists[3] = {&g.track.textures, &g.track.textures_med, &g.track.textures_far};
+	for (int l = 0; l < 3; l++) {
+		lists[l]->start = render_textures_len();
+		lists[l]->len = len;
+		for (int i = 0; i < len; i++) {
+			image_t tile = pack_image(pack, l * len + i);
+			render_texture_create_lazy(tile.width, tile.height, track_tile_load_mapped, tile.pixels);
+		}
+	}
+}
+
+void track_load(const char *base_path) {
+	// Load and assemble the track tiles in all three resolutions; each 
+	// resolution gets its own contiguous texture list. The assembled tiles
+	// are kept in a pack next to the library.cmp; with the pack, a tile only
+	// takes up room in the atlas once it is drawn in that resolution.
+
+	g.track.load_stats = (track_load_stats_t){0};
+
+	char cmp_path[64], ttf_path[64];
+	strcpy(cmp_path, get_path(base_path, "library.cmp"));
+	strcpy(ttf_path, get_path(base_path, "library.ttf"));
+	pack_header_t *tiles_pack = pack_map(cmp_path, ttf_path, PACK_TRACK_TILES, sizeof(rgba_t));
+	if (tiles_pack && tiles_pack->len % 3 != 0) {
+		pack_unmap(tiles_pack);
+		tiles_pack = NULL;
+	}
+	if (!tiles_pack) {
+		tiles_pack = track_load_tiles(ttf_path, cmp_path);
+	}
+	if (tiles_pack) {
+		track_load_tiles_from_pack(tiles_pack);
+	}
+
+	// Faces from a pack are used in place; the mapping is copy-on-write, so
+	// the color changes below and during the race don't touch the file. It 
+	// stays mapped until the scene is unloaded.
+	char trf_path[64], trv_path[64];
+	strcpy(trf_path, get_path(base_path, "track.trf"));
+	strcpy(trv_path, get_path(base_path, "track.trv"));
+	pack_header_t *faces_pack = pack_map(trf_path, trv_path, PACK_TRACK_FACES, sizeof(track_face_t));
+	if (faces_pack && faces_pack->data_size == faces_pack->len * sizeof(track_face_t)) {
+		g.track.face_count = faces_pack->len;
+		g.track.faces = pack_data(faces_pack);
+	}
+	else {
+		if (faces_pack) {
+			pack_unmap(faces_pack);
+		}
+		vec3_t *vertices = track_load_vertices(trv_path);
+		track_load_faces(trf_path, vertices);
+		mem_temp_free(vertices);
+
+		if (pack_write_begin(trf_path, trv_path, PACK_TRACK_FACES, sizeof(track_face_t), g.track.face_count)) {
+			pack_write_bytes(g.track.faces, sizeof(track_face_t) * g.track.face_count);
+			pack_write_end();
+		}
+	}
+
+	// The view lists (potentially visible sections) are optional; without
+	// them we just draw everything in range.
+	uint32_t view_size = 0;
+	uint8_t *view_bytes = NULL;
+	if (file_exists(get_path(base_path, "track.vew"))) {
+		view_bytes = file_load(get_path(base_path, "track.vew"), &view_size);
+	}
+	track_load_sections(get_path(base_path, "track.trs"), view_bytes, view_size);
+	if (view_bytes) {
+		mem_temp_free(view_bytes);
+	}
+	track_calc_section_bounds();
 
 	g.track.pickups_len = 0;
 	section_t *s = g.track.sections;
@@ -73,6 +285,15 @@ void track_load(const char *base_path) {
 				g.track.pickups[g.track.pickups_len].face = face;
 				g.track.pickups[g.track.pickups_len].cooldown_timer = 0;
 				g.track.pickups_len++;
+
+				// Pickups cycle their color; give them a palette slot
+				uint16_t slot = render_palette_alloc(1);
+				render_set_palette_color(slot, face->tris[0].vertices[0].color);
+				for (int t = 0; t < 2; t++) {
+					for (int v = 0; v < 3; v++) {
+						face->tris[t].vertices[v].color_slot = slot;
+					}
+				}
 			}
 			
 			if (flags_is(face->flags, FACE_BOOST)) {
@@ -150,7 +371,7 @@ void track_load_faces(char *file_name, vec3_t *vertices) {
 	uint8_t *bytes = file_load(file_name, &size);
 
 	g.track.face_count = size / 20; // TRACK_FACE_DATA_SIZE
-	g.track.faces = mem_bump(sizeof(track_face_t) * g.track.face_count);
+	g.track.faces = mem_bump_uninit(sizeof(track_face_t) * g.track.face_count);
 
 	uint32_t p = 0;
 	track_face_t *tf = g.track.faces;
@@ -187,7 +408,54 @@ void track_load_faces(char *file_name, vec3_t *vertices) {
 }
 
 
-void track_load_sections(char *file_name) {
+static void track_load_section_pvs(section_t *section, int32_t section_index, uint8_t *view_bytes, uint32_t view_size, int32_t *offsets, int16_t *counts) {
+	// Each detail level is a list of big endian section indices in the .vew
+	// file, referenced by byte offset. Lists that don't fit the file, point
+	// to invalid sections or don't contain the section itself are rejected
+	// and the section falls back to the plain distance test.
+	int32_t len = 0;
+	for (int i = 0; i < 3; i++) {
+		if (counts[i] < 0 || offsets[i] < 0 || offsets[i] + counts[i] * 2 > view_size) {
+			return;
+		}
+		len += counts[i];
+	}
+	if (len == 0) {
+		return;
+	}
+
+	uint8_t seen[TRACK_SECTIONS_MAX] = {0};
+	bool has_self = false;
+	int16_t *pvs = mem_bump(sizeof(int16_t) * len);
+	int16_t pvs_len = 0;
+
+	for (int i = 0; i < 3; i++) {
+		uint32_t p = offsets[i];
+		for (int j = 0; j < counts[i]; j++) {
+			int16_t index = get_i16(view_bytes, &p);
+			if (index < 0 || index >= g.track.section_count || index >= TRACK_SECTIONS_MAX) {
+				mem_reset(pvs);
+				return;
+			}
+			if (seen[index]) {
+				continue;
+			}
+			seen[index] = true;
+			has_self = has_self || (index == section_index);
+			pvs[pvs_len++] = index;
+		}
+	}
+
+	if (!has_self) {
+		mem_reset(pvs);
+		return;
+	}
+
+	section->pvs = pvs;
+	section->pvs_len = pvs_len;
+}
+
+void track_load_sections(char *file_name, uint8_t *view_bytes, uint32_t view_size) {
 	uint32_t size;
 	uint8_t *bytes = file_load(file_name, &size);
 
@@ -217,8 +485,28 @@ void track_load_sections(char *file_name) {
 		p += 2; // padding
 
 		p += 4 + 4; // objects pointer, objectCount
-		p += 5 * 3 * 4; // view section pointers
-		p += 5 * 3 * 2; // view section counts
+
+		// View section pointers and counts for the north, south, east, west 
+		// and all directions; 3 detail levels each. We only use the lists 
+		// for all directions and rely on the frustum test for the rest.
+		int32_t view_offsets[5][3];
+		int16_t view_counts[5][3];
+		for (int j = 0; j < 5; j++) {
+			for (int k = 0; k < 3; k++) {
+				view_offsets[j][k] = get_i32(bytes, &p);
+			}
+		}
+		for (int j = 0; j < 5; j++) {
+			for (int k = 0; k < 3; k++) {
+				view_counts[j][k] = get_i16(bytes, &p);
+			}
+		}
+
+		ts->pvs = NULL;
+		ts->pvs_len = 0;
+		if (view_bytes) {
+			track_load_section_pvs(ts, i, view_bytes, view_size, view_offsets[4], view_counts[4]);
+		}
 
 		for (int j = 0; j < 4; j++) {
 			ts->high[j] = get_i16(bytes, &p);
@@ -241,39 +529,180 @@ void track_load_sections(char *file_name) {
 	mem_temp_free(bytes);
 }
 
+void track_calc_section_bounds() {
+	section_t *s = g.track.sections;
+	for (int32_t i = 0; i < g.track.section_count; i++, s++) {
+		s->bounds_min = s->center;
+		s->bounds_max = s->center;
+
+		track_face_t *face = g.track.faces + s->face_start;
+		for (int32_t f = 0; f < s->face_count; f++, face++) {
+			for (int t = 0; t < 2; t++) {
+				for (int v = 0; v < 3; v++) {
+					vec3_t pos = face->tris[t].vertices[v].pos;
+					s->bounds_min = vec3(minfloat(s->bounds_min.x, pos.x), minfloat(s->bounds_min.y, pos.y), minfloat(s->bounds_min.z, pos.z));
+					s->bounds_max = vec3(maxfloat(s->bounds_max.x, pos.x), maxfloat(s->bounds_max.y, pos.y), maxfloat(s->bounds_max.z, pos.z));
+				}
+			}
+		}
+	}
+}
 
 
 
-void track_draw_section(section_t *section) {
+static bool track_section_is_visible(section_t *section, vec3_t cam_pos, frustum_t *frustum) {
+	vec3_t d = vec3_sub(cam_pos, section->center);
+	float dist_sq = d.x * d.x + d.y * d.y + d.z * d.z;
+	float fadeout_far = render_fadeout().y;
+	if (dist_sq >= fadeout_far * fadeout_far) {
+		return false;
+	}
+	if (!frustum_test_aabb(frustum, section->bounds_min, section->bounds_max)) {
+		return false;
+	}
+	if (dist_sq >= TRACK_OCCLUDER_DIST * TRACK_OCCLUDER_DIST) {
+		return occlusion_test_aabb(section->bounds_min, section->bounds_max);
+	}
+	return true;
+}
+
+static bool track_section_is_faded(section_t *section, vec3_t cam_pos) {
+	// Distance to the farthest corner of the bounding box
+	vec3_t d = vec3(
+		maxfloat(fabs(cam_pos.x - section->bounds_min.x), fabs(cam_pos.x - section->bounds_max.x)),
+		maxfloat(fabs(cam_pos.y - section->bounds_min.y), fabs(cam_pos.y - section->bounds_max.y)),
+		maxfloat(fabs(cam_pos.z - section->bounds_min.z), fabs(cam_pos.z - section->bounds_max.z))
+	);
+	float fadeout_near = render_fadeout().x;
+	return d.x * d.x + d.y * d.y + d.z * d.z >= fadeout_near * fadeout_near;
+}
+
+static void track_add_section_occluders(section_t *section, vec3_t cam_pos, frustum_t *frustum) {
+	vec3_t d = vec3_sub(cam_pos, section->center);
+	float dist_sq = d.x * d.x + d.y * d.y + d.z * d.z;
+	if (
+		dist_sq >= TRACK_OCCLUDER_DIST * TRACK_OCCLUDER_DIST ||
+		!frustum_test_aabb(frustum, section->bounds_min, section->bounds_max)
+	) {
+		return;
+	}
+
+	track_face_t *face = g.track.faces + section->face_start;
+	for (int32_t i = 0; i < section->face_count; i++, face++) {
+		occlusion_add_tris(&face->tris[0]);
+		occlusion_add_tris(&face->tris[1]);
+	}
+}
+
+void track_draw_occluders(camera_t *camera) {
+	mat4_t vp_mat = render_view_projection();
+	occlusion_begin(&vp_mat);
+
+	vec3_t cam_pos = camera->position;
+	frustum_t frustum = render_frustum();
+
+	section_t *cs = camera->section;
+	if (cs && cs->pvs_len) {
+		for (int32_t i = 0; i < cs->pvs_len; i++) {
+			track_add_section_occluders(g.track.sections + cs->pvs[i], cam_pos, &frustum);
+		}
+	}
+	else {
+		for (int32_t i = 0; i < g.track.section_count; i++) {
+			track_add_section_occluders(g.track.sections + i, cam_pos, &frustum);
+		}
+	}
+}
+
+static track_lod_t track_section_lod(section_t *section, vec3_t cam_pos) {
+	float d = vec3_len(vec3_sub(cam_pos, section->center));
+	if (d > TRACK_LOD_FAR_DIST) {
+		return TRACK_LOD_FAR;
+	}
+	else if (d > TRACK_LOD_MED_DIST) {
+		return TRACK_LOD_MED;
+	}
+	return TRACK_LOD_NEAR;
+}
+
+void track_draw_section(section_t *section, track_lod_t lod) {
 	track_face_t *face = g.track.faces + section->face_start;
 	int16_t face_count = section->face_count;
 	
+	if (lod == TRACK_LOD_NEAR) {
+		for (uint32_t j = 0; j < face_count; j++) {
+			uint16_t tex_index = texture_from_list(g.track.textures, face->texture);
+			render_push_tris(face->tris[0], tex_index);
+			render_push_tris(face->tris[1], tex_index);
+			face++;
+		}
+		return;
+	}
+
+	// The face uvs are in texels of the 128x128 tile; scale them down to 
+	// the smaller tile
+	texture_list_t textures = lod == TRACK_LOD_MED ? g.track.textures_med : g.track.textures_far;
+	float uv_scale = lod == TRACK_LOD_MED ? 0.5 : 0.25;
 
 	for (uint32_t j = 0; j < face_count; j++) {
-		uint16_t tex_index = texture_from_list(g.track.textures, face->texture);
-		render_push_tris(face->tris[0], tex_index);
-		render_push_tris(face->tris[1], tex_index);
+		uint16_t tex_index = texture_from_list(textures, face->texture);
+		for (int t = 0; t < 2; t++) {
+			tris_t tris = face->tris[t];
+			for (int v = 0; v < 3; v++) {
+				tris.vertices[v].uv.x *= uv_scale;
+				tris.vertices[v].uv.y *= uv_scale;
+			}
+			render_push_tris(tris, tex_index);
+		}
 		face++;
 	}
 }
 
-void track_draw(camera_t *camera) {	
+void track_draw(camera_t *camera, bool faded) {	
 	mat4_t _mat;
 	_mat = mat4_identity();
 	render_set_model_mat(&_mat);	
 	
-	float max_dist_sq = RENDER_FADEOUT_FAR * RENDER_FADEOUT_FAR;
 	vec3_t cam_pos = camera->position;
+	frustum_t frustum = render_frustum();
+	track_draw_stats_t *stats = &g.track.draw_stats;
+	if (!faded) {
+		stats->sections_drawn = 0;
+		stats->tris_drawn = 0;
+	}
 
-	section_t *s = g.track.sections;
-	for(int32_t i = 0; i < g.track.section_count; ++i, ++s)
-	{
-		vec3_t d = vec3_sub(cam_pos, s->center);
-		float dist_sq = d.x * d.x + d.y * d.y + d.z * d.z;
-		if (dist_sq <  max_dist_sq) {
-			track_draw_section(s);
+	// Only consider the sections visible from the camera's section, if we 
+	// have a view list for it; otherwise test all sections
+	section_t *cs = camera->section;
+	if (cs && cs->pvs_len) {
+		for (int32_t i = 0; i < cs->pvs_len; i++) {
+			section_t *s = g.track.sections + cs->pvs[i];
+			if (
+				track_section_is_faded(s, cam_pos) == faded &&
+				track_section_is_visible(s, cam_pos, &frustum)
+			) {
+				track_draw_section(s, track_section_lod(s, cam_pos));
+				stats->sections_drawn++;
+				stats->tris_drawn += s->face_count * 2;
+			}
 		}
 	}
+	else {
+		section_t *s = g.track.sections;
+		for (int32_t i = 0; i < g.track.section_count; i++, s++) {
+			if (
+				track_section_is_faded(s, cam_pos) == faded &&
+				track_section_is_visible(s, cam_pos, &frustum)
+			) {
+				track_draw_section(s, track_section_lod(s, cam_pos));
+				stats->sections_drawn++;
+				stats->tris_drawn += s->face_count * 2;
+			}
+		}
+	}
+
+	stats->sections_culled = g.track.section_count - stats->sections_drawn;
+	stats->tris_culled = g.track.face_count * 2 - stats->tris_drawn;
 }
 
 void track_cycle_pickups() {
@@ -300,6 +729,12 @@ void track_cycle_pickups() {
 }
 
 void track_face_set_color(track_face_t *face, rgba_t color) {
+	// Animated faces only need to update their palette slot
+	if (face->tris[0].vertices[0].color_slot) {
+		render_set_palette_color(face->tris[0].vertices[0].color_slot, color);
+		return;
+	}
+
 	face->tris[0].vertices[0].color = color;
 	face->tris[0].vertices[1].color = color;
 	face->tris[0].vertices[2].color = color;
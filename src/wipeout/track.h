@@ -18,6 +18,22 @@
 #define TRACK_SEARCH_LOOK_BACK 3
 #define TRACK_SEARCH_LOOK_AHEAD 6
 
+// Sections closer than this are rasterized as occluders; sections further 
+// away are tested against the occlusion buffer
+#define TRACK_OCCLUDER_DIST 16000.0
+
+// Sections further away than these use the 64x64 (med) and 32x32 (far) 
+// versions of the track tiles
+#define TRACK_LOD_MED_DIST 10000.0
+#define TRACK_LOD_FAR_DIST 20000.0
+
+typedef enum {
+	TRACK_LOD_NEAR,
+	TRACK_LOD_MED,
+	TRACK_LOD_FAR,
+	TRACK_LOD_MAX
+} track_lod_t;
+
 typedef struct track_face_t {
 	tris_t tris[2];
 	vec3_t normal;
@@ -60,6 +76,12 @@ typedef struct section_t {
 
 	int16_t flags;
 	int16_t num;
+
+	vec3_t bounds_min;
+	vec3_t bounds_max;
+
+	int16_t *pvs; // Indices of all sections visible from this one
+	int16_t pvs_len;
 } section_t;
 
 #define SECTION_JUMP            1
@@ -72,6 +94,22 @@ typedef struct {
 	float cooldown_timer;
 } track_pickup_t;
 
+typedef struct {
+	int32_t sections_drawn;
+	int32_t sections_culled;
+	int32_t tris_drawn;
+	int32_t tris_culled;
+} track_draw_stats_t;
+
+// Filled when the tiles are assembled from the library; all zero when they
+// came from a pack.
+typedef struct {
+	int32_t sub_tile_references;
+	int32_t sub_tiles_decoded;
+	double decode_time;
+	double decode_time_saved; // Average time per decoded sub tile, for each hit
+} track_load_stats_t;
+
 typedef struct track_t {
 	int32_t vertex_count;
 	int32_t face_count;
@@ -79,10 +117,15 @@ typedef struct track_t {
 	int32_t pickups_len;
 	int32_t total_section_nums;
 	texture_list_t textures;
+	texture_list_t textures_med;
+	texture_list_t textures_far;
 	
 	track_face_t *faces;
 	section_t *sections;
 	track_pickup_t *pickups;
+
+	track_draw_stats_t draw_stats;
+	track_load_stats_t load_stats;
 } track_t;
 
 
@@ -90,14 +133,18 @@ void track_load(const char *base_path);
 ttf_t *track_load_tile_format(char *ttf_name);
 vec3_t *track_load_vertices(char *file);
 void track_load_faces(char *file, vec3_t *vertices);
-void track_load_sections(char *file);
+void track_load_sections(char *file, uint8_t *view_bytes, uint32_t view_size);
+void track_calc_section_bounds(void);
 bool track_collect_pickups(track_face_t *face);
 void track_face_set_color(track_face_t *face, rgba_t color);
 track_face_t *track_section_get_base_face(section_t *section);
 section_t *track_nearest_section(vec3_t pos, section_t *section, float *distance);
 
 struct camera_t;
-void track_draw(struct camera_t *camera);
+// Draws either all visible sections that are fully opaque or all that are 
+// (partially) faded out
+void track_draw(struct camera_t *camera, bool faded);
+void track_draw_occluders(struct camera_t *camera);
 
 void track_cycle_pickups(void);
 
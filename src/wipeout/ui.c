@@ -57,6 +57,7 @@ uint16_t icon_textures[UI_ICON_MAX];
 
 void ui_load() {
 	texture_list_t tl = image_get_compressed_textures("wipeout/textures/drfonts.cmp");
+	texture_list_prefetch(tl);
 	char_set[UI_SIZE_16].texture   = texture_from_list(tl, 0);
 	char_set[UI_SIZE_12].texture   = texture_from_list(tl, 1);
 	char_set[UI_SIZE_8 ].texture   = texture_from_list(tl, 2);
@@ -49,6 +49,7 @@ struct {
 	Object *shield;
 	Object *shield_internal;
 	Object *ebolt;
+	uint16_t mine_light_color_slot;
 } weapon_assets;
 
 void weapon_update_wait_for_delay(weapon_t *self);
@@ -87,6 +88,30 @@ void weapons_load() {
 	weapon_assets.shield_internal = objects_load("wipeout/common/shld.prm", weapon_textures);
 	weapon_assets.ebolt = objects_load("wipeout/common/ebolt.prm", weapon_textures);
 
+	// Shields get their alpha changed at runtime; the mine is baked once its
+	// palette slots are set
+	object_bake(weapon_assets.rocket);
+	object_bake(weapon_assets.missile);
+	object_bake(weapon_assets.ebolt);
+
+	// The mine lights pulsate; all mines share one palette slot that is set
+	// before each mine is drawn
+	weapon_assets.mine_light_color_slot = render_palette_alloc(1);
+	Prm prm = {.primitive = weapon_assets.mine->primitives};
+	for (int i = 0; i < 8; i++) {
+		switch (prm.primitive->type) {
+		case PRM_TYPE_GT3:
+			prm.gt3->colour[0].as_rgba.r = 230;
+			prm.gt3->colour[0].as_rgba.g = 0;
+			prm.gt3->colour[0].as_rgba.b = 0;
+			object_set_color_slot(weapon_assets.mine, i, 1, weapon_assets.mine_light_color_slot);
+			object_set_color_slot(weapon_assets.mine, i, 2, weapon_assets.mine_light_color_slot);
+			prm.gt3 += 1;
+			break;
+		}
+	}
+	object_bake(weapon_assets.mine);
+
 	// Invert shield polys for internal view
 	Prm poly = {.primitive = weapon_assets.shield_internal->primitives};
 	int primitives_len = weapon_assets.shield_internal->primitives_len;
@@ -221,6 +246,7 @@ void weapons_update() {
 
 void weapons_draw() {
 	mat4_t mat = mat4_identity();
+	frustum_t frustum = render_frustum();
 	for (int i = 0; i < weapons_active; i++) {
 		weapon_t *weapon = &weapons[i];
 		if (weapon->model) {
@@ -229,7 +255,9 @@ void weapons_draw() {
 			if (weapon->model == weapon_assets.mine) {
 				weapon_update_mine_lights(weapon, i);
 			}
-			object_draw(weapon->model, &mat);
+			if (object_is_visible(weapon->model, &mat, &frustum)) {
+				object_draw(weapon->model, &mat);
+			}
 		}
 	}
 }
@@ -352,25 +380,8 @@ void weapon_update_mine_wait_for_release(weapon_t *self) {
 }
 
 void weapon_update_mine_lights(weapon_t *self, int index) {
-	Prm prm = {.primitive = self->model->primitives};
-
 	uint8_t r = sin(system_cycle_time() * M_PI * 2 + index * 0.66) * 128 + 128;
-	for (int i = 0; i < 8; i++) {
-		switch (prm.primitive->type) {
-		case PRM_TYPE_GT3:
-			prm.gt3->colour[0].as_rgba.r = 230;
-			prm.gt3->colour[1].as_rgba.r = r;
-			prm.gt3->colour[2].as_rgba.r = r;
-			prm.gt3->colour[0].as_rgba.g = 0;
-			prm.gt3->colour[1].as_rgba.g = 0x40;
-			prm.gt3->colour[2].as_rgba.g = 0x40;
-			prm.gt3->colour[0].as_rgba.b = 0;
-			prm.gt3->colour[1].as_rgba.b = 0;
-			prm.gt3->colour[2].as_rgba.b = 0;
-			prm.gt3 += 1;
-			break;
-		}
-	}
+	render_set_palette_color(weapon_assets.mine_light_color_slot, rgba(r, 0x40, 0, 255));
 }
 
 void weapon_update_mine(weapon_t *self) {